@@ -10,9 +10,8 @@
 #define _CRT_SECURE_NO_WARNINGS
 #include <Windows.h>
 #include <stdio.h>
-#endif
-
 #include <mmeapi.h>
+#endif
 
 #include <assert.h>
 #include <stdbool.h>
@@ -26,9 +25,6 @@
 #define OPL_CHANNELS   9u
 #define MIDI_CHANNELS 16u
 
-// event age counter
-uint32_t age;
-
 // opl channel
 struct opl_channel_t {
     uint8_t  midi_key;
@@ -41,16 +37,25 @@ struct midi_channel_t {
     uint8_t program;
 };
 
-struct opl_channel_t  opl_channel [OPL_CHANNELS];
-struct midi_channel_t midi_channel[MIDI_CHANNELS];
+// synth state, one per open device so that each plays only what is routed
+// to it
+struct adlib_t {
+    // event age counter
+    uint32_t age;
+
+    struct opl_channel_t  opl_channel [OPL_CHANNELS];
+    struct midi_channel_t midi_channel[MIDI_CHANNELS];
+};
 
 // ----------------------------------------------------------------------------
 //
 // ----------------------------------------------------------------------------
 
 // allocate the most suitable OPL channel
-static struct opl_channel_t* opl_channel_alloc()
+static struct opl_channel_t* opl_channel_alloc(struct adlib_t* adlib)
 {
+    struct opl_channel_t* opl_channel = adlib->opl_channel;
+
     // this considers:
     // - oldest channel
     // - oldest free channel
@@ -76,13 +81,13 @@ static void opl_note_off(int channel)
 // 
 // ----------------------------------------------------------------------------
 
-static void note_off(const struct midi_event_t* event)
+static void note_off(struct adlib_t* adlib, const struct midi_event_t* event)
 {
     const uint32_t channel  = event->channel;
     const uint32_t key      = event->data[0];
 
     for (int i = 0; i < OPL_CHANNELS; ++i) {
-        struct opl_channel_t *oc = &opl_channel[i];
+        struct opl_channel_t *oc = &adlib->opl_channel[i];
         if (oc->midi_key != key) {
             continue;
         }
@@ -98,7 +103,7 @@ static void note_off(const struct midi_event_t* event)
     }
 }
 
-static void note_on(const struct midi_event_t* event)
+static void note_on(struct adlib_t* adlib, const struct midi_event_t* event)
 {
     const uint32_t channel  = event->channel;
     const uint32_t key      = event->data[0];
@@ -113,14 +118,14 @@ static void note_on(const struct midi_event_t* event)
         return;
     }
 
-    struct opl_channel_t* oc = opl_channel_alloc();
-    oc->age           = age;
+    struct opl_channel_t* oc = opl_channel_alloc(adlib);
+    oc->age           = adlib->age;
     oc->midi_key      = key;
     oc->midi_channel  = channel;
     oc->midi_velocity = velocity;
 
     // lookup the program for this channel
-    struct midi_channel_t* mc = &midi_channel[channel];
+    struct midi_channel_t* mc = &adlib->midi_channel[channel];
 
     // upload program to OPL channel
     const uint32_t midi_program = mc->program;
@@ -131,7 +136,7 @@ static void note_on(const struct midi_event_t* event)
 
 }
 
-static void prog_change(const struct midi_event_t* event)
+static void prog_change(struct adlib_t* adlib, const struct midi_event_t* event)
 {
     const uint32_t channel = event->channel;
     const uint32_t program = event->data[0];
@@ -140,13 +145,13 @@ static void prog_change(const struct midi_event_t* event)
     assert(program < 128);
 
     // lookup the program for this channel
-    struct midi_channel_t* mc = &midi_channel[channel];
+    struct midi_channel_t* mc = &adlib->midi_channel[channel];
 
     // save the program
     mc->program = program;
 }
 
-static void ctrl_change(const struct midi_event_t* event)
+static void ctrl_change(struct adlib_t* adlib, const struct midi_event_t* event)
 {
 }
 
@@ -154,30 +159,36 @@ static void ctrl_change(const struct midi_event_t* event)
 // ADLIB (OPL2/OPL3) synthesizer device
 // ----------------------------------------------------------------------------
 
-static bool device_adlib_open(void)
+static bool device_adlib_open(struct device_t* device)
 {
-    return true;
+    device->user = calloc(1, sizeof(struct adlib_t));
+    return device->user != NULL;
 }
 
-static void device_adlib_send(const struct midi_event_t* event)
+static void device_adlib_send(struct device_t* device, const struct midi_event_t* event)
 {
-    ++age;
+    struct adlib_t* adlib = (struct adlib_t*)device->user;
+    ++adlib->age;
 
     switch (event->type) {
-    case e_midi_event_note_on:     note_on    (event); break;
-    case e_midi_event_note_off:    note_off   (event); break;
-    case e_midi_event_prog_change: prog_change(event); break;
-    case e_midi_event_ctrl_change: ctrl_change(event); break;
+    case e_midi_event_note_on:     note_on    (adlib, event); break;
+    case e_midi_event_note_off:    note_off   (adlib, event); break;
+    case e_midi_event_prog_change: prog_change(adlib, event); break;
+    case e_midi_event_ctrl_change: ctrl_change(adlib, event); break;
     }
 }
 
-static void device_adlib_close(void)
+static void device_adlib_close(struct device_t* device)
 {
+    free(device->user);
+    device->user = NULL;
 }
 
-void device_adlib_select(void)
+void device_adlib_select(struct device_t* device)
 {
-    device_open  = device_adlib_open;
-    device_send  = device_adlib_send;
-    device_close = device_adlib_close;
+    device->open  = device_adlib_open;
+    device->send  = device_adlib_send;
+    device->flush = NULL;
+    device->close = device_adlib_close;
+    device->user  = NULL;
 }
@@ -28,12 +28,11 @@
 // Microsoft Midi out device
 // ----------------------------------------------------------------------------
 
-// the output midi device handle
-static HMIDIOUT hmidiout;
-
-static bool device_windows_open(void)
+// note: device->user holds the HMIDIOUT of each open device
+static bool device_windows_open(struct device_t* device)
 {
     MMRESULT res = { 0 };
+    HMIDIOUT hmidiout = NULL;
 
     UINT numDevices = midiOutGetNumDevs();
     if (numDevices == 0) {
@@ -57,10 +56,11 @@ static bool device_windows_open(void)
         return false;
     }
 
+    device->user = hmidiout;
     return true;
 }
 
-static void device_windows_send(const struct midi_event_t* event)
+static void device_windows_send(struct device_t* device, const struct midi_event_t* event)
 {
     union {
         DWORD dwData;
@@ -72,17 +72,20 @@ static void device_windows_send(const struct midi_event_t* event)
     u.bData[2] = event->data[1];
     u.bData[3] = 0;
 
-    midiOutShortMsg(hmidiout, u.dwData);
+    midiOutShortMsg((HMIDIOUT)device->user, u.dwData);
 }
 
-static void device_windows_close(void)
+static void device_windows_close(struct device_t* device)
 {
-    midiOutClose(hmidiout);
+    midiOutClose((HMIDIOUT)device->user);
+    device->user = NULL;
 }
 
-void device_windows_select(void)
+void device_windows_select(struct device_t* device)
 {
-    device_open  = device_windows_open;
-    device_send  = device_windows_send;
-    device_close = device_windows_close;
+    device->open  = device_windows_open;
+    device->send  = device_windows_send;
+    device->flush = NULL;
+    device->close = device_windows_close;
+    device->user  = NULL;
 }
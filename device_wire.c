@@ -0,0 +1,236 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libmidi.h"
+#include "midiplay.h"
+
+
+// ----------------------------------------------------------------------------
+// Raw midi wire output
+// ----------------------------------------------------------------------------
+
+// every event of a scheduling slot is encoded into one buffer, using running
+// status, and goes out with a single write or datagram when the player flushes.
+// a byte stream keeps running status across writes, a datagram always starts
+// with a status byte so each one decodes on its own. a stamped output puts a
+// wire_stamp_t in front of each write, in the same system call.
+
+enum {
+    // keeps every datagram well under the loopback mtu
+    WIRE_BUFFER_SIZE = 1024,
+};
+
+// one wire output, several may be open at once
+struct wire_t {
+    const char* target;
+    int fd;
+    bool datagram;
+    bool stamped;
+    bool broken;    // the reader went away, output is dropped
+
+    uint8_t buffer[WIRE_BUFFER_SIZE];
+    size_t size;
+
+    // status byte the receiver will apply to bare data bytes, 0 when unknown
+    uint8_t running;
+};
+
+static int wire_open_udp(const char* spec)
+{
+    // "port" or "host:port"
+    char host[256] = "127.0.0.1";
+    const char* port = strrchr(spec, ':');
+    if (port) {
+        const size_t length = (size_t)(port - spec);
+        if (length >= sizeof(host)) {
+            return -1;
+        }
+        memcpy(host, spec, length);
+        host[length] = '\0';
+        ++port;
+    } else {
+        port = spec;
+    }
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    struct addrinfo* info = NULL;
+    if (getaddrinfo(host, port, &hints, &info) != 0) {
+        return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo* i = info; i && fd < 0; i = i->ai_next) {
+        fd = socket(i->ai_family, i->ai_socktype | SOCK_CLOEXEC, i->ai_protocol);
+        if (fd >= 0 && connect(fd, i->ai_addr, i->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(info);
+    return fd;
+}
+
+static bool device_wire_open(struct device_t* device)
+{
+    struct wire_t* wire = (struct wire_t*)device->user;
+    if (!wire) {
+        return false;
+    }
+    const char* target = wire->target;
+    wire->stamped = strncmp(target, "stamp:", 6) == 0;
+    if (wire->stamped) {
+        target += 6;
+    }
+    if (strncmp(target, "udp:", 4) == 0) {
+        wire->datagram = true;
+        wire->fd = wire_open_udp(target + 4);
+    } else {
+        // a fifo whose reader exits would raise SIGPIPE and end the player,
+        // the write failing with EPIPE is handled instead
+        signal(SIGPIPE, SIG_IGN);
+        // note: opening a fifo blocks until a reader connects
+        wire->datagram = false;
+        wire->fd = open(target, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+    if (wire->fd < 0) {
+        fprintf(stderr, "Unable to open '%s'\n", wire->target);
+        return false;
+    }
+    printf("Using MIDI wire output '%s'\n", wire->target);
+    wire->size = 0;
+    wire->running = 0;
+    wire->broken = false;
+    return true;
+}
+
+static uint64_t wire_usec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+// send the pending slot in one system call
+static void device_wire_flush(struct device_t* device)
+{
+    struct wire_t* wire = (struct wire_t*)device->user;
+    if (wire->size == 0 || wire->broken) {
+        wire->size = 0;
+        return;
+    }
+    struct wire_stamp_t stamp = { 0, (uint32_t)wire->size, 0 };
+    struct iovec iov[2] = {
+        { &stamp, sizeof(stamp) },
+        { wire->buffer, wire->size },
+    };
+    struct iovec* first = wire->stamped ? iov : iov + 1;
+    int count = wire->stamped ? 2 : 1;
+    if (wire->stamped) {
+        stamp.usec = wire_usec();
+    }
+    if (wire->datagram) {
+        // a lost datagram is not retried
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = first;
+        msg.msg_iovlen = (size_t)count;
+        sendmsg(wire->fd, &msg, MSG_NOSIGNAL);
+        wire->running = 0;
+    } else {
+        while (count) {
+            const ssize_t written = writev(wire->fd, first, count);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                // the receiver went away (EPIPE), drop the output
+                wire->broken = true;
+                break;
+            }
+            // step over what was written, which may end mid buffer
+            size_t done = (size_t)written;
+            for (; count && done >= first->iov_len; ++first, --count) {
+                done -= first->iov_len;
+            }
+            if (count) {
+                first->iov_base = (uint8_t*)first->iov_base + done;
+                first->iov_len -= done;
+            }
+        }
+    }
+    wire->size = 0;
+}
+
+static void device_wire_send(struct device_t* device, const struct midi_event_t* event)
+{
+    struct wire_t* wire = (struct wire_t*)device->user;
+    uint32_t type = event->type;
+    if (type == e_midi_event_channel_mode) {
+        type = e_midi_event_ctrl_change;
+    }
+    if (type >= e_midi_event_sysex) {
+        return;
+    }
+    if (wire->size + 3 > WIRE_BUFFER_SIZE) {
+        device_wire_flush(device);
+    }
+    const uint8_t status = (uint8_t)((type & 0xf0) | (event->channel & 0x0f));
+    if (status != wire->running) {
+        wire->buffer[wire->size++] = status;
+        wire->running = status;
+    }
+    wire->buffer[wire->size++] = event->data[0] & 0x7f;
+    if (type != e_midi_event_prog_change && type != e_midi_event_chan_aftertouch) {
+        wire->buffer[wire->size++] = event->data[1] & 0x7f;
+    }
+}
+
+static void device_wire_close(struct device_t* device)
+{
+    struct wire_t* wire = (struct wire_t*)device->user;
+    if (!wire) {
+        return;
+    }
+    if (wire->fd >= 0) {
+        device_wire_flush(device);
+        close(wire->fd);
+    }
+    free(wire);
+    device->user = NULL;
+}
+
+void device_wire_select(struct device_t* device, const char* target)
+{
+    struct wire_t* wire = (struct wire_t*)calloc(1, sizeof(struct wire_t));
+    if (wire) {
+        wire->target = target;
+        wire->fd = -1;
+    }
+    device->open  = device_wire_open;
+    device->send  = device_wire_send;
+    device->flush = device_wire_flush;
+    device->close = device_wire_close;
+    device->user  = wire;
+}
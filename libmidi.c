@@ -29,6 +29,87 @@
 #define strict(EXPR) (void)(EXPR)
 #endif
 
+// ----------------------------------------------------------------------------
+// Instrumentation
+// ----------------------------------------------------------------------------
+
+#if defined(MIDI_STATS)
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <Windows.h>
+#define THREAD_LOCAL __declspec(thread)
+#else
+#include <time.h>
+#define THREAD_LOCAL __thread
+#endif
+
+// each thread counts into its own block, linked into a global list the first
+// time it is used so that midi_stats_get() can find it
+struct stats_block_t {
+    struct midi_stats_t stats;
+    struct stats_block_t* next;
+};
+
+static struct stats_block_t* volatile stats_list;
+static THREAD_LOCAL struct stats_block_t* stats_local;
+
+static struct midi_stats_t* stats_block(void)
+{
+    if (stats_local) {
+        return &stats_local->stats;
+    }
+    // note: blocks outlive their threads and are never released
+    struct stats_block_t* block = calloc(1, sizeof(struct stats_block_t));
+    assert(block);
+#if defined(_MSC_VER)
+    do {
+        block->next = stats_list;
+    } while (InterlockedCompareExchangePointer(
+        (PVOID volatile*)&stats_list, block, block->next) != block->next);
+#else
+    do {
+        block->next = stats_list;
+    } while (!__atomic_compare_exchange_n(&stats_list, &block->next, block,
+        false, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+#endif
+    stats_local = block;
+    return &block->stats;
+}
+
+#define STAT_ADD(FIELD, N) (stats_block()->FIELD += (N))
+
+#else
+#define STAT_ADD(FIELD, N) (void)0
+#endif
+
+#if defined(MIDI_STATS) && defined(MIDI_STATS_TIMING)
+static uint64_t stats_clock(void)
+{
+#if defined(_MSC_VER)
+    return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+#define STAT_TIMER_BEGIN(NAME) \
+    const uint64_t NAME##_start = stats_clock()
+#define STAT_TIMER_END(NAME)                                   \
+    {                                                          \
+        struct midi_stats_t* st_ = stats_block();              \
+        st_->NAME##_time += stats_clock() - NAME##_start;      \
+        ++st_->NAME##_calls;                                   \
+    }
+#else
+#define STAT_TIMER_BEGIN(NAME) (void)0
+#define STAT_TIMER_END(NAME) (void)0
+#endif
+
 #define FOURCC(a, b, c, d) ( \
      ((a) <<  0) |           \
      ((b) <<  8) |           \
@@ -53,6 +134,20 @@ struct midi_stream_t {
     uint8_t prevEvent;
     const uint8_t* ptr;
     const uint8_t* end;
+
+    // decoded lookahead, the next event and the stream state after it
+    // note: filled by peek and delta so that next does not decode again
+    bool ahead;
+    bool ahead_ok;
+    uint8_t ahead_prev;
+    const uint8_t* ahead_ptr;
+    struct midi_event_t ahead_event;
+};
+
+struct midi_mux_t {
+    struct midi_stream_t** streams;
+    uint64_t* times;
+    size_t count;
 };
 
 static void swap(uint8_t* x, uint8_t* y)
@@ -109,6 +204,7 @@ static size_t vlq_read(const uint8_t* restrict in, uint64_t* restrict out)
         }
     }
     out ? (*out = accum) : (void)0;
+    STAT_ADD(vlq_bytes, read);
     return read;
 }
 
@@ -142,7 +238,7 @@ static bool skip_riff_header(const uint8_t **ptr, size_t size)
     return true;
 }
 
-struct midi_t* midi_load(const void* data, size_t size)
+static struct midi_t* load(const void* data, size_t size)
 {
 #define TRY(EXPR)       \
     {                   \
@@ -159,6 +255,7 @@ struct midi_t* midi_load(const void* data, size_t size)
     // allocate header
     struct midi_t* hdr = malloc(sizeof(struct midi_t));
     assert(hdr);
+    STAT_ADD(allocations, 1);
     memset(hdr, 0, sizeof(struct midi_t));
     // extract headers
     MEMCPY(hdr, ptr, 14);
@@ -174,6 +271,7 @@ struct midi_t* midi_load(const void* data, size_t size)
     // collect tracks
     hdr->tracks = malloc(sizeof(struct midi_track_t) * hdr->num_tracks);
     assert(hdr->tracks);
+    STAT_ADD(allocations, 1);
     for (uint32_t i = 0; i < hdr->num_tracks; ++i) {
         struct midi_track_t* trk = hdr->tracks + i;
         MEMCPY(trk, ptr, 8);
@@ -196,6 +294,14 @@ error:
 #undef TRY
 }
 
+struct midi_t* midi_load(const void* data, size_t size)
+{
+    STAT_TIMER_BEGIN(load);
+    struct midi_t* midi = load(data, size);
+    STAT_TIMER_END(load);
+    return midi;
+}
+
 void midi_free(struct midi_t* midi)
 {
     assert(midi);
@@ -211,11 +317,13 @@ struct midi_stream_t* midi_stream(struct midi_t* midi, uint32_t track)
     }
     struct midi_stream_t* stream = malloc(sizeof(struct midi_stream_t));
     assert(stream);
+    STAT_ADD(allocations, 1);
     const struct midi_track_t* trk = midi->tracks + track;
     assert(trk->data);
     stream->ptr = trk->data;
     stream->end = trk->data + trk->length;
     stream->prevEvent = 0xff;
+    stream->ahead = false;
     return stream;
 }
 
@@ -299,12 +407,9 @@ static bool on_midi_sysex(struct midi_stream_t* stream, struct midi_event_t* eve
     assert(stream && event);
     uint64_t vlq_value = 0, vlq_size = 0;
     switch (event->channel) {
-    case 0x0: /* single complete SysEx message  */
-        vlq_size = vlq_read(stream->ptr, &vlq_value);
-        event->length = (vlq_size + vlq_value);
-        stream->ptr += event->length;
-        return !stream_overflow(stream);
-    case 0x07: /* escape sequence */
+    case 0x0:  /* SysEx message, or the start of a split one */
+    case 0x07: /* continuation of a split SysEx message, or an escape */
+        // the two only differ in context, see midi_sysex_push()
         vlq_size = vlq_read(stream->ptr, &vlq_value);
         event->length = (vlq_size + vlq_value);
         stream->ptr += event->length;
@@ -337,26 +442,7 @@ static bool on_midi_cc(struct midi_stream_t* stream, struct midi_event_t* event)
     return !stream_overflow(stream);
 }
 
-bool midi_event_peek(struct midi_stream_t* stream, struct midi_event_t* event)
-{
-    assert(stream && event);
-    struct midi_stream_t temp = *stream;
-    return midi_event_next(&temp, event);
-}
-
-bool midi_event_delta(struct midi_stream_t* stream, uint64_t* delta)
-{
-    assert(stream && delta);
-    if (stream->ptr >= stream->end) {
-        // stream has ended
-        return false;
-    }
-    // parse delta time
-    vlq_read(stream->ptr, delta);
-    return !stream_overflow(stream);
-}
-
-bool midi_event_next(struct midi_stream_t* stream, struct midi_event_t* event)
+static bool event_next(struct midi_stream_t* stream, struct midi_event_t* event)
 {
     assert(stream && event);
     if (stream->ptr >= stream->end) {
@@ -374,6 +460,7 @@ bool midi_event_next(struct midi_stream_t* stream, struct midi_event_t* event)
     } else {
         // continuation of previous event
         cmd = stream->prevEvent;
+        STAT_ADD(running_status, 1);
     }
     // output known event data
     event->type    = cmd & 0xf0;
@@ -403,13 +490,88 @@ bool midi_event_next(struct midi_stream_t* stream, struct midi_event_t* event)
     return !stream_overflow(stream);
 }
 
+// decode the next event into the lookahead slot without advancing
+static void stream_ahead(struct midi_stream_t* stream)
+{
+    struct midi_stream_t temp;
+    temp.prevEvent = stream->prevEvent;
+    temp.ptr = stream->ptr;
+    temp.end = stream->end;
+    stream->ahead_ok = event_next(&temp, &stream->ahead_event);
+    stream->ahead_prev = temp.prevEvent;
+    stream->ahead_ptr = temp.ptr;
+    stream->ahead = true;
+}
+
+bool midi_event_peek(struct midi_stream_t* stream, struct midi_event_t* event)
+{
+    assert(stream && event);
+    if (!stream->ahead) {
+        STAT_ADD(peeks, 1);
+        stream_ahead(stream);
+    }
+    *event = stream->ahead_event;
+    return stream->ahead_ok;
+}
+
+bool midi_event_delta(struct midi_stream_t* stream, uint64_t* delta)
+{
+    assert(stream && delta);
+    if (stream->ptr >= stream->end) {
+        // stream has ended
+        return false;
+    }
+    if (!stream->ahead) {
+        stream_ahead(stream);
+    }
+    // the delta is valid even if the event itself failed to parse
+    *delta = stream->ahead_event.delta;
+    return true;
+}
+
+static bool stream_next(struct midi_stream_t* stream, struct midi_event_t* event)
+{
+    if (!stream->ahead) {
+        return event_next(stream, event);
+    }
+    // commit the lookahead
+    *event = stream->ahead_event;
+    stream->ptr = stream->ahead_ptr;
+    stream->prevEvent = stream->ahead_prev;
+    stream->ahead = false;
+    return stream->ahead_ok;
+}
+
+bool midi_event_next(struct midi_stream_t* stream, struct midi_event_t* event)
+{
+    assert(stream && event);
+    STAT_TIMER_BEGIN(next);
+#if defined(MIDI_STATS)
+    const uint8_t* start = stream->ptr;
+#endif
+    const bool ok = stream_next(stream, event);
+#if defined(MIDI_STATS)
+    struct midi_stats_t* stats = stats_block();
+    stats->bytes += stream->ptr - start;
+    if (ok) {
+        switch (event->type) {
+        case e_midi_event_meta:         ++stats->events[8]; break;
+        case e_midi_event_channel_mode: ++stats->events[9]; break;
+        default:                        ++stats->events[(event->type >> 4) & 7];
+        }
+    }
+#endif
+    STAT_TIMER_END(next);
+    return ok;
+}
+
 bool midi_stream_end(struct midi_stream_t* stream)
 {
     assert(stream);
     return stream->ptr == stream->end;
 }
 
-bool midi_stream_mux(
+static bool stream_mux(
     struct midi_stream_t **stream,
     uint64_t              *delta,
     const size_t           count,
@@ -424,6 +586,7 @@ bool midi_stream_mux(
     uint64_t  min_delta = invalid;
     // select track with nearest pending event
     for (size_t i = 0; i < count; ++i) {
+        STAT_ADD(mux_compares, 1);
 
         uint64_t cur_delta;
         if (!midi_event_delta(stream[i], &cur_delta)) {
@@ -458,3 +621,89 @@ bool midi_stream_mux(
     *delta_out  = min_delta;
     return true;
 }
+
+bool midi_stream_mux(
+    struct midi_stream_t **stream,
+    uint64_t              *delta,
+    const size_t           count,
+    struct midi_event_t   *event,
+    uint64_t              *delta_out,
+    size_t                *index)
+{
+    STAT_TIMER_BEGIN(mux);
+    const bool ok = stream_mux(stream, delta, count, event, delta_out, index);
+    STAT_TIMER_END(mux);
+    return ok;
+}
+
+struct midi_mux_t* midi_mux(struct midi_t* midi)
+{
+    assert(midi);
+    struct midi_mux_t* mux = malloc(sizeof(struct midi_mux_t));
+    assert(mux);
+    mux->count = midi->num_tracks;
+    mux->streams = calloc(mux->count, sizeof(struct midi_stream_t*));
+    mux->times = calloc(mux->count, sizeof(uint64_t));
+    assert(mux->streams && mux->times);
+    STAT_ADD(allocations, 3);
+    for (size_t i = 0; i < mux->count; ++i) {
+        mux->streams[i] = midi_stream(midi, (uint32_t)i);
+        if (mux->streams[i] == NULL) {
+            midi_mux_free(mux);
+            return NULL;
+        }
+    }
+    return mux;
+}
+
+void midi_mux_free(struct midi_mux_t* mux)
+{
+    assert(mux);
+    for (size_t i = 0; i < mux->count; ++i) {
+        if (mux->streams[i]) {
+            midi_stream_free(mux->streams[i]);
+        }
+    }
+    free(mux->streams);
+    free(mux->times);
+    free(mux);
+}
+
+bool midi_mux_next(
+    struct midi_mux_t   *mux,
+    struct midi_event_t *event,
+    uint64_t            *time,
+    size_t              *track)
+{
+    assert(mux && event && time && track);
+    return midi_stream_mux(mux->streams, mux->times, mux->count, event, time, track);
+}
+
+bool midi_stats_get(struct midi_stats_t* stats)
+{
+    assert(stats);
+    memset(stats, 0, sizeof(struct midi_stats_t));
+#if defined(MIDI_STATS)
+    // every field is a uint64_t counter so blocks can be summed as arrays
+    const size_t fields = sizeof(struct midi_stats_t) / sizeof(uint64_t);
+    uint64_t* out = (uint64_t*)stats;
+    for (struct stats_block_t* b = stats_list; b; b = b->next) {
+        const uint64_t* in = (const uint64_t*)&b->stats;
+        for (size_t i = 0; i < fields; ++i) {
+            out[i] += in[i];
+        }
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+void midi_stats_reset(void)
+{
+#if defined(MIDI_STATS)
+    for (struct stats_block_t* b = stats_list; b; b = b->next) {
+        memset(&b->stats, 0, sizeof(struct midi_stats_t));
+    }
+#endif
+}
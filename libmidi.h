@@ -7,8 +7,12 @@
 
 #pragma once
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#if defined(__cplusplus)
+extern "C" {
+#endif
 
 enum midi_format_t {
 
@@ -146,6 +150,7 @@ struct midi_event_t {
 };
 
 struct midi_stream_t;
+struct midi_mux_t;
 
 // load a midi file from memory
 struct midi_t* midi_load(
@@ -192,3 +197,60 @@ bool midi_event_next(
 bool midi_event_delta(
     struct midi_stream_t* stream,
     uint64_t* delta);
+
+// create a merged event stream over all tracks of a midi file
+struct midi_mux_t* midi_mux(
+    struct midi_t* midi);
+
+// release a merged event stream
+void midi_mux_free(
+    struct midi_mux_t* mux);
+
+// return the next event in time order across all tracks
+// note: time receives the absolute event time in ticks
+bool midi_mux_next(
+    struct midi_mux_t* mux,
+    struct midi_event_t* event,
+    uint64_t* time,
+    size_t* track);
+
+// instrumentation counters
+// note: only collected when libmidi is built with MIDI_STATS defined, timing
+//       additionally requires MIDI_STATS_TIMING. timings are in processor
+//       cycles where available, otherwise nanoseconds, and nest, so time in
+//       midi_stream_mux() includes its calls to midi_event_next().
+enum {
+    // events[] is indexed as midi_type_mask() bits, (type >> 4) & 7 for
+    // channel and sysex events, then meta and channel mode
+    MIDI_STATS_EVENT_TYPES = 10,
+};
+
+struct midi_stats_t {
+    uint64_t bytes;           // track bytes consumed by midi_event_next()
+    uint64_t events[MIDI_STATS_EVENT_TYPES];
+    uint64_t vlq_bytes;       // bytes read while decoding VLQs
+    uint64_t running_status;  // events using running status
+    uint64_t peeks;           // events decoded by midi_event_peek()
+    uint64_t mux_compares;    // tracks examined by midi_stream_mux()
+    uint64_t allocations;     // allocations made by libmidi.c
+
+    uint64_t load_calls;
+    uint64_t load_time;
+    uint64_t next_calls;
+    uint64_t next_time;
+    uint64_t mux_calls;
+    uint64_t mux_time;
+};
+
+// sum the counters of all threads that have used libmidi
+// note: returns false, with all counters zero, when stats are not compiled
+//       in. counters of threads still running may be slightly behind.
+bool midi_stats_get(
+    struct midi_stats_t* stats);
+
+// zero the counters of all threads
+void midi_stats_reset(void);
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
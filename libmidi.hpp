@@ -0,0 +1,285 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#pragma once
+#include <cstdio>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "libmidi.h"
+
+// thin header only C++ layer over libmidi
+//
+//   midi::file song = midi::file::load("song.mid");
+//   for (const midi::event& ev : midi::merged(song)) {
+//       midi::dispatch(ev, handler);
+//   }
+//
+// note: the iterators are input iterators, not the forward iterators first
+//       asked for. each range walks one libmidi stream or mux, which is
+//       opaque and cannot be copied, and the event an iterator yields lives
+//       inside it, so two copies of an iterator cannot hold independent
+//       positions. iterate a range again, or make a new one, to take
+//       another pass.
+
+namespace midi {
+
+// an event along with its absolute time and source track
+struct event : midi_event_t {
+    uint64_t time;
+    size_t track;
+};
+
+// ----------------------------------------------------------------------------
+// Owners
+// ----------------------------------------------------------------------------
+
+namespace detail {
+    struct midi_deleter {
+        void operator()(midi_t* m) const { midi_free(m); }
+    };
+    struct stream_deleter {
+        void operator()(midi_stream_t* s) const { midi_stream_free(s); }
+    };
+    struct mux_deleter {
+        void operator()(midi_mux_t* m) const { midi_mux_free(m); }
+    };
+} // namespace detail
+
+// owns a parsed midi file and, when loaded from disk, its bytes
+class file {
+public:
+    file() = default;
+
+    // parse a midi file from memory
+    // note: the data is borrowed and must outlive this object
+    file(const void* data, size_t size)
+        : midi_(midi_load(data, size))
+    {
+    }
+
+    // read and parse a midi file
+    static file load(const std::string& path)
+    {
+        file out;
+        FILE* fd = std::fopen(path.c_str(), "rb");
+        if (!fd) {
+            return out;
+        }
+        std::vector<uint8_t> bytes;
+        uint8_t block[4096];
+        size_t read;
+        while ((read = std::fread(block, 1, sizeof(block), fd)) > 0) {
+            bytes.insert(bytes.end(), block, block + read);
+        }
+        std::fclose(fd);
+        out.data_ = std::move(bytes);
+        out.midi_.reset(midi_load(out.data_.data(), out.data_.size()));
+        return out;
+    }
+
+    explicit operator bool() const { return midi_ != nullptr; }
+
+    midi_t* get() const { return midi_.get(); }
+    uint16_t format() const { return midi_->format; }
+    uint16_t num_tracks() const { return midi_->num_tracks; }
+    uint16_t divisions() const { return midi_->divisions; }
+
+private:
+    // note: moving a vector keeps its buffer, so midi_ stays valid
+    std::vector<uint8_t> data_;
+    std::unique_ptr<midi_t, detail::midi_deleter> midi_;
+};
+
+// ----------------------------------------------------------------------------
+// Ranges
+// ----------------------------------------------------------------------------
+
+// events of a single track
+class track_range {
+public:
+    class iterator {
+    public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef midi::event value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const midi::event* pointer;
+        typedef const midi::event& reference;
+
+        iterator() = default;
+        iterator(midi_stream_t* stream, size_t track)
+            : stream_(stream)
+        {
+            event_.time = 0;
+            event_.track = track;
+            advance();
+        }
+
+        reference operator*() const { return event_; }
+        pointer operator->() const { return &event_; }
+
+        iterator& operator++()
+        {
+            advance();
+            return *this;
+        }
+
+        bool operator==(const iterator& o) const { return stream_ == o.stream_; }
+        bool operator!=(const iterator& o) const { return stream_ != o.stream_; }
+
+    private:
+        void advance()
+        {
+            if (midi_stream_end(stream_) || !midi_event_next(stream_, &event_)) {
+                stream_ = nullptr;
+                return;
+            }
+            event_.time += event_.delta;
+        }
+
+        midi_stream_t* stream_ = nullptr;
+        midi::event event_;
+    };
+
+    track_range(midi_t* m, size_t track)
+        : stream_(midi_stream(m, static_cast<uint32_t>(track)))
+        , track_(track)
+    {
+    }
+
+    iterator begin() { return stream_ ? iterator(stream_.get(), track_) : iterator(); }
+    iterator end() { return iterator(); }
+
+private:
+    std::unique_ptr<midi_stream_t, detail::stream_deleter> stream_;
+    size_t track_;
+};
+
+// events of all tracks in time order
+class merged_range {
+public:
+    class iterator {
+    public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef midi::event value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const midi::event* pointer;
+        typedef const midi::event& reference;
+
+        iterator() = default;
+        explicit iterator(midi_mux_t* mux)
+            : mux_(mux)
+        {
+            advance();
+        }
+
+        reference operator*() const { return event_; }
+        pointer operator->() const { return &event_; }
+
+        iterator& operator++()
+        {
+            advance();
+            return *this;
+        }
+
+        bool operator==(const iterator& o) const { return mux_ == o.mux_; }
+        bool operator!=(const iterator& o) const { return mux_ != o.mux_; }
+
+    private:
+        void advance()
+        {
+            if (!midi_mux_next(mux_, &event_, &event_.time, &event_.track)) {
+                mux_ = nullptr;
+            }
+        }
+
+        midi_mux_t* mux_ = nullptr;
+        midi::event event_;
+    };
+
+    explicit merged_range(midi_t* m)
+        : mux_(midi_mux(m))
+    {
+    }
+
+    iterator begin() { return mux_ ? iterator(mux_.get()) : iterator(); }
+    iterator end() { return iterator(); }
+
+private:
+    std::unique_ptr<midi_mux_t, detail::mux_deleter> mux_;
+};
+
+inline track_range track(midi_t* m, size_t index)
+{
+    return track_range(m, index);
+}
+
+inline track_range track(const file& f, size_t index)
+{
+    return track_range(f.get(), index);
+}
+
+inline merged_range merged(midi_t* m)
+{
+    return merged_range(m);
+}
+
+inline merged_range merged(const file& f)
+{
+    return merged_range(f.get());
+}
+
+// ----------------------------------------------------------------------------
+// Dispatch
+// ----------------------------------------------------------------------------
+
+// default handlers, all of which do nothing
+// note: derive from this and hide the handlers of interest, dispatch() calls
+//       them directly so the empty ones inline away
+struct handler {
+    void note_off(const event&) {}
+    void note_on(const event&) {}
+    void poly_aftertouch(const event&) {}
+    void ctrl_change(const event&) {}
+    void prog_change(const event&) {}
+    void chan_aftertouch(const event&) {}
+    void pitch_wheel(const event&) {}
+    void sysex(const event&) {}
+    void meta(const event&) {}
+    void channel_mode(const event&) {}
+};
+
+// call the handler member matching the event type
+template <typename HANDLER>
+inline void dispatch(const event& ev, HANDLER& h)
+{
+    switch (ev.type) {
+    case e_midi_event_note_off:        h.note_off(ev);        break;
+    case e_midi_event_note_on:         h.note_on(ev);         break;
+    case e_midi_event_poly_aftertouch: h.poly_aftertouch(ev); break;
+    case e_midi_event_ctrl_change:     h.ctrl_change(ev);     break;
+    case e_midi_event_prog_change:     h.prog_change(ev);     break;
+    case e_midi_event_chan_aftertouch: h.chan_aftertouch(ev); break;
+    case e_midi_event_pitch_wheel:     h.pitch_wheel(ev);     break;
+    case e_midi_event_sysex:           h.sysex(ev);           break;
+    case e_midi_event_meta:            h.meta(ev);            break;
+    case e_midi_event_channel_mode:    h.channel_mode(ev);    break;
+    }
+}
+
+// dispatch every event of a range
+template <typename RANGE, typename HANDLER>
+inline void visit(RANGE&& range, HANDLER& h)
+{
+    for (const event& ev : range) {
+        dispatch(ev, h);
+    }
+}
+
+} // namespace midi
@@ -0,0 +1,332 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "midi_automation.h"
+
+
+enum {
+    NUM_CHANNELS = 16,
+    NUM_CURVES   = NUM_CHANNELS * MIDI_CURVE_CONTROLLERS,
+
+    // forward steps a cursor takes before falling back to a binary search
+    CURSOR_STEPS = 8,
+};
+
+// one controller event, in merged stream order
+struct point_t {
+    uint64_t tick;
+    uint16_t curve; // channel * MIDI_CURVE_CONTROLLERS + controller
+    uint16_t value;
+};
+
+struct points_t {
+    struct point_t* point;
+    size_t count;
+    size_t capacity;
+    bool used[NUM_CURVES]; // curves with points, which a reset applies to
+};
+
+static bool points_push(struct points_t* points, uint64_t tick, uint32_t curve, uint16_t value)
+{
+    if (points->count == points->capacity) {
+        const size_t capacity = points->capacity ? points->capacity * 2 : 256;
+        struct point_t* point = realloc(points->point, capacity * sizeof(struct point_t));
+        if (!point) {
+            return false;
+        }
+        points->point = point;
+        points->capacity = capacity;
+    }
+    struct point_t* p = &points->point[points->count++];
+    p->tick = tick;
+    p->curve = (uint16_t)curve;
+    p->value = value;
+    points->used[curve] = true;
+    return true;
+}
+
+// what reset all controllers (cc121) sets, per the recommended practice
+// note: volume, pan, bank select and effect depths are left alone
+static const struct {
+    uint8_t controller;
+    uint16_t value;
+} reset_value[] = {
+    {   1,   0 }, // modulation
+    {  11, 127 }, // expression
+    {  64,   0 }, // sustain
+    {  65,   0 }, // portamento
+    {  66,   0 }, // sostenuto
+    {  67,   0 }, // soft pedal
+    {  98, 127 }, // nrpn lsb, null
+    {  99, 127 }, // nrpn msb, null
+    { 100, 127 }, // rpn lsb, null
+    { 101, 127 }, // rpn msb, null
+    { MIDI_CURVE_PITCH_WHEEL, 0x2000 },
+    { MIDI_CURVE_AFTERTOUCH,  0 },
+};
+
+// push the reset value of every curve this channel has already set
+static bool points_reset(struct points_t* points, uint64_t tick, uint32_t base)
+{
+    for (size_t i = 0; i < sizeof(reset_value) / sizeof(reset_value[0]); ++i) {
+        const uint32_t curve = base + reset_value[i].controller;
+        if (points->used[curve] && !points_push(points, tick, curve, reset_value[i].value)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool points_collect(struct midi_t* midi, struct points_t* points)
+{
+    struct midi_mux_t* mux = midi_mux(midi);
+    if (!mux) {
+        return false;
+    }
+    bool ok = true;
+    struct midi_event_t event;
+    uint64_t time = 0;
+    size_t track = 0;
+    while (ok && midi_mux_next(mux, &event, &time, &track)) {
+        const uint32_t base = (event.channel & 0xf) * MIDI_CURVE_CONTROLLERS;
+        switch (event.type) {
+        case e_midi_event_ctrl_change:
+            ok = points_push(points, time, base + (event.data[0] & 0x7f), event.data[1] & 0x7f);
+            break;
+        case e_midi_event_pitch_wheel:
+            ok = points_push(points, time, base + MIDI_CURVE_PITCH_WHEEL,
+                (uint16_t)(((event.data[1] & 0x7f) << 7) | (event.data[0] & 0x7f)));
+            break;
+        case e_midi_event_chan_aftertouch:
+            ok = points_push(points, time, base + MIDI_CURVE_AFTERTOUCH, event.data[0] & 0x7f);
+            break;
+        case e_midi_event_channel_mode:
+            if (event.data[0] == e_midi_cmode_reset_all_controllers) {
+                ok = points_reset(points, time, base);
+            }
+            break;
+        }
+    }
+    midi_mux_free(mux);
+    return ok;
+}
+
+bool midi_automation_build(struct midi_t* midi, struct midi_automation_t* automation)
+{
+    assert(midi && automation);
+    memset(automation, 0, sizeof(struct midi_automation_t));
+
+    struct points_t points;
+    memset(&points, 0, sizeof(points));
+    if (!points_collect(midi, &points)) {
+        free(points.point);
+        return false;
+    }
+
+    // counting sort by curve, which keeps each curve in time order
+    size_t* offset = calloc(NUM_CURVES + 1, sizeof(size_t));
+    if (!offset) {
+        free(points.point);
+        return false;
+    }
+    size_t curves = 0;
+    for (size_t i = 0; i < points.count; ++i) {
+        if (offset[points.point[i].curve + 1]++ == 0) {
+            ++curves;
+        }
+    }
+    for (size_t i = 0; i < NUM_CURVES; ++i) {
+        offset[i + 1] += offset[i];
+    }
+    automation->tick = malloc((points.count ? points.count : 1) * sizeof(uint64_t));
+    automation->value = malloc((points.count ? points.count : 1) * sizeof(uint16_t));
+    automation->curve = malloc((curves ? curves : 1) * sizeof(struct midi_curve_t));
+    if (!automation->tick || !automation->value || !automation->curve) {
+        free(offset);
+        free(points.point);
+        midi_automation_free(automation);
+        return false;
+    }
+    for (size_t i = 0; i < points.count; ++i) {
+        const struct point_t* p = &points.point[i];
+        const size_t slot = offset[p->curve]++;
+        automation->tick[slot] = p->tick;
+        automation->value[slot] = p->value;
+    }
+    free(points.point);
+
+    // compact each curve down to the points where its value changes
+    size_t out = 0, begin = 0;
+    for (size_t c = 0; c < NUM_CURVES; ++c) {
+        const size_t end = offset[c];
+        if (begin == end) {
+            continue;
+        }
+        const size_t first = out;
+        for (size_t i = begin; i < end; ++i) {
+            const uint64_t tick = automation->tick[i];
+            const uint16_t value = automation->value[i];
+            if (out > first && automation->tick[out - 1] == tick) {
+                // the last value set on a tick wins
+                --out;
+            }
+            if (out > first && automation->value[out - 1] == value) {
+                continue;
+            }
+            automation->tick[out] = tick;
+            automation->value[out] = value;
+            ++out;
+        }
+        struct midi_curve_t* curve = &automation->curve[automation->count++];
+        curve->tick = automation->tick + first;
+        curve->value = automation->value + first;
+        curve->count = out - first;
+        curve->channel = (uint8_t)(c / MIDI_CURVE_CONTROLLERS);
+        curve->controller = (uint8_t)(c % MIDI_CURVE_CONTROLLERS);
+        begin = end;
+    }
+    automation->points = out;
+    free(offset);
+    return true;
+}
+
+void midi_automation_free(struct midi_automation_t* automation)
+{
+    assert(automation);
+    free(automation->curve);
+    free(automation->tick);
+    free(automation->value);
+    memset(automation, 0, sizeof(struct midi_automation_t));
+}
+
+const struct midi_curve_t* midi_automation_curve(
+    const struct midi_automation_t* automation,
+    uint8_t channel,
+    uint8_t controller)
+{
+    assert(automation);
+    const uint32_t key = channel * MIDI_CURVE_CONTROLLERS + controller;
+    size_t lo = 0, hi = automation->count;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        const struct midi_curve_t* curve = &automation->curve[mid];
+        const uint32_t k = curve->channel * MIDI_CURVE_CONTROLLERS + curve->controller;
+        if (k == key) {
+            return curve;
+        }
+        if (k < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+// first point in [lo, hi) with a tick at or after 'tick', or past it when
+// 'after' is set
+static size_t bound(const uint64_t* ticks, size_t lo, size_t hi, uint64_t tick, bool after)
+{
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (ticks[mid] < tick || (after && ticks[mid] == tick)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+uint16_t midi_curve_value(const struct midi_curve_t* curve, uint64_t tick, uint16_t initial)
+{
+    if (!curve) {
+        return initial;
+    }
+    const size_t index = bound(curve->tick, 0, curve->count, tick, true);
+    return index ? curve->value[index - 1] : initial;
+}
+
+size_t midi_curve_range(const struct midi_curve_t* curve, uint64_t t0, uint64_t t1, size_t* first)
+{
+    assert(first);
+    *first = 0;
+    if (!curve || t1 <= t0) {
+        return 0;
+    }
+    const size_t begin = bound(curve->tick, 0, curve->count, t0, false);
+    const size_t end = bound(curve->tick, begin, curve->count, t1, false);
+    *first = begin;
+    return end - begin;
+}
+
+void midi_curve_cursor_init(struct midi_curve_cursor_t* cursor, const struct midi_curve_t* curve)
+{
+    assert(cursor);
+    cursor->curve = curve;
+    cursor->index = 0;
+}
+
+// move the cursor to the first point at or after 'tick', or past it when
+// 'after' is set
+static void cursor_seek(struct midi_curve_cursor_t* cursor, uint64_t tick, bool after)
+{
+    const struct midi_curve_t* curve = cursor->curve;
+    size_t index = cursor->index;
+    if (index && (curve->tick[index - 1] > tick || (!after && curve->tick[index - 1] == tick))) {
+        // moving backwards
+        cursor->index = bound(curve->tick, 0, index, tick, after);
+        return;
+    }
+    for (uint32_t step = 0; index < curve->count; ++step, ++index) {
+        const uint64_t t = curve->tick[index];
+        if (t > tick || (!after && t == tick)) {
+            break;
+        }
+        if (step == CURSOR_STEPS) {
+            index = bound(curve->tick, index, curve->count, tick, after);
+            break;
+        }
+    }
+    cursor->index = index;
+}
+
+uint16_t midi_curve_cursor_value(struct midi_curve_cursor_t* cursor, uint64_t tick, uint16_t initial)
+{
+    assert(cursor);
+    const struct midi_curve_t* curve = cursor->curve;
+    if (!curve) {
+        return initial;
+    }
+    cursor_seek(cursor, tick, true);
+    return cursor->index ? curve->value[cursor->index - 1] : initial;
+}
+
+size_t midi_curve_cursor_block(
+    struct midi_curve_cursor_t* cursor,
+    uint64_t t1,
+    const uint64_t** tick,
+    const uint16_t** value)
+{
+    assert(cursor && tick && value);
+    const struct midi_curve_t* curve = cursor->curve;
+    *tick = NULL;
+    *value = NULL;
+    const size_t begin = cursor->index;
+    if (!curve || (begin && curve->tick[begin - 1] >= t1)) {
+        // nothing, or t1 lies behind the cursor
+        return 0;
+    }
+    cursor_seek(cursor, t1, false);
+    *tick = curve->tick + begin;
+    *value = curve->value + begin;
+    return cursor->index - begin;
+}
@@ -0,0 +1,106 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#pragma once
+#include "libmidi.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+enum {
+    // controller numbers 0-119 are control change events, these follow them
+    MIDI_CURVE_PITCH_WHEEL = 128, // 14 bit value, 8192 is centre
+    MIDI_CURVE_AFTERTOUCH  = 129, // channel aftertouch
+
+    MIDI_CURVE_CONTROLLERS = 130,
+};
+
+// the values one controller of one channel takes over time
+// note: points are sorted by tick, hold the last value set on a tick and
+//       only appear where the value changes
+struct midi_curve_t {
+    const uint64_t* tick;  // absolute time in ticks
+    const uint16_t* value;
+    size_t count;
+    uint8_t channel;
+    uint8_t controller;
+};
+
+// every curve of a midi file, sorted by channel and then controller
+struct midi_automation_t {
+    struct midi_curve_t* curve;
+    size_t count;
+
+    // storage for all points
+    uint64_t* tick;
+    uint16_t* value;
+    size_t points;
+};
+
+// walks a curve, cheap when queries move forward in time
+struct midi_curve_cursor_t {
+    const struct midi_curve_t* curve;
+    size_t index; // points at or before the last query
+};
+
+// collect controller, pitch wheel and channel aftertouch curves
+// note: reset all controllers returns the curves of its channel that have
+//       been set to their defaults, volume and pan keep their values
+bool midi_automation_build(
+    struct midi_t* midi,
+    struct midi_automation_t* automation);
+
+// release all curves
+void midi_automation_free(
+    struct midi_automation_t* automation);
+
+// find the curve of a controller on a channel
+// note: returns NULL if that controller is never set
+const struct midi_curve_t* midi_automation_curve(
+    const struct midi_automation_t* automation,
+    uint8_t channel,
+    uint8_t controller);
+
+// return the value of a curve at a tick
+// note: 'initial' is returned before the first point, or for a NULL curve
+uint16_t midi_curve_value(
+    const struct midi_curve_t* curve,
+    uint64_t tick,
+    uint16_t initial);
+
+// return the points in [t0, t1) as a range starting at *first
+size_t midi_curve_range(
+    const struct midi_curve_t* curve,
+    uint64_t t0,
+    uint64_t t1,
+    size_t* first);
+
+// start a cursor at the beginning of a curve
+void midi_curve_cursor_init(
+    struct midi_curve_cursor_t* cursor,
+    const struct midi_curve_t* curve);
+
+// return the value at a tick, moving the cursor there
+uint16_t midi_curve_cursor_value(
+    struct midi_curve_cursor_t* cursor,
+    uint64_t tick,
+    uint16_t initial);
+
+// return the points in [cursor position, t1) and move the cursor to t1
+// note: meant for rendering consecutive blocks, take the value at the start
+//       of the first block with midi_curve_cursor_value() then apply the
+//       points of each block in turn
+size_t midi_curve_cursor_block(
+    struct midi_curve_cursor_t* cursor,
+    uint64_t t1,
+    const uint64_t** tick,
+    const uint16_t** value);
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
@@ -0,0 +1,493 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define _CRT_SECURE_NO_WARNINGS
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "midi_compiled.h"
+#include "midi_thread.h"
+
+
+#define ALIGN8(X) (((X) + 7) & ~(uint64_t)7)
+
+static bool source_stat(const char* path, uint64_t* size, int64_t* mtime)
+{
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return false;
+    }
+    *size = (uint64_t)st.st_size;
+    *mtime = (int64_t)st.st_mtime;
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Compiling
+// ----------------------------------------------------------------------------
+
+static void find_title(struct midi_t* midi, char* title, size_t size)
+{
+    struct midi_stream_t* stream = midi_stream(midi, 0);
+    if (!stream) {
+        return;
+    }
+    struct midi_event_t event;
+    while (!midi_stream_end(stream) && midi_event_next(stream, &event)) {
+        if (event.delta != 0) {
+            break;
+        }
+        if (event.type == e_midi_event_meta && event.meta == e_midi_meta_track_name) {
+            const size_t n = (event.length < size - 1) ? (size_t)event.length : size - 1;
+            memcpy(title, event.data, n);
+            title[n] = '\0';
+            break;
+        }
+    }
+    midi_stream_free(stream);
+}
+
+// walk the packed stream collecting checkpoints and the song length
+static size_t build_checkpoints(
+    const struct midi_packed_stream_t *packed,
+    const struct midi_tempo_map_t     *tempo,
+    struct midi_checkpoint_t         **out,
+    uint64_t                          *events,
+    uint64_t                          *duration)
+{
+    // there are never more events than slots
+    const size_t capacity = packed->count / MIDI_CHECKPOINT_EVENTS + 1;
+    struct midi_checkpoint_t* cp = malloc(capacity * sizeof(struct midi_checkpoint_t));
+    assert(cp);
+    const struct midi_packed_t* slot = packed->slot;
+    size_t count = 0, i = 0;
+    uint64_t tick = 0, n = 0;
+    while (i < packed->count) {
+        // 'i' is the first slot of an event and 'tick' its delta base
+        if (n % MIDI_CHECKPOINT_EVENTS == 0) {
+            cp[count].slot = i;
+            cp[count].tick = tick;
+            cp[count].usec = midi_tempo_usec(tempo, tick);
+            ++count;
+        }
+        for (; i < packed->count && slot[i].status == 0; ++i) {
+            // delta only, belongs to the following event
+            tick += slot[i].delta;
+        }
+        if (i == packed->count) {
+            break;
+        }
+        tick += slot[i].delta;
+        // escapes are followed by a payload slot
+        i += (slot[i].status >= e_midi_event_sysex) ? 2 : 1;
+        ++n;
+    }
+    *out = cp;
+    *events = n;
+    *duration = tick;
+    return count;
+}
+
+static bool write_section(FILE* fd, uint64_t* pos, const void* data, uint64_t size)
+{
+    static const uint8_t zero[8] = { 0 };
+    if (size && fwrite(data, 1, (size_t)size, fd) != size) {
+        return false;
+    }
+    const uint64_t pad = ALIGN8(size) - size;
+    if (pad && fwrite(zero, 1, (size_t)pad, fd) != pad) {
+        return false;
+    }
+    *pos += size + pad;
+    return true;
+}
+
+// create a new temporary file next to 'path', returning its name in 'temp'
+static FILE* temp_open(const char* path, char* temp, size_t size)
+{
+#if defined(_WIN32)
+    // the process id and a counter keep names unique across processes and
+    // threads, and "x" refuses to reuse one that somehow exists
+    static volatile size_t counter;
+    const size_t n = midi_atomic_add(&counter, 1);
+    snprintf(temp, size, "%s.%lu.%zu.tmp", path, (unsigned long)GetCurrentProcessId(), n);
+    return fopen(temp, "wbx");
+#else
+    const int length = snprintf(temp, size, "%s.XXXXXX", path);
+    if (length < 0 || (size_t)length >= size) {
+        return NULL;
+    }
+    const int fd = mkstemp(temp);
+    if (fd < 0) {
+        return NULL;
+    }
+    // mkstemp creates the file private to its owner, caches are shared
+    fchmod(fd, 0644);
+    FILE* file = fdopen(fd, "wb");
+    if (!file) {
+        close(fd);
+        remove(temp);
+    }
+    return file;
+#endif
+}
+
+bool midi_compile_to_file(
+    struct midi_t *midi,
+    const char    *path,
+    uint64_t       source_size,
+    int64_t        source_mtime)
+{
+    assert(midi && path);
+    struct midi_packed_stream_t packed;
+    memset(&packed, 0, sizeof(packed));
+    struct midi_tempo_map_t tempo;
+    if (!midi_pack(midi, &packed)) {
+        midi_packed_free(&packed);
+        return false;
+    }
+    if (!midi_tempo_map_build(midi, &tempo)) {
+        midi_packed_free(&packed);
+        return false;
+    }
+    struct midi_checkpoint_t* cp = NULL;
+    struct midi_compiled_header_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    const size_t cp_count =
+        build_checkpoints(&packed, &tempo, &cp, &hdr.events, &hdr.duration_ticks);
+
+    hdr.magic           = MIDI_COMPILED_MAGIC;
+    hdr.version         = MIDI_COMPILED_VERSION;
+    hdr.source_size     = source_size;
+    hdr.source_mtime    = source_mtime;
+    hdr.format          = midi->format;
+    hdr.num_tracks      = midi->num_tracks;
+    hdr.divisions       = midi->divisions;
+    hdr.smpte           = tempo.smpte ? 1 : 0;
+    hdr.tempo_divisions = tempo.divisions;
+    hdr.duration_usec   = midi_tempo_usec(&tempo, hdr.duration_ticks);
+    find_title(midi, hdr.title, sizeof(hdr.title));
+
+    // lay out the sections after the header
+    uint64_t pos = ALIGN8(sizeof(hdr));
+    hdr.slot.offset = pos;
+    hdr.slot.count = packed.count;
+    pos += ALIGN8(packed.count * sizeof(struct midi_packed_t));
+    hdr.payload.offset = pos;
+    hdr.payload.count = packed.payload_size;
+    pos += ALIGN8(packed.payload_size);
+    hdr.tempo.offset = pos;
+    hdr.tempo.count = tempo.count;
+    pos += ALIGN8(tempo.count * sizeof(struct midi_tempo_t));
+    hdr.checkpoint.offset = pos;
+    hdr.checkpoint.count = cp_count;
+    pos += ALIGN8(cp_count * sizeof(struct midi_checkpoint_t));
+    hdr.file_size = pos;
+
+    // write to a temporary file and rename it into place, so that readers
+    // never see a partial cache. the name is unique so that processes
+    // rebuilding the same cache at once never share a temporary file.
+    char temp[1024];
+    FILE* fd = temp_open(path, temp, sizeof(temp));
+    bool ok = (fd != NULL);
+    pos = 0;
+    ok = ok && write_section(fd, &pos, &hdr, sizeof(hdr));
+    ok = ok && write_section(fd, &pos, packed.slot, packed.count * sizeof(struct midi_packed_t));
+    ok = ok && write_section(fd, &pos, packed.payload, packed.payload_size);
+    ok = ok && write_section(fd, &pos, tempo.entry, tempo.count * sizeof(struct midi_tempo_t));
+    ok = ok && write_section(fd, &pos, cp, cp_count * sizeof(struct midi_checkpoint_t));
+    ok = ok && (pos == hdr.file_size);
+    if (fd) {
+        ok = (fclose(fd) == 0) && ok;
+    }
+#if defined(_WIN32)
+    // rename does not replace existing files on windows
+    if (ok) {
+        remove(path);
+    }
+#endif
+    ok = ok && rename(temp, path) == 0;
+    if (!ok && fd) {
+        remove(temp);
+    }
+    free(cp);
+    midi_tempo_map_free(&tempo);
+    midi_packed_free(&packed);
+    return ok;
+}
+
+// ----------------------------------------------------------------------------
+// Mapping
+// ----------------------------------------------------------------------------
+
+// map a whole file read only
+// note: 'handle' receives the mapping object where the platform has one
+static bool map_file(const char* path, void** out, size_t* out_size, void** handle)
+{
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL) {
+        return false;
+    }
+    void* base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (base == NULL) {
+        CloseHandle(mapping);
+        return false;
+    }
+    *out = base;
+    *out_size = (size_t)size.QuadPart;
+    *handle = mapping;
+#else
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    void* base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+    *out = base;
+    *out_size = (size_t)st.st_size;
+    *handle = NULL;
+#endif
+    return true;
+}
+
+static void unmap_file(void* base, size_t size, void* handle)
+{
+#if defined(_WIN32)
+    (void)size;
+    UnmapViewOfFile(base);
+    CloseHandle(handle);
+#else
+    (void)handle;
+    munmap(base, size);
+#endif
+}
+
+static bool section_valid(const struct midi_section_t* s, size_t elem, uint64_t size)
+{
+    if ((s->offset & 7) || s->offset > size) {
+        return false;
+    }
+    return s->count <= (size - s->offset) / elem;
+}
+
+// walk the slots checking that every payload lies inside the payload section
+// and that checkpoints start events, so unpacking never leaves the mapping
+static bool events_valid(
+    const struct midi_packed_t      *slot,
+    size_t                           count,
+    size_t                           payload_size,
+    const struct midi_checkpoint_t  *cp,
+    size_t                           cp_count)
+{
+    size_t i = 0, k = 0;
+    while (i < count) {
+        for (; k < cp_count && cp[k].slot == i; ++k) {
+        }
+        if (k < cp_count && cp[k].slot < i) {
+            // out of order, or pointing into a payload slot
+            return false;
+        }
+        if (slot[i].status < e_midi_event_sysex) {
+            ++i;
+            continue;
+        }
+        if (i + 1 == count) {
+            return false;
+        }
+        struct midi_packed_payload_t payload;
+        memcpy(&payload, slot + i + 1, sizeof(payload));
+        if (payload.offset > payload_size || payload.length > payload_size - payload.offset) {
+            return false;
+        }
+        i += 2;
+    }
+    // nothing may be left beyond the last event
+    return k == cp_count;
+}
+
+// check the header and resolve section offsets to pointers
+static bool fixup(struct midi_compiled_t* c)
+{
+    const struct midi_compiled_header_t* hdr = c->base;
+    if (c->size < sizeof(*hdr) ||
+        hdr->magic != MIDI_COMPILED_MAGIC ||
+        hdr->version != MIDI_COMPILED_VERSION ||
+        hdr->file_size != c->size) {
+        return false;
+    }
+    if (!section_valid(&hdr->slot, sizeof(struct midi_packed_t), c->size) ||
+        !section_valid(&hdr->payload, 1, c->size) ||
+        !section_valid(&hdr->tempo, sizeof(struct midi_tempo_t), c->size) ||
+        !section_valid(&hdr->checkpoint, sizeof(struct midi_checkpoint_t), c->size) ||
+        hdr->tempo.count == 0 || hdr->tempo_divisions == 0) {
+        return false;
+    }
+    if (!memchr(hdr->title, '\0', sizeof(hdr->title))) {
+        return false;
+    }
+    const uint8_t* base = c->base;
+    if (!events_valid(
+            (const struct midi_packed_t*)(base + hdr->slot.offset), (size_t)hdr->slot.count,
+            (size_t)hdr->payload.count,
+            (const struct midi_checkpoint_t*)(base + hdr->checkpoint.offset),
+            (size_t)hdr->checkpoint.count)) {
+        return false;
+    }
+    c->header     = hdr;
+    c->slot       = (const struct midi_packed_t*)(base + hdr->slot.offset);
+    c->payload    = base + hdr->payload.offset;
+    c->tempo      = (const struct midi_tempo_t*)(base + hdr->tempo.offset);
+    c->checkpoint = (const struct midi_checkpoint_t*)(base + hdr->checkpoint.offset);
+    return true;
+}
+
+static struct midi_compiled_t* open_cache(const char* path)
+{
+    struct midi_compiled_t* c = malloc(sizeof(struct midi_compiled_t));
+    assert(c);
+    memset(c, 0, sizeof(struct midi_compiled_t));
+    if (!map_file(path, &c->base, &c->size, &c->handle)) {
+        free(c);
+        return NULL;
+    }
+    if (!fixup(c)) {
+        midi_close_compiled(c);
+        return NULL;
+    }
+    return c;
+}
+
+static bool rebuild(const char* path, const char* source_path,
+    uint64_t source_size, int64_t source_mtime)
+{
+    // the source is mapped the same way as the cache, libmidi does not
+    // link the tools' file helpers
+    void* data = NULL;
+    void* handle = NULL;
+    size_t size = 0;
+    if (!map_file(source_path, &data, &size, &handle)) {
+        return false;
+    }
+    struct midi_t* midi = midi_load(data, size);
+    bool ok = (midi != NULL);
+    ok = ok && midi_compile_to_file(midi, path, source_size, source_mtime);
+    if (midi) {
+        midi_free(midi);
+    }
+    unmap_file(data, size, handle);
+    return ok;
+}
+
+struct midi_compiled_t* midi_open_compiled(const char* path, const char* source_path)
+{
+    assert(path);
+    struct midi_compiled_t* c = open_cache(path);
+    if (!source_path) {
+        return c;
+    }
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    if (!source_stat(source_path, &size, &mtime)) {
+        // source is gone, any valid cache is better than nothing
+        return c;
+    }
+    if (c && c->header->source_size == size && c->header->source_mtime == mtime) {
+        return c;
+    }
+    if (c) {
+        midi_close_compiled(c);
+    }
+    if (!rebuild(path, source_path, size, mtime)) {
+        return NULL;
+    }
+    return open_cache(path);
+}
+
+void midi_close_compiled(struct midi_compiled_t* compiled)
+{
+    assert(compiled);
+    unmap_file(compiled->base, compiled->size, compiled->handle);
+    free(compiled);
+}
+
+void midi_compiled_stream(
+    const struct midi_compiled_t *c,
+    struct midi_packed_stream_t  *view)
+{
+    assert(c && view);
+    memset(view, 0, sizeof(struct midi_packed_stream_t));
+    view->slot = (struct midi_packed_t*)c->slot;
+    view->count = (size_t)c->header->slot.count;
+    view->payload = (uint8_t*)c->payload;
+    view->payload_size = (size_t)c->header->payload.count;
+}
+
+void midi_compiled_tempo_map(
+    const struct midi_compiled_t *c,
+    struct midi_tempo_map_t      *view)
+{
+    assert(c && view);
+    view->entry = (struct midi_tempo_t*)c->tempo;
+    view->count = (size_t)c->header->tempo.count;
+    view->divisions = c->header->tempo_divisions;
+    view->smpte = c->header->smpte != 0;
+}
+
+const struct midi_checkpoint_t* midi_compiled_seek(
+    const struct midi_compiled_t *c,
+    uint64_t                      tick)
+{
+    assert(c);
+    const size_t count = (size_t)c->header->checkpoint.count;
+    if (count == 0) {
+        return NULL;
+    }
+    size_t lo = 0, hi = count;
+    while (hi - lo > 1) {
+        const size_t mid = (lo + hi) / 2;
+        if (c->checkpoint[mid].tick <= tick) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return c->checkpoint + lo;
+}
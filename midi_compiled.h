@@ -0,0 +1,126 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#pragma once
+#include "libmidi.h"
+#include "midi_packed.h"
+#include "midi_tempo.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// compiled midi cache (.midc)
+//
+// a pre-merged, packed event timeline together with its tempo map and seek
+// checkpoints, laid out so that it can be memory mapped and used in place.
+// all sections are 8 byte aligned and referenced by offset from the start
+// of the file. the file is written in native byte order, which the magic
+// value also guards against.
+
+enum {
+    MIDI_COMPILED_MAGIC    = 0x4344494d, // 'MIDC'
+    MIDI_COMPILED_VERSION  = 1,
+
+    // events between seek checkpoints
+    MIDI_CHECKPOINT_EVENTS = 1024,
+};
+
+struct midi_section_t {
+    uint64_t offset;
+    uint64_t count;
+};
+
+struct midi_compiled_header_t {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t file_size;
+
+    // the source file this cache was built from
+    uint64_t source_size;
+    int64_t  source_mtime;
+
+    uint16_t format;
+    uint16_t num_tracks;
+    uint16_t divisions;
+    uint16_t smpte;
+    uint32_t tempo_divisions;
+    uint32_t reserved;
+
+    uint64_t events;
+    uint64_t duration_ticks;
+    uint64_t duration_usec;
+
+    struct midi_section_t slot;       // midi_packed_t
+    struct midi_section_t payload;    // uint8_t
+    struct midi_section_t tempo;      // midi_tempo_t
+    struct midi_section_t checkpoint; // midi_checkpoint_t
+
+    // first track name, zero terminated
+    char title[64];
+};
+
+// a point to resume playback from
+// note: unpacking from 'slot' gives deltas relative to 'tick', the time of
+//       the event before the checkpoint
+struct midi_checkpoint_t {
+    uint64_t slot;
+    uint64_t tick;
+    uint64_t usec;
+};
+
+struct midi_compiled_t {
+    const struct midi_compiled_header_t* header;
+    const struct midi_packed_t* slot;
+    const uint8_t* payload;
+    const struct midi_tempo_t* tempo;
+    const struct midi_checkpoint_t* checkpoint;
+
+    // mapping, private
+    void* base;
+    size_t size;
+    void* handle;
+};
+
+// compile a midi file into a cache file
+// note: source_size and source_mtime identify the source file so that stale
+//       caches can be detected, the file is replaced atomically
+bool midi_compile_to_file(
+    struct midi_t* midi,
+    const char* path,
+    uint64_t source_size,
+    int64_t source_mtime);
+
+// open a compiled cache file
+// note: if source_path is not NULL the cache is (re)built from it when it is
+//       missing, invalid or older than the source
+struct midi_compiled_t* midi_open_compiled(
+    const char* path,
+    const char* source_path);
+
+// close a compiled cache file
+void midi_close_compiled(
+    struct midi_compiled_t* compiled);
+
+// return a read only packed stream view of the compiled events
+void midi_compiled_stream(
+    const struct midi_compiled_t* compiled,
+    struct midi_packed_stream_t* view);
+
+// return a read only tempo map view of the compiled tempo changes
+void midi_compiled_tempo_map(
+    const struct midi_compiled_t* compiled,
+    struct midi_tempo_map_t* view);
+
+// find the last checkpoint at or before an absolute tick
+const struct midi_checkpoint_t* midi_compiled_seek(
+    const struct midi_compiled_t* compiled,
+    uint64_t tick);
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
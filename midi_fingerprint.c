@@ -0,0 +1,130 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "midi_fingerprint.h"
+#include "midi_tempo.h"
+
+
+// normalised notes are packed into one word so sorting them orders by time
+// first and hashing them is a single mix
+//
+//   63         18 17   14 13    7 6     0
+//   [ time      ][ chan ][ key  ][ vel  ]
+
+enum {
+    // initial notes buffered for one run, chords rarely exceed this
+    RUN_NOTES = 64,
+};
+
+static uint64_t note_pack(uint64_t time, uint32_t channel, uint32_t key, uint32_t velocity)
+{
+    return (time << 18) | ((uint64_t)(channel & 0xf) << 14) |
+           ((uint64_t)(key & 0x7f) << 7) | (velocity & 0x7f);
+}
+
+static int note_compare(const void* a, const void* b)
+{
+    const uint64_t x = *(const uint64_t*)a;
+    const uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// murmur3 finaliser
+static uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+static uint64_t hash_step(uint64_t hash, uint64_t word)
+{
+    return (hash ^ mix64(word)) * 0x9e3779b97f4a7c15ull;
+}
+
+// sort one run of notes sharing a time and fold it into the hash
+static uint64_t run_hash(uint64_t hash, uint64_t* note, size_t count)
+{
+    if (count > 1) {
+        qsort(note, count, sizeof(uint64_t), note_compare);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        hash = hash_step(hash, note[i]);
+    }
+    return hash;
+}
+
+bool midi_fingerprint(struct midi_t* midi, struct midi_fingerprint_t* fingerprint)
+{
+    assert(midi && fingerprint);
+    memset(fingerprint, 0, sizeof(struct midi_fingerprint_t));
+
+    struct midi_tempo_map_t map;
+    if (!midi_tempo_map_build(midi, &map)) {
+        return false;
+    }
+    struct midi_mux_t* mux = midi_mux(midi);
+    if (!mux) {
+        midi_tempo_map_free(&map);
+        return false;
+    }
+
+    // notes arrive in time order, so each run sharing a time is sorted and
+    // hashed when the next time starts. only the open run is buffered.
+    uint64_t* note = NULL;
+    size_t count = 0, capacity = 0, total = 0;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    bool ok = true;
+    struct midi_event_t event;
+    uint64_t time = 0;
+    size_t track = 0;
+    while (midi_mux_next(mux, &event, &time, &track)) {
+        if (event.type != e_midi_event_note_on || (event.data[1] & 0x7f) == 0) {
+            continue;
+        }
+        const uint64_t usec = midi_tempo_usec(&map, time);
+        const uint64_t slot = (usec + MIDI_FINGERPRINT_USEC / 2) / MIDI_FINGERPRINT_USEC;
+        const uint64_t packed = note_pack(slot, event.channel, event.data[0], event.data[1]);
+        if (count && (note[0] >> 18) != slot) {
+            hash = run_hash(hash, note, count);
+            total += count;
+            count = 0;
+        }
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : RUN_NOTES;
+            uint64_t* grown = realloc(note, capacity * sizeof(uint64_t));
+            if (!grown) {
+                ok = false;
+                break;
+            }
+            note = grown;
+        }
+        note[count++] = packed;
+        fingerprint->usec = usec;
+    }
+    midi_mux_free(mux);
+    midi_tempo_map_free(&map);
+    if (ok) {
+        hash = run_hash(hash, note, count);
+        total += count;
+    }
+    free(note);
+    if (!ok) {
+        return false;
+    }
+
+    fingerprint->hash = mix64(hash ^ total);
+    fingerprint->notes = total;
+    return true;
+}
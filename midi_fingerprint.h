@@ -0,0 +1,38 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#pragma once
+#include "libmidi.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+enum {
+    // note times are rounded to this many microseconds before hashing
+    MIDI_FINGERPRINT_USEC = 1000,
+};
+
+// identifies the music of a file rather than its bytes
+// note: files that play the same notes at the same times hash the same even
+//       if their track layout, division, tempo encoding or use of running
+//       status differ
+struct midi_fingerprint_t {
+    uint64_t hash;
+    uint64_t notes; // number of notes hashed
+    uint64_t usec;  // time of the last note
+};
+
+// hash the note ons of a midi file as (time, channel, key, velocity)
+// note: notes starting together are hashed in a canonical order
+bool midi_fingerprint(
+    struct midi_t* midi,
+    struct midi_fingerprint_t* fingerprint);
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
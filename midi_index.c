@@ -0,0 +1,163 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "midi_index.h"
+
+
+enum {
+    // subtrees at or below this level are scanned linearly
+    LEAF_LEVEL = 3,
+};
+
+static uint64_t note_end(const struct midi_note_t* note)
+{
+    return note->start + (note->duration ? note->duration : 1);
+}
+
+bool midi_index_build(struct midi_index_t* index, const struct midi_notes_t* notes)
+{
+    assert(index && notes);
+    memset(index, 0, sizeof(struct midi_index_t));
+    const size_t n = notes->count;
+    index->note = notes->note;
+    index->count = n;
+    index->levels = -1;
+    if (n == 0) {
+        return true;
+    }
+    for (size_t i = 1; i < n; ++i) {
+        if (notes->note[i].start < notes->note[i - 1].start) {
+            // spans must be sorted by start time
+            return false;
+        }
+    }
+    uint64_t* max_end = malloc(n * sizeof(uint64_t));
+    assert(max_end);
+
+    // level 0, the leaves at even indices
+    size_t last_i = 0;
+    uint64_t last = 0;
+    for (size_t i = 0; i < n; i += 2) {
+        last_i = i;
+        last = max_end[i] = note_end(index->note + i);
+    }
+    // each following level from its two children
+    // note: 'last' tracks the max end of the rightmost node so that nodes
+    //       whose right child is out of range can still be augmented
+    int32_t k = 1;
+    for (; ((size_t)1 << k) <= n; ++k) {
+        const size_t x = (size_t)1 << (k - 1);
+        const size_t step = x << 2;
+        for (size_t i = (x << 1) - 1; i < n; i += step) {
+            const uint64_t el = max_end[i - x];
+            const uint64_t er = (i + x < n) ? max_end[i + x] : last;
+            uint64_t e = note_end(index->note + i);
+            e = (e > el) ? e : el;
+            e = (e > er) ? e : er;
+            max_end[i] = e;
+        }
+        last_i = ((last_i >> k) & 1) ? last_i - x : last_i + x;
+        if (last_i < n && max_end[last_i] > last) {
+            last = max_end[last_i];
+        }
+    }
+    index->max_end = max_end;
+    index->levels = k - 1;
+    return true;
+}
+
+void midi_index_free(struct midi_index_t* index)
+{
+    assert(index);
+    free(index->max_end);
+    memset(index, 0, sizeof(struct midi_index_t));
+}
+
+size_t midi_index_range(
+    const struct midi_index_t *index,
+    uint64_t                   t0,
+    uint64_t                   t1,
+    uint32_t                  *out,
+    size_t                     max)
+{
+    assert(index);
+    if (index->levels < 0 || t0 >= t1) {
+        return 0;
+    }
+    const struct midi_note_t* note = index->note;
+    const size_t n = index->count;
+    size_t found = 0;
+
+#define EMIT(I)                        \
+    {                                  \
+        if (found < max)               \
+            out[found] = (uint32_t)(I); \
+        ++found;                       \
+    }
+
+    struct {
+        size_t x;
+        int32_t k;
+        bool right;
+    } stack[128];
+    size_t top = 0;
+    stack[top].x = ((size_t)1 << index->levels) - 1;
+    stack[top].k = index->levels;
+    stack[top++].right = false;
+
+    while (top) {
+        const size_t x = stack[--top].x;
+        const int32_t k = stack[top].k;
+        const bool right = stack[top].right;
+
+        if (k <= LEAF_LEVEL) {
+            // small subtree, scan it in order
+            const size_t i0 = (x >> k) << k;
+            size_t i1 = i0 + ((size_t)1 << (k + 1)) - 1;
+            i1 = (i1 > n) ? n : i1;
+            for (size_t i = i0; i < i1 && note[i].start < t1; ++i) {
+                if (t0 < note_end(note + i)) {
+                    EMIT(i);
+                }
+            }
+        } else if (!right) {
+            // revisit this node once its left subtree is done
+            stack[top].x = x;
+            stack[top].k = k;
+            stack[top++].right = true;
+            // left child may be out of range when the tree is not full
+            const size_t y = x - ((size_t)1 << (k - 1));
+            if (y >= n || index->max_end[y] > t0) {
+                stack[top].x = y;
+                stack[top].k = k - 1;
+                stack[top++].right = false;
+            }
+        } else if (x < n && note[x].start < t1) {
+            if (t0 < note_end(note + x)) {
+                EMIT(x);
+            }
+            stack[top].x = x + ((size_t)1 << (k - 1));
+            stack[top].k = k - 1;
+            stack[top++].right = false;
+        }
+    }
+#undef EMIT
+    return found;
+}
+
+size_t midi_index_at(
+    const struct midi_index_t *index,
+    uint64_t                   t,
+    uint32_t                  *out,
+    size_t                     max)
+{
+    return midi_index_range(index, t, t + 1, out, max);
+}
@@ -0,0 +1,61 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#pragma once
+#include "midi_notes.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// implicit augmented interval tree over note spans
+//
+// the sorted span array itself forms the tree: the in-order layout of a
+// perfect binary tree, where index i sits at level k when its lowest k bits
+// are set. each node stores the greatest end time in its subtree.
+//
+// note: a zero duration note is treated as sounding for one tick so that it
+//       is still reported by queries
+struct midi_index_t {
+    const struct midi_note_t* note; // borrowed from midi_notes_t
+    uint64_t* max_end;
+    size_t count;
+    int32_t levels;
+};
+
+// build an index over note spans sorted by start time
+// note: the spans are not copied and must outlive the index. they may come
+//       from midi_notes_build_packed(), to index a compiled cache directly
+bool midi_index_build(
+    struct midi_index_t* index,
+    const struct midi_notes_t* notes);
+
+// release an index
+void midi_index_free(
+    struct midi_index_t* index);
+
+// find all notes sounding in the time range [t0, t1)
+// note: returns the total number of matches, of which at most max indices
+//       into the span array are written to out, in start time order
+size_t midi_index_range(
+    const struct midi_index_t* index,
+    uint64_t t0,
+    uint64_t t1,
+    uint32_t* out,
+    size_t max);
+
+// find all notes sounding at tick t
+// note: use midi_tempo_tick() to query by wall clock time
+size_t midi_index_at(
+    const struct midi_index_t* index,
+    uint64_t t,
+    uint32_t* out,
+    size_t max);
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
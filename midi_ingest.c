@@ -0,0 +1,698 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#if defined(_MSC_VER)
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define INGEST_URING 1
+#endif
+#endif
+#endif
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "midi_ingest.h"
+#include "midi_thread.h"
+
+
+enum {
+    MAX_WORKERS = 64,
+};
+
+// a pooled buffer and the file being read into it
+struct slot_t {
+    uint8_t* data;
+    size_t capacity;
+    size_t size;
+    size_t index;
+    int fd;
+    bool failed;
+};
+
+// slot indices waiting to be handled
+struct queue_t {
+    size_t slot[MIDI_INGEST_BUFFERS];
+    size_t head;
+    size_t count;
+};
+
+struct ingest_t {
+#if defined(_WIN32)
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE ready_cond;
+    CONDITION_VARIABLE empty_cond;
+#else
+    pthread_mutex_t lock;
+    pthread_cond_t ready_cond;
+    pthread_cond_t empty_cond;
+#endif
+    struct slot_t slot[MIDI_INGEST_BUFFERS];
+    struct queue_t ready;       // read, waiting to be parsed
+    struct queue_t empty;       // waiting to be read into
+    bool done;                  // no more slots will become ready
+
+    const char* const* path;
+    size_t count;
+    volatile size_t next;       // next path for the reader threads
+    volatile size_t handed;     // files given to the parse workers
+    volatile size_t submits;
+    midi_ingest_func_t func;
+    void* user;
+    struct midi_ingest_stats_t* stats;
+};
+
+// ----------------------------------------------------------------------------
+// Buffer pool
+// ----------------------------------------------------------------------------
+
+static void ingest_lock(struct ingest_t* in)
+{
+#if defined(_WIN32)
+    EnterCriticalSection(&in->lock);
+#else
+    pthread_mutex_lock(&in->lock);
+#endif
+}
+
+static void ingest_unlock(struct ingest_t* in)
+{
+#if defined(_WIN32)
+    LeaveCriticalSection(&in->lock);
+#else
+    pthread_mutex_unlock(&in->lock);
+#endif
+}
+
+#if defined(_WIN32)
+static void ingest_wait(struct ingest_t* in, CONDITION_VARIABLE* cond)
+{
+    SleepConditionVariableCS(cond, &in->lock, INFINITE);
+}
+
+static void ingest_wake(CONDITION_VARIABLE* cond, bool all)
+{
+    if (all) {
+        WakeAllConditionVariable(cond);
+    } else {
+        WakeConditionVariable(cond);
+    }
+}
+#else
+static void ingest_wait(struct ingest_t* in, pthread_cond_t* cond)
+{
+    pthread_cond_wait(cond, &in->lock);
+}
+
+static void ingest_wake(pthread_cond_t* cond, bool all)
+{
+    if (all) {
+        pthread_cond_broadcast(cond);
+    } else {
+        pthread_cond_signal(cond);
+    }
+}
+#endif
+
+static void queue_push(struct queue_t* q, size_t slot)
+{
+    assert(q->count < MIDI_INGEST_BUFFERS);
+    q->slot[(q->head + q->count++) % MIDI_INGEST_BUFFERS] = slot;
+}
+
+static size_t queue_pop(struct queue_t* q)
+{
+    assert(q->count);
+    const size_t slot = q->slot[q->head];
+    q->head = (q->head + 1) % MIDI_INGEST_BUFFERS;
+    --q->count;
+    return slot;
+}
+
+static bool ingest_init(struct ingest_t* in)
+{
+#if defined(_WIN32)
+    InitializeCriticalSection(&in->lock);
+    InitializeConditionVariable(&in->ready_cond);
+    InitializeConditionVariable(&in->empty_cond);
+#else
+    pthread_mutex_init(&in->lock, NULL);
+    pthread_cond_init(&in->ready_cond, NULL);
+    pthread_cond_init(&in->empty_cond, NULL);
+#endif
+    for (size_t i = 0; i < MIDI_INGEST_BUFFERS; ++i) {
+        struct slot_t* slot = &in->slot[i];
+        slot->data = malloc(MIDI_INGEST_BUFFER_SIZE);
+        if (!slot->data) {
+            return false;
+        }
+        slot->capacity = MIDI_INGEST_BUFFER_SIZE;
+        queue_push(&in->empty, i);
+    }
+    return true;
+}
+
+static void ingest_free(struct ingest_t* in)
+{
+    for (size_t i = 0; i < MIDI_INGEST_BUFFERS; ++i) {
+        free(in->slot[i].data);
+    }
+#if defined(_WIN32)
+    DeleteCriticalSection(&in->lock);
+#else
+    pthread_cond_destroy(&in->empty_cond);
+    pthread_cond_destroy(&in->ready_cond);
+    pthread_mutex_destroy(&in->lock);
+#endif
+}
+
+// buffers keep their size once grown, so later large files fit
+static bool slot_reserve(struct slot_t* slot, size_t size)
+{
+    if (size <= slot->capacity) {
+        return true;
+    }
+    size_t capacity = slot->capacity;
+    while (capacity < size) {
+        if (capacity > SIZE_MAX / 2) {
+            return false;
+        }
+        capacity *= 2;
+    }
+    uint8_t* data = realloc(slot->data, capacity);
+    if (!data) {
+        return false;
+    }
+    slot->data = data;
+    slot->capacity = capacity;
+    return true;
+}
+
+static void put_ready(struct ingest_t* in, size_t slot)
+{
+    midi_atomic_add(&in->handed, 1);
+    ingest_lock(in);
+    queue_push(&in->ready, slot);
+    ingest_wake(&in->ready_cond, false);
+    ingest_unlock(in);
+}
+
+// take an empty slot, waiting for one only if asked to
+static bool take_empty(struct ingest_t* in, bool wait, size_t* slot)
+{
+    ingest_lock(in);
+    while (wait && in->empty.count == 0) {
+        ingest_wait(in, &in->empty_cond);
+    }
+    const bool ok = in->empty.count != 0;
+    if (ok) {
+        *slot = queue_pop(&in->empty);
+    }
+    ingest_unlock(in);
+    return ok;
+}
+
+static void put_empty(struct ingest_t* in, size_t slot)
+{
+    ingest_lock(in);
+    queue_push(&in->empty, slot);
+    ingest_wake(&in->empty_cond, false);
+    ingest_unlock(in);
+}
+
+static void ingest_finish(struct ingest_t* in)
+{
+    ingest_lock(in);
+    in->done = true;
+    ingest_wake(&in->ready_cond, true);
+    ingest_unlock(in);
+}
+
+static void parse_worker(void* arg)
+{
+    struct ingest_t* in = arg;
+    for (;;) {
+        ingest_lock(in);
+        while (in->ready.count == 0 && !in->done) {
+            ingest_wait(in, &in->ready_cond);
+        }
+        if (in->ready.count == 0) {
+            ingest_unlock(in);
+            break;
+        }
+        const size_t index = queue_pop(&in->ready);
+        ingest_unlock(in);
+
+        struct slot_t* slot = &in->slot[index];
+        struct midi_t* midi = slot->failed ? NULL : midi_load(slot->data, slot->size);
+        if (midi) {
+            midi_atomic_add(&in->stats->loaded, 1);
+            midi_atomic_add(&in->stats->bytes, slot->size);
+        } else {
+            midi_atomic_add(&in->stats->failed, 1);
+        }
+        in->func(in->user, slot->index, midi, slot->data, slot->failed ? 0 : slot->size);
+        if (midi) {
+            midi_free(midi);
+        }
+        put_empty(in, index);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Reader threads
+// ----------------------------------------------------------------------------
+
+// return the size of an open file, failing for anything but a regular file
+static bool file_size(FILE* fd, size_t* size)
+{
+#if defined(_WIN32)
+    struct _stat64 st;
+    if (_fstat64(_fileno(fd), &st) != 0 || (st.st_mode & _S_IFMT) != _S_IFREG) {
+        return false;
+    }
+#else
+    struct stat st;
+    if (fstat(fileno(fd), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+#endif
+    *size = (size_t)st.st_size;
+    return true;
+}
+
+static bool read_file(struct slot_t* slot, const char* path)
+{
+    FILE* fd = fopen(path, "rb");
+    if (!fd) {
+        return false;
+    }
+    // a directory opens fine but has no meaningful size
+    size_t size = 0;
+    const bool ok = file_size(fd, &size) && slot_reserve(slot, size) &&
+                    fread(slot->data, 1, size, fd) == size;
+    slot->size = ok ? size : 0;
+    fclose(fd);
+    return ok;
+}
+
+static void read_worker(void* arg)
+{
+    struct ingest_t* in = arg;
+    for (;;) {
+        size_t index = 0;
+        take_empty(in, true, &index);
+        const size_t next = midi_atomic_add(&in->next, 1);
+        if (next >= in->count) {
+            put_empty(in, index);
+            break;
+        }
+        struct slot_t* slot = &in->slot[index];
+        slot->index = next;
+        slot->failed = !read_file(slot, in->path[next]);
+        midi_atomic_add(&in->submits, 1);
+        put_ready(in, index);
+    }
+}
+
+static void ingest_threads(struct ingest_t* in)
+{
+    struct midi_thread_t* thread[MIDI_INGEST_READERS];
+    size_t started = 0;
+    // the calling thread is one of the readers
+    for (size_t i = 1; i < MIDI_INGEST_READERS && i < in->count; ++i) {
+        if ((thread[started] = midi_thread_start(read_worker, in)) != NULL) {
+            ++started;
+        }
+    }
+    read_worker(in);
+    for (size_t i = 0; i < started; ++i) {
+        midi_thread_join(thread[i]);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// io_uring
+// ----------------------------------------------------------------------------
+
+#if defined(INGEST_URING)
+
+enum {
+    // the slot index is the user data of opens and reads
+    CLOSE_TAG = 1ull << 63,
+};
+
+struct uring_t {
+    int fd;
+    uint8_t* sq_ring;
+    size_t sq_ring_size;
+    uint8_t* cq_ring;
+    size_t cq_ring_size;
+    struct io_uring_sqe* sqe;
+    size_t sqe_size;
+
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe* cqe;
+
+    unsigned queued;            // sqes filled in but not yet published
+};
+
+static void uring_free(struct uring_t* r)
+{
+    if (r->sqe) {
+        munmap(r->sqe, r->sqe_size);
+    }
+    if (r->cq_ring && r->cq_ring != r->sq_ring) {
+        munmap(r->cq_ring, r->cq_ring_size);
+    }
+    if (r->sq_ring) {
+        munmap(r->sq_ring, r->sq_ring_size);
+    }
+    close(r->fd);
+}
+
+static bool uring_init(struct uring_t* r, unsigned entries)
+{
+    memset(r, 0, sizeof(struct uring_t));
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0) {
+        // not built into the kernel, or refused by a sandbox
+        return false;
+    }
+    // opens and closes arrived in 5.6 along with this feature, and nodrop
+    // keeps completions from being lost when closes pile up
+    if (!(p.features & IORING_FEAT_RW_CUR_POS) || !(p.features & IORING_FEAT_NODROP)) {
+        close(r->fd);
+        return false;
+    }
+    r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    const bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+        r->sq_ring_size = (r->cq_ring_size > r->sq_ring_size) ? r->cq_ring_size : r->sq_ring_size;
+        r->cq_ring_size = r->sq_ring_size;
+    }
+    void* sq = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    r->sq_ring = (sq == MAP_FAILED) ? NULL : sq;
+    if (r->sq_ring && single) {
+        r->cq_ring = r->sq_ring;
+    } else if (r->sq_ring) {
+        void* cq = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        r->cq_ring = (cq == MAP_FAILED) ? NULL : cq;
+    }
+    r->sqe_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    if (r->cq_ring) {
+        void* sqe = mmap(NULL, r->sqe_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+        r->sqe = (sqe == MAP_FAILED) ? NULL : sqe;
+    }
+    if (!r->sqe) {
+        uring_free(r);
+        return false;
+    }
+    r->sq_head    = (unsigned*)(r->sq_ring + p.sq_off.head);
+    r->sq_tail    = (unsigned*)(r->sq_ring + p.sq_off.tail);
+    r->sq_array   = (unsigned*)(r->sq_ring + p.sq_off.array);
+    r->sq_mask    = *(unsigned*)(r->sq_ring + p.sq_off.ring_mask);
+    r->sq_entries = p.sq_entries;
+    r->cq_head    = (unsigned*)(r->cq_ring + p.cq_off.head);
+    r->cq_tail    = (unsigned*)(r->cq_ring + p.cq_off.tail);
+    r->cq_mask    = *(unsigned*)(r->cq_ring + p.cq_off.ring_mask);
+    r->cqe        = (struct io_uring_cqe*)(r->cq_ring + p.cq_off.cqes);
+    return true;
+}
+
+// publish queued sqes and submit them, waiting for completions if asked
+static bool uring_submit(struct uring_t* r, unsigned wait)
+{
+    const unsigned tail = *r->sq_tail + r->queued;
+    __atomic_store_n(r->sq_tail, tail, __ATOMIC_RELEASE);
+    r->queued = 0;
+    for (;;) {
+        // anything the kernel has not consumed yet goes again
+        const unsigned pending = tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+        if (pending == 0 && wait == 0) {
+            return true;
+        }
+        const long ret = syscall(__NR_io_uring_enter, r->fd, pending, wait,
+                                 wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (ret >= 0) {
+            return true;
+        }
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            return false;
+        }
+    }
+}
+
+// next free sqe, submitting what is queued when the ring is full
+static struct io_uring_sqe* uring_sqe(struct uring_t* r, size_t* submits)
+{
+    for (;;) {
+        const unsigned tail = *r->sq_tail + r->queued;
+        if (tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) < r->sq_entries) {
+            const unsigned index = tail & r->sq_mask;
+            struct io_uring_sqe* sqe = &r->sqe[index];
+            memset(sqe, 0, sizeof(struct io_uring_sqe));
+            r->sq_array[index] = index;
+            ++r->queued;
+            return sqe;
+        }
+        ++*submits;
+        if (!uring_submit(r, 0)) {
+            return NULL;
+        }
+    }
+}
+
+static bool uring_read(struct uring_t* r, struct slot_t* slot, size_t index, size_t* submits)
+{
+    struct io_uring_sqe* sqe = uring_sqe(r, submits);
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode    = IORING_OP_READ;
+    sqe->fd        = slot->fd;
+    sqe->addr      = (uint64_t)(uintptr_t)(slot->data + slot->size);
+    sqe->len       = (uint32_t)(slot->capacity - slot->size);
+    sqe->off       = slot->size;
+    sqe->user_data = index;
+    return true;
+}
+
+static bool uring_close(struct uring_t* r, struct slot_t* slot, size_t* submits)
+{
+    struct io_uring_sqe* sqe = uring_sqe(r, submits);
+    if (!sqe) {
+        // leave it to a blocking close rather than leak it
+        close(slot->fd);
+        return false;
+    }
+    sqe->opcode    = IORING_OP_CLOSE;
+    sqe->fd        = slot->fd;
+    sqe->user_data = CLOSE_TAG;
+    return true;
+}
+
+// each file is opened, read until a read comes up short, and closed, one
+// step per completion. the buffer is handed on as soon as it is read, the
+// close completing in the background.
+static bool ingest_uring(struct ingest_t* in, struct uring_t* r)
+{
+    size_t next = 0, busy = 0, closing = 0, submits = 0;
+    bool ok = true;
+    while (ok && (next < in->count || busy || closing)) {
+        // start a file for every empty buffer, only waiting for one when
+        // there is nothing else to wait on
+        size_t index = 0;
+        while (ok && next < in->count && take_empty(in, busy == 0 && closing == 0, &index)) {
+            struct slot_t* slot = &in->slot[index];
+            struct io_uring_sqe* sqe = uring_sqe(r, &submits);
+            if (!sqe) {
+                ok = false;
+                put_empty(in, index);
+                break;
+            }
+            slot->index  = next;
+            slot->size   = 0;
+            slot->fd     = -1;
+            slot->failed = false;
+            sqe->opcode     = IORING_OP_OPENAT;
+            sqe->fd         = AT_FDCWD;
+            sqe->addr       = (uint64_t)(uintptr_t)in->path[next];
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+            sqe->user_data  = index;
+            ++next;
+            ++busy;
+        }
+        ++submits;
+        if (!ok || !uring_submit(r, (busy || closing) ? 1 : 0)) {
+            ok = false;
+            break;
+        }
+
+        unsigned head = *r->cq_head;
+        const unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        for (; ok && head != tail; ++head) {
+            const struct io_uring_cqe* cqe = &r->cqe[head & r->cq_mask];
+            const uint64_t user_data = cqe->user_data;
+            const int res = cqe->res;
+            if (user_data & CLOSE_TAG) {
+                --closing;
+                continue;
+            }
+            struct slot_t* slot = &in->slot[user_data];
+            bool finished = false;
+            if (slot->fd < 0) {
+                // the open completed
+                if (res < 0) {
+                    slot->failed = finished = true;
+                } else {
+                    slot->fd = res;
+                    ok = uring_read(r, slot, (size_t)user_data, &submits);
+                }
+            } else if (res < 0) {
+                slot->failed = finished = true;
+            } else {
+                slot->size += (size_t)res;
+                if (slot->size < slot->capacity) {
+                    finished = true;
+                } else if (!slot_reserve(slot, slot->capacity * 2)) {
+                    slot->failed = finished = true;
+                } else {
+                    ok = uring_read(r, slot, (size_t)user_data, &submits);
+                }
+            }
+            if (finished) {
+                if (slot->fd >= 0 && uring_close(r, slot, &submits)) {
+                    ++closing;
+                }
+                --busy;
+                put_ready(in, (size_t)user_data);
+            }
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+    in->submits = submits;
+    return ok;
+}
+
+#endif // INGEST_URING
+
+// ----------------------------------------------------------------------------
+// Ingest
+// ----------------------------------------------------------------------------
+
+bool midi_ingest(
+    const char* const* path,
+    size_t count,
+    size_t threads,
+    uint32_t flags,
+    midi_ingest_func_t func,
+    void* user,
+    struct midi_ingest_stats_t* stats)
+{
+    assert((path || count == 0) && func && stats);
+    memset(stats, 0, sizeof(struct midi_ingest_stats_t));
+    struct ingest_t* in = calloc(1, sizeof(struct ingest_t));
+    if (!in) {
+        return false;
+    }
+    in->path  = path;
+    in->count = count;
+    in->func  = func;
+    in->user  = user;
+    in->stats = stats;
+    if (!ingest_init(in)) {
+        ingest_free(in);
+        free(in);
+        return false;
+    }
+
+#if defined(INGEST_URING)
+    struct uring_t ring;
+    bool uring = !(flags & MIDI_INGEST_NO_URING) &&
+                 uring_init(&ring, 2 * MIDI_INGEST_BUFFERS);
+#else
+    (void)flags;
+    const bool uring = false;
+#endif
+    stats->backend = uring ? e_midi_ingest_uring : e_midi_ingest_threads;
+
+    if (threads == 0) {
+        threads = midi_thread_count();
+    }
+    threads = (threads > MAX_WORKERS) ? MAX_WORKERS : threads;
+    struct midi_thread_t* worker[MAX_WORKERS];
+    size_t started = 0;
+    for (size_t i = 0; i < threads; ++i) {
+        if ((worker[started] = midi_thread_start(parse_worker, in)) != NULL) {
+            ++started;
+        }
+    }
+
+    bool ok = started != 0;
+    if (ok) {
+#if defined(INGEST_URING)
+        if (uring) {
+            ok = ingest_uring(in, &ring);
+        } else
+#endif
+        {
+            ingest_threads(in);
+        }
+    }
+#if defined(INGEST_URING)
+    if (uring) {
+        uring_free(&ring);
+    }
+#endif
+    ingest_finish(in);
+    for (size_t i = 0; i < started; ++i) {
+        midi_thread_join(worker[i]);
+    }
+    // files never handed on after a failure count as failed
+    stats->failed += count - in->handed;
+    stats->submits = in->submits;
+    ingest_free(in);
+    free(in);
+    return ok;
+}
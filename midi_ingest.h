@@ -0,0 +1,73 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#pragma once
+#include "libmidi.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// batched loading of many midi files
+//
+// scanning a library of small files is dominated by opening and reading
+// them rather than by parsing. files are read into a fixed pool of buffers
+// by the calling thread while worker threads parse the buffers that are
+// ready, so reading and parsing overlap and a buffer is reused once its file
+// has been handled.
+//
+// on linux the opens, reads and closes are submitted in batches through
+// io_uring, using the raw system calls. elsewhere, or where io_uring is not
+// available, a few threads do plain blocking reads instead.
+enum {
+    MIDI_INGEST_BUFFERS     = 64,           // files in flight
+    MIDI_INGEST_BUFFER_SIZE = 64 * 1024,    // initial size of each buffer
+    MIDI_INGEST_READERS     = 4,            // threads reading without io_uring
+
+    // flags
+    MIDI_INGEST_NO_URING    = 1 << 0,       // always use reader threads
+};
+
+enum midi_ingest_backend_t {
+    e_midi_ingest_threads = 0,
+    e_midi_ingest_uring,
+};
+
+struct midi_ingest_stats_t {
+    volatile size_t loaded;
+    volatile size_t failed;     // files that could not be read or parsed
+    volatile size_t bytes;
+    size_t submits;             // io_uring_enter calls, or blocking reads
+    uint32_t backend;           // midi_ingest_backend_t
+};
+
+// called on a worker thread for every file, in no particular order
+// note: 'midi' is NULL if the file could not be read or parsed. it and 'data'
+//       are only valid during the call.
+typedef void (*midi_ingest_func_t)(
+    void* user,
+    size_t index,
+    struct midi_t* midi,
+    const void* data,
+    size_t size);
+
+// load and parse every file of a list, handing each to 'func'
+// note: when threads is 0 the hardware thread count is used for parsing.
+//       returns false if the ingest could not be set up, failed files are
+//       only counted.
+bool midi_ingest(
+    const char* const* path,
+    size_t count,
+    size_t threads,
+    uint32_t flags,
+    midi_ingest_func_t func,
+    void* user,
+    struct midi_ingest_stats_t* stats);
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
@@ -0,0 +1,528 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "midi_ngram.h"
+#include "midi_notes.h"
+
+
+enum {
+    NUM_CHANNELS = 16,
+
+    // intervals are clamped to +/- this many semitones
+    MAX_INTERVAL = 31,
+
+    // inter-onset ratios are quantised to half octaves, clamped to +/- this
+    MAX_RATIO    = 7,
+};
+
+// term frequency saturation used when ranking
+#define RANK_K1 1.2f
+
+// gram layout, the kind lives in bits 30-31
+//
+//   interval: [ kind ][ 4 x 6 bit interval ]
+//   rhythm:   [ kind ][ 3 x 4 bit ratio ][ 4 x 2 bit contour ]
+#define GRAM_KIND_SHIFT 30
+
+struct keys_t {
+    uint32_t* key;
+    size_t count;
+    size_t capacity;
+};
+
+static bool keys_push(struct keys_t* keys, uint32_t key)
+{
+    if (keys->count == keys->capacity) {
+        const size_t capacity = keys->capacity ? keys->capacity * 2 : 1024;
+        uint32_t* grown = realloc(keys->key, capacity * sizeof(uint32_t));
+        if (!grown) {
+            return false;
+        }
+        keys->key = grown;
+        keys->capacity = capacity;
+    }
+    keys->key[keys->count++] = key;
+    return true;
+}
+
+static int key_compare(const void* a, const void* b)
+{
+    const uint32_t x = *(const uint32_t*)a;
+    const uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t quantise_ratio(uint64_t a, uint64_t b)
+{
+    long r = lround(2.0 * log2((double)b / (double)a));
+    r = (r < -MAX_RATIO) ? -MAX_RATIO : (r > MAX_RATIO) ? MAX_RATIO : r;
+    return (uint32_t)(r + MAX_RATIO + 1);
+}
+
+// append the grams of every window of a melodic line
+static bool line_grams(const uint8_t* key, const uint64_t* onset, size_t count, struct keys_t* out)
+{
+    for (size_t i = 0; i + MIDI_NGRAM_NOTES <= count; ++i) {
+        uint32_t interval = 0, contour = 0;
+        for (size_t j = 0; j + 1 < MIDI_NGRAM_NOTES; ++j) {
+            int32_t step = (int32_t)key[i + j + 1] - (int32_t)key[i + j];
+            contour = (contour << 2) | ((step > 0) ? 1u : (step < 0) ? 2u : 0u);
+            step = (step < -MAX_INTERVAL) ? -MAX_INTERVAL : (step > MAX_INTERVAL) ? MAX_INTERVAL : step;
+            interval = (interval << 6) | (uint32_t)(step + MAX_INTERVAL + 1);
+        }
+        if (!keys_push(out, ((uint32_t)e_midi_ngram_interval << GRAM_KIND_SHIFT) | interval)) {
+            return false;
+        }
+        if (!onset) {
+            continue;
+        }
+        uint32_t ratio = 0;
+        bool valid = true;
+        for (size_t j = 0; j + 2 < MIDI_NGRAM_NOTES; ++j) {
+            const uint64_t a = onset[i + j + 1] - onset[i + j];
+            const uint64_t b = onset[i + j + 2] - onset[i + j + 1];
+            if (a == 0 || b == 0) {
+                valid = false;
+                break;
+            }
+            ratio = (ratio << 4) | quantise_ratio(a, b);
+        }
+        if (valid && !keys_push(out,
+                ((uint32_t)e_midi_ngram_rhythm << GRAM_KIND_SHIFT) | (ratio << 8) | contour)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// sort raw gram keys and count each distinct one
+static bool grams_count(struct keys_t* keys, struct midi_ngrams_t* grams)
+{
+    qsort(keys->key, keys->count, sizeof(uint32_t), key_compare);
+    grams->count = 0;
+    for (size_t i = 0; i < keys->count;) {
+        size_t j = i + 1;
+        while (j < keys->count && keys->key[j] == keys->key[i]) {
+            ++j;
+        }
+        if (grams->count == grams->capacity) {
+            const size_t capacity = grams->capacity ? grams->capacity * 2 : 256;
+            struct midi_ngram_t* grown = realloc(grams->gram, capacity * sizeof(struct midi_ngram_t));
+            if (!grown) {
+                return false;
+            }
+            grams->gram = grown;
+            grams->capacity = capacity;
+        }
+        struct midi_ngram_t* gram = &grams->gram[grams->count++];
+        gram->key = keys->key[i];
+        gram->count = (uint32_t)(j - i);
+        i = j;
+    }
+    return true;
+}
+
+bool midi_ngrams_build(struct midi_t* midi, struct midi_ngrams_t* grams)
+{
+    assert(midi && grams);
+    struct midi_notes_t notes = { NULL, 0, 0 };
+    if (!midi_notes_build(midi, &notes)) {
+        midi_notes_free(&notes);
+        return false;
+    }
+
+    // group notes by channel keeping start order
+    size_t start[NUM_CHANNELS + 1] = { 0 };
+    for (size_t i = 0; i < notes.count; ++i) {
+        ++start[notes.note[i].channel + 1];
+    }
+    for (size_t c = 0; c < NUM_CHANNELS; ++c) {
+        start[c + 1] += start[c];
+    }
+    const size_t count = notes.count;
+    uint8_t* key = malloc(count ? count : 1);
+    uint64_t* onset = malloc((count ? count : 1) * sizeof(uint64_t));
+    struct keys_t keys = { NULL, 0, 0 };
+    bool ok = key && onset;
+    if (ok) {
+        size_t fill[NUM_CHANNELS];
+        memcpy(fill, start, sizeof(fill));
+        for (size_t i = 0; i < count; ++i) {
+            const struct midi_note_t* note = &notes.note[i];
+            key[fill[note->channel]] = note->key;
+            onset[fill[note->channel]++] = note->start;
+        }
+    }
+    for (size_t c = 0; ok && c < NUM_CHANNELS; ++c) {
+        if (c == MIDI_NGRAM_DRUMS) {
+            continue;
+        }
+        // keep the highest key of each onset
+        size_t line = start[c];
+        for (size_t i = start[c]; i < start[c + 1]; ++i) {
+            if (line > start[c] && onset[line - 1] == onset[i]) {
+                if (key[i] > key[line - 1]) {
+                    key[line - 1] = key[i];
+                }
+                continue;
+            }
+            key[line] = key[i];
+            onset[line++] = onset[i];
+        }
+        ok = line_grams(key + start[c], onset + start[c], line - start[c], &keys);
+    }
+    ok = ok && grams_count(&keys, grams);
+
+    free(keys.key);
+    free(onset);
+    free(key);
+    midi_notes_free(&notes);
+    return ok;
+}
+
+bool midi_ngrams_from_keys(
+    const uint8_t* key,
+    const uint64_t* onset,
+    size_t count,
+    struct midi_ngrams_t* grams)
+{
+    assert(key && grams);
+    struct keys_t keys = { NULL, 0, 0 };
+    const bool ok = line_grams(key, onset, count, &keys) && grams_count(&keys, grams);
+    free(keys.key);
+    return ok;
+}
+
+void midi_ngrams_free(struct midi_ngrams_t* grams)
+{
+    assert(grams);
+    free(grams->gram);
+    memset(grams, 0, sizeof(struct midi_ngrams_t));
+}
+
+// ----------------------------------------------------------------------------
+// Inverted index
+// ----------------------------------------------------------------------------
+
+static uint32_t varint_size(uint32_t value)
+{
+    uint32_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+static uint8_t* varint_write(uint8_t* out, uint32_t value)
+{
+    while (value >= 0x80) {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+// note: returns NULL if the varint runs past 'end'
+static const uint8_t* varint_read(const uint8_t* in, const uint8_t* end, uint32_t* value)
+{
+    uint32_t out = 0;
+    for (uint32_t shift = 0;; shift += 7) {
+        if (in >= end) {
+            return NULL;
+        }
+        const uint8_t byte = *in++;
+        out |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80) || shift >= 28) {
+            break;
+        }
+    }
+    *value = out;
+    return in;
+}
+
+static size_t index_find(const struct midi_ngram_index_t* index, uint32_t key)
+{
+    size_t lo = 0, hi = index->keys;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (index->key[mid] < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return (lo < index->keys && index->key[lo] == key) ? lo : SIZE_MAX;
+}
+
+bool midi_ngram_index_build(
+    struct midi_ngram_index_t* index,
+    const struct midi_ngrams_t* songs,
+    size_t count)
+{
+    assert(index && (songs || !count));
+    memset(index, 0, sizeof(struct midi_ngram_index_t));
+    index->songs = (uint32_t)count;
+
+    // the dictionary of every distinct key
+    struct keys_t keys = { NULL, 0, 0 };
+    for (size_t s = 0; s < count; ++s) {
+        for (size_t g = 0; g < songs[s].count; ++g) {
+            if (!keys_push(&keys, songs[s].gram[g].key)) {
+                free(keys.key);
+                return false;
+            }
+        }
+    }
+    qsort(keys.key, keys.count, sizeof(uint32_t), key_compare);
+    size_t unique = 0;
+    for (size_t i = 0; i < keys.count; ++i) {
+        if (unique == 0 || keys.key[unique - 1] != keys.key[i]) {
+            keys.key[unique++] = keys.key[i];
+        }
+    }
+    index->key = keys.key;
+    index->keys = unique;
+    index->df = calloc(unique + 1, sizeof(uint32_t));
+    index->offset = calloc(unique + 1, sizeof(uint64_t));
+    uint32_t* last = calloc(unique + 1, sizeof(uint32_t));
+    if (!index->df || !index->offset || !last) {
+        free(last);
+        midi_ngram_index_free(index);
+        return false;
+    }
+
+    // size each posting list, songs arrive in increasing order
+    for (size_t s = 0; s < count; ++s) {
+        for (size_t g = 0; g < songs[s].count; ++g) {
+            const struct midi_ngram_t* gram = &songs[s].gram[g];
+            const size_t k = index_find(index, gram->key);
+            const uint32_t delta = (uint32_t)s - (index->df[k] ? last[k] : 0);
+            index->offset[k + 1] += varint_size(delta) + varint_size(gram->count);
+            last[k] = (uint32_t)s;
+            ++index->df[k];
+        }
+    }
+    for (size_t k = 0; k < unique; ++k) {
+        index->offset[k + 1] += index->offset[k];
+    }
+    index->size = index->offset[unique];
+    index->postings = malloc(index->size ? (size_t)index->size : 1);
+    if (!index->postings) {
+        free(last);
+        midi_ngram_index_free(index);
+        return false;
+    }
+
+    // encode (song delta, count) pairs
+    uint64_t* cursor = malloc((unique + 1) * sizeof(uint64_t));
+    if (!cursor) {
+        free(last);
+        midi_ngram_index_free(index);
+        return false;
+    }
+    memcpy(cursor, index->offset, (unique + 1) * sizeof(uint64_t));
+    memset(last, 0, (unique + 1) * sizeof(uint32_t));
+    for (size_t s = 0; s < count; ++s) {
+        for (size_t g = 0; g < songs[s].count; ++g) {
+            const struct midi_ngram_t* gram = &songs[s].gram[g];
+            const size_t k = index_find(index, gram->key);
+            const bool first = cursor[k] == index->offset[k];
+            uint8_t* out = index->postings + cursor[k];
+            out = varint_write(out, (uint32_t)s - (first ? 0 : last[k]));
+            out = varint_write(out, gram->count);
+            cursor[k] = (uint64_t)(out - index->postings);
+            last[k] = (uint32_t)s;
+        }
+    }
+    free(cursor);
+    free(last);
+    return true;
+}
+
+void midi_ngram_index_free(struct midi_ngram_index_t* index)
+{
+    assert(index);
+    free(index->key);
+    free(index->df);
+    free(index->offset);
+    free(index->postings);
+    memset(index, 0, sizeof(struct midi_ngram_index_t));
+}
+
+struct index_header_t {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t songs;
+    uint32_t reserved;
+    uint64_t keys;
+    uint64_t size;
+};
+
+bool midi_ngram_index_save(const struct midi_ngram_index_t* index, FILE* fd)
+{
+    assert(index && fd);
+    const struct index_header_t header = {
+        MIDI_NGRAM_MAGIC, MIDI_NGRAM_VERSION, index->songs, 0, index->keys, index->size
+    };
+    const size_t keys = index->keys;
+    return fwrite(&header, sizeof(header), 1, fd) == 1 &&
+           fwrite(index->key, sizeof(uint32_t), keys, fd) == keys &&
+           fwrite(index->df, sizeof(uint32_t), keys, fd) == keys &&
+           fwrite(index->offset, sizeof(uint64_t), keys + 1, fd) == keys + 1 &&
+           fwrite(index->postings, 1, (size_t)index->size, fd) == index->size;
+}
+
+bool midi_ngram_index_load(struct midi_ngram_index_t* index, FILE* fd)
+{
+    assert(index && fd);
+    memset(index, 0, sizeof(struct midi_ngram_index_t));
+    struct index_header_t header;
+    if (fread(&header, sizeof(header), 1, fd) != 1 ||
+        header.magic != MIDI_NGRAM_MAGIC || header.version != MIDI_NGRAM_VERSION) {
+        return false;
+    }
+    if (header.keys >= SIZE_MAX / sizeof(uint64_t) || header.size > SIZE_MAX) {
+        return false;
+    }
+    const size_t keys = (size_t)header.keys;
+    index->songs = header.songs;
+    index->keys = keys;
+    index->size = header.size;
+    index->key = malloc((keys + 1) * sizeof(uint32_t));
+    index->df = malloc((keys + 1) * sizeof(uint32_t));
+    index->offset = malloc((keys + 1) * sizeof(uint64_t));
+    index->postings = malloc(header.size ? (size_t)header.size : 1);
+    if (!index->key || !index->df || !index->offset || !index->postings ||
+        fread(index->key, sizeof(uint32_t), keys, fd) != keys ||
+        fread(index->df, sizeof(uint32_t), keys, fd) != keys ||
+        fread(index->offset, sizeof(uint64_t), keys + 1, fd) != keys + 1 ||
+        fread(index->postings, 1, (size_t)header.size, fd) != header.size ||
+        index->offset[keys] != header.size) {
+        midi_ngram_index_free(index);
+        return false;
+    }
+    // posting lists must be in order and inside the postings
+    for (size_t i = 0; i < keys; ++i) {
+        if (index->offset[i] > index->offset[i + 1]) {
+            midi_ngram_index_free(index);
+            return false;
+        }
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Ranked queries
+// ----------------------------------------------------------------------------
+
+static void hit_sift_down(struct midi_ngram_hit_t* heap, size_t count, size_t i)
+{
+    for (;;) {
+        const size_t l = i * 2 + 1;
+        const size_t r = l + 1;
+        size_t min = i;
+        if (l < count && heap[l].score < heap[min].score) {
+            min = l;
+        }
+        if (r < count && heap[r].score < heap[min].score) {
+            min = r;
+        }
+        if (min == i) {
+            return;
+        }
+        const struct midi_ngram_hit_t t = heap[i];
+        heap[i] = heap[min];
+        heap[min] = t;
+        i = min;
+    }
+}
+
+static int hit_compare(const void* a, const void* b)
+{
+    const struct midi_ngram_hit_t* x = a;
+    const struct midi_ngram_hit_t* y = b;
+    if (x->score != y->score) {
+        return (x->score < y->score) ? 1 : -1;
+    }
+    return (x->song > y->song) - (x->song < y->song);
+}
+
+size_t midi_ngram_query(
+    const struct midi_ngram_index_t* index,
+    const struct midi_ngrams_t* query,
+    struct midi_ngram_hit_t* hits,
+    size_t k)
+{
+    assert(index && query && (hits || !k));
+    if (k == 0 || index->songs == 0) {
+        return 0;
+    }
+    float* score = calloc(index->songs, sizeof(float));
+    if (!score) {
+        return 0;
+    }
+
+    // bm25 style weighting, rare grams count for more
+    const float songs = (float)index->songs;
+    for (size_t q = 0; q < query->count; ++q) {
+        const struct midi_ngram_t* gram = &query->gram[q];
+        const size_t key = index_find(index, gram->key);
+        if (key == SIZE_MAX) {
+            continue;
+        }
+        const float df = (float)index->df[key];
+        const float idf = logf(1.0f + (songs - df + 0.5f) / (df + 0.5f));
+        const uint8_t* in = index->postings + index->offset[key];
+        const uint8_t* end = index->postings + index->offset[key + 1];
+        uint32_t song = 0;
+        for (bool first = true; in < end; first = false) {
+            uint32_t delta, count;
+            in = varint_read(in, end, &delta);
+            in = in ? varint_read(in, end, &count) : NULL;
+            if (!in) {
+                break;
+            }
+            song = first ? delta : song + delta;
+            if (song >= index->songs) {
+                break;
+            }
+            const float tf = (float)((count < gram->count) ? count : gram->count);
+            score[song] += idf * tf * (RANK_K1 + 1.0f) / (tf + RANK_K1);
+        }
+    }
+
+    // keep the best k in a min heap
+    size_t found = 0;
+    for (uint32_t s = 0; s < index->songs; ++s) {
+        if (score[s] <= 0.0f) {
+            continue;
+        }
+        if (found < k) {
+            hits[found].song = s;
+            hits[found].score = score[s];
+            if (++found == k) {
+                for (size_t i = k / 2; i-- > 0;) {
+                    hit_sift_down(hits, k, i);
+                }
+            }
+        } else if (score[s] > hits[0].score) {
+            hits[0].song = s;
+            hits[0].score = score[s];
+            hit_sift_down(hits, k, 0);
+        }
+    }
+    free(score);
+    qsort(hits, found, sizeof(struct midi_ngram_hit_t), hit_compare);
+    return found;
+}
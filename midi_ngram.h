@@ -0,0 +1,118 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#pragma once
+#include <stdio.h>
+
+#include "libmidi.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// melodic n-gram search
+//
+// every channel but the drums is reduced to a melodic line, keeping the
+// highest key of each onset. windows of MIDI_NGRAM_NOTES consecutive notes
+// then give two kinds of n-gram:
+//  - interval grams, the pitch steps between the notes, transposition free
+//  - rhythm grams, the ratios of the inter-onset times along with the
+//    contour (up, down, same) of each step, tempo free
+//
+// an inverted index maps each gram to the songs containing it, stored as
+// delta and varint coded posting lists.
+
+enum {
+    MIDI_NGRAM_NOTES   = 5,
+    MIDI_NGRAM_DRUMS   = 9,          // channel left out of the melody
+    MIDI_NGRAM_MAGIC   = 0x49474e4d, // 'MNGI'
+    MIDI_NGRAM_VERSION = 1,
+};
+
+enum midi_ngram_kind_t {
+    e_midi_ngram_interval = 0,
+    e_midi_ngram_rhythm   = 1,
+};
+
+struct midi_ngram_t {
+    uint32_t key;   // kind in the top bits
+    uint32_t count; // occurrences
+};
+
+// the distinct grams of one song, sorted by key
+struct midi_ngrams_t {
+    struct midi_ngram_t* gram;
+    size_t count;
+    size_t capacity;
+};
+
+struct midi_ngram_index_t {
+    uint32_t songs;
+    size_t keys;
+
+    uint32_t* key;    // sorted gram keys
+    uint32_t* df;     // songs containing each key
+    uint64_t* offset; // keys + 1 posting list offsets
+    uint8_t* postings;
+    uint64_t size;    // bytes of postings
+};
+
+struct midi_ngram_hit_t {
+    uint32_t song;
+    float score;
+};
+
+// collect the grams of a midi file
+// note: 'grams' should be zero initialised before first use, its storage is
+//       kept and reused by subsequent calls
+bool midi_ngrams_build(
+    struct midi_t* midi,
+    struct midi_ngrams_t* grams);
+
+// collect the grams of a single melodic line
+// note: onset may be NULL, giving only interval grams
+bool midi_ngrams_from_keys(
+    const uint8_t* key,
+    const uint64_t* onset,
+    size_t count,
+    struct midi_ngrams_t* grams);
+
+// release gram storage
+void midi_ngrams_free(
+    struct midi_ngrams_t* grams);
+
+// build an inverted index, song ids being positions in the 'songs' array
+bool midi_ngram_index_build(
+    struct midi_ngram_index_t* index,
+    const struct midi_ngrams_t* songs,
+    size_t count);
+
+// release an index
+void midi_ngram_index_free(
+    struct midi_ngram_index_t* index);
+
+// write an index at the current file position
+bool midi_ngram_index_save(
+    const struct midi_ngram_index_t* index,
+    FILE* fd);
+
+// read an index written by midi_ngram_index_save()
+bool midi_ngram_index_load(
+    struct midi_ngram_index_t* index,
+    FILE* fd);
+
+// rank songs by the grams they share with a query, best first
+// note: returns the number of hits written, at most k
+size_t midi_ngram_query(
+    const struct midi_ngram_index_t* index,
+    const struct midi_ngrams_t* query,
+    struct midi_ngram_hit_t* hits,
+    size_t k);
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
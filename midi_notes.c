@@ -0,0 +1,216 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "midi_notes.h"
+
+
+enum {
+    NUM_CHANNELS = 16,
+    NUM_KEYS     = 128,
+
+    // maximum number of overlapping notes of the same key on one channel
+    // note: beyond this the oldest pending note is truncated
+    STACK_DEPTH  = 8,
+};
+
+// pending note ons for one (channel, key) pair
+// note: indices refer to spans already emitted into the output array, so
+//       closing a note only has to fill in its duration
+struct note_stack_t {
+    uint32_t size;
+    uint32_t index[STACK_DEPTH];
+};
+
+static void notes_reserve(struct midi_notes_t* notes, size_t count)
+{
+    if (count <= notes->capacity) {
+        return;
+    }
+    size_t capacity = notes->capacity ? notes->capacity : 256;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    notes->note = realloc(notes->note, capacity * sizeof(struct midi_note_t));
+    assert(notes->note);
+    notes->capacity = capacity;
+}
+
+static void note_close(struct midi_notes_t* notes, uint32_t index, uint64_t time)
+{
+    struct midi_note_t* note = notes->note + index;
+    note->duration = time - note->start;
+}
+
+static void note_on(
+    struct midi_notes_t* notes,
+    struct note_stack_t* stack,
+    const struct midi_event_t* event,
+    uint64_t time,
+    size_t track)
+{
+    if (stack->size == STACK_DEPTH) {
+        // truncate the oldest pending note to make room
+        note_close(notes, stack->index[0], time);
+        notes->note[stack->index[0]].flags |= e_midi_note_truncated;
+        memmove(stack->index, stack->index + 1,
+            sizeof(uint32_t) * (STACK_DEPTH - 1));
+        --stack->size;
+    }
+    if (notes->count == notes->capacity) {
+        notes_reserve(notes, notes->count + 1);
+    }
+    const uint32_t index = (uint32_t)(notes->count++);
+    struct midi_note_t* note = notes->note + index;
+    note->start    = time;
+    note->duration = 0;
+    note->track    = (uint16_t)track;
+    note->channel  = (uint8_t)event->channel;
+    note->key      = event->data[0] & 0x7f;
+    note->velocity = event->data[1] & 0x7f;
+    note->flags    = 0;
+    stack->index[stack->size++] = index;
+}
+
+static void note_off(
+    struct midi_notes_t* notes,
+    struct note_stack_t* stack,
+    uint64_t time)
+{
+    // note off without a matching note on is ignored
+    if (stack->size) {
+        note_close(notes, stack->index[--stack->size], time);
+    }
+}
+
+static void channel_off(
+    struct midi_notes_t* notes,
+    struct note_stack_t* stacks,
+    uint64_t time)
+{
+    for (uint32_t key = 0; key < NUM_KEYS; ++key) {
+        struct note_stack_t* stack = stacks + key;
+        while (stack->size) {
+            note_close(notes, stack->index[--stack->size], time);
+        }
+    }
+}
+
+static void notes_event(
+    struct midi_notes_t* notes,
+    struct note_stack_t* stacks,
+    const struct midi_event_t* event,
+    uint64_t time,
+    size_t track)
+{
+    const uint32_t channel = event->channel & 0x0f;
+    switch (event->type) {
+    case e_midi_event_note_on:
+        if (event->data[1] != 0) {
+            note_on(notes, stacks + channel * NUM_KEYS + (event->data[0] & 0x7f),
+                event, time, track);
+            break;
+        }
+        // velocity 0 note on is a note off
+        // fall through
+    case e_midi_event_note_off:
+        note_off(notes, stacks + channel * NUM_KEYS + (event->data[0] & 0x7f), time);
+        break;
+    case e_midi_event_channel_mode:
+        if (event->data[0] == e_midi_cmode_all_notes_off ||
+            event->data[0] == e_midi_cmode_all_sound_off) {
+            channel_off(notes, stacks + channel * NUM_KEYS, time);
+        }
+        break;
+    }
+}
+
+// anything still pending runs until the end of the song
+static void notes_finish(struct midi_notes_t* notes, struct note_stack_t* stacks, uint64_t time)
+{
+    for (uint32_t i = 0; i < NUM_CHANNELS * NUM_KEYS; ++i) {
+        struct note_stack_t* stack = stacks + i;
+        while (stack->size) {
+            const uint32_t index = stack->index[--stack->size];
+            note_close(notes, index, time);
+            notes->note[index].flags |= e_midi_note_unterminated;
+        }
+    }
+}
+
+bool midi_notes_build(struct midi_t* midi, struct midi_notes_t* notes)
+{
+    assert(midi && notes);
+    notes->count = 0;
+
+    // roughly three bytes per event with running status, about half of which
+    // tend to be note ons, so this avoids most regrowth
+    size_t bytes = 0;
+    for (uint32_t i = 0; i < midi->num_tracks; ++i) {
+        bytes += midi->tracks[i].length;
+    }
+    notes_reserve(notes, bytes / 6);
+
+    struct midi_mux_t* mux = midi_mux(midi);
+    if (!mux) {
+        return false;
+    }
+    struct note_stack_t* stacks =
+        calloc(NUM_CHANNELS * NUM_KEYS, sizeof(struct note_stack_t));
+    assert(stacks);
+
+    struct midi_event_t event;
+    uint64_t time = 0;
+    size_t track = 0;
+    while (midi_mux_next(mux, &event, &time, &track)) {
+        notes_event(notes, stacks, &event, time, track);
+    }
+    notes_finish(notes, stacks, time);
+
+    free(stacks);
+    midi_mux_free(mux);
+    return true;
+}
+
+bool midi_notes_build_packed(const struct midi_packed_stream_t* stream, struct midi_notes_t* notes)
+{
+    assert(stream && notes);
+    notes->count = 0;
+    // about half of all slots tend to be note ons
+    notes_reserve(notes, stream->count / 2);
+
+    struct note_stack_t* stacks =
+        calloc(NUM_CHANNELS * NUM_KEYS, sizeof(struct note_stack_t));
+    if (!stacks) {
+        return false;
+    }
+    // unpack in blocks to keep the event scratch space in cache
+    enum { BLOCK = 256 };
+    struct midi_event_t event[BLOCK];
+    uint64_t time = 0;
+    size_t pos = 0, n = 0;
+    while ((n = midi_unpack_events(stream, &pos, event, BLOCK)) != 0) {
+        for (size_t i = 0; i < n; ++i) {
+            time += event[i].delta;
+            notes_event(notes, stacks, event + i, time, 0);
+        }
+    }
+    notes_finish(notes, stacks, time);
+
+    free(stacks);
+    return true;
+}
+
+void midi_notes_free(struct midi_notes_t* notes)
+{
+    assert(notes);
+    free(notes->note);
+    memset(notes, 0, sizeof(struct midi_notes_t));
+}
@@ -0,0 +1,62 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#pragma once
+#include "libmidi.h"
+#include "midi_packed.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+enum midi_note_flags_t {
+
+    // no matching note off was found before the end of the song
+    // note: duration extends to the time of the last event
+    e_midi_note_unterminated = 0x01,
+
+    // the note was closed early because too many overlapping notes of the
+    // same key were pending on its channel
+    e_midi_note_truncated    = 0x02,
+};
+
+struct midi_note_t {
+    uint64_t start;    // absolute start time in ticks
+    uint64_t duration; // duration in ticks
+    uint16_t track;    // track holding the note on event
+    uint8_t  channel;
+    uint8_t  key;
+    uint8_t  velocity;
+    uint8_t  flags;
+};
+
+struct midi_notes_t {
+    struct midi_note_t* note;
+    size_t count;
+    size_t capacity;
+};
+
+// pair note on and note off events into spans sorted by start time
+// note: 'notes' should be zero initialised before first use, its storage is
+//       kept and reused by subsequent calls
+bool midi_notes_build(
+    struct midi_t* midi,
+    struct midi_notes_t* notes);
+
+// pair the notes of a packed stream, such as a compiled cache's
+// note: a packed stream is already merged, so every note has track 0
+bool midi_notes_build_packed(
+    const struct midi_packed_stream_t* stream,
+    struct midi_notes_t* notes);
+
+// release note span storage
+void midi_notes_free(
+    struct midi_notes_t* notes);
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
@@ -0,0 +1,347 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "midi_optimize.h"
+
+
+enum {
+    NUM_CHANNELS = 16,
+    NUM_CTRLS    = 120,
+    NUM_KEYS     = 128,
+
+    // value not yet known, so the next event always has an effect
+    UNKNOWN      = 0xffff,
+
+    // percussion channel, where even zero length notes trigger a sound
+    DRUM_CHANNEL = 9,
+
+    SUSTAIN      = 64,
+};
+
+// a piece of channel state along with the event that last set it
+// note: 'before' is the value prior to that event, used when a later event
+//       at the same tick overwrites it
+struct slot_t {
+    uint16_t value;
+    uint16_t before;
+    uint64_t tick;
+    uint64_t serial; // channel event counter when set
+    uint32_t track;
+    uint32_t event;
+    bool live;       // an event we kept is the source of 'value'
+};
+
+struct channel_t {
+    struct slot_t ctrl[NUM_CTRLS];
+    struct slot_t prog;
+    struct slot_t wheel;
+    struct slot_t touch;
+    bool bank_dirty;
+
+    uint8_t sounding[NUM_KEYS];
+    // last note on per key, for zero length note removal
+    uint64_t on_tick[NUM_KEYS];
+    uint32_t on_track[NUM_KEYS];
+    uint32_t on_event[NUM_KEYS];
+
+    // counts every event on this channel
+    uint64_t serial;
+};
+
+// per track bitmap of removed events
+struct drop_t {
+    uint8_t** bits;
+};
+
+static void drop(struct drop_t* d, uint32_t track, uint32_t event)
+{
+    d->bits[track][event >> 3] |= (uint8_t)(1u << (event & 7));
+}
+
+static bool dropped(const struct drop_t* d, uint32_t track, uint32_t event)
+{
+    return (d->bits[track][event >> 3] >> (event & 7)) & 1;
+}
+
+static void slot_reset(struct slot_t* slot)
+{
+    slot->value = slot->before = UNKNOWN;
+    slot->live = false;
+}
+
+// decide whether a state setting event is kept
+// note: returns true if the event should be removed
+static bool slot_set(
+    struct slot_t         *slot,
+    struct drop_t         *d,
+    const struct channel_t *chan,
+    uint16_t               value,
+    uint64_t               tick,
+    uint32_t               track,
+    uint32_t               event,
+    uint64_t              *redundant,
+    uint64_t              *overwritten)
+{
+    if (slot->value == value) {
+        ++(*redundant);
+        return true;
+    }
+    if (slot->live && slot->tick == tick && slot->serial + 1 == chan->serial) {
+        // the previous event set this slot at the same tick with nothing in
+        // between on this channel, so it was never heard
+        drop(d, slot->track, slot->event);
+        ++(*overwritten);
+        if (slot->before == value) {
+            // and this event just restores the older value
+            slot->value = value;
+            slot->live = false;
+            ++(*redundant);
+            return true;
+        }
+        slot->value = value;
+    } else {
+        slot->before = slot->value;
+        slot->value = value;
+    }
+    slot->live   = true;
+    slot->tick   = tick;
+    slot->serial = chan->serial;
+    slot->track  = track;
+    slot->event  = event;
+    return false;
+}
+
+// forget controller, program, wheel and aftertouch values
+// note: sounding notes are kept, a later note off is never removed for them
+static void state_reset(struct channel_t* chan)
+{
+    for (int i = 0; i < NUM_CTRLS; ++i) {
+        slot_reset(chan->ctrl + i);
+    }
+    slot_reset(&chan->prog);
+    slot_reset(&chan->wheel);
+    slot_reset(&chan->touch);
+    chan->bank_dirty = false;
+}
+
+static void channel_reset(struct channel_t* chan)
+{
+    state_reset(chan);
+    memset(chan->sounding, 0, sizeof(chan->sounding));
+}
+
+static bool dedup_ctrl(uint32_t ctrl)
+{
+    switch (ctrl) {
+    case 6:  // data entry msb
+    case 38: // data entry lsb
+    case 96: // data increment
+    case 97: // data decrement
+        // these act on the selected parameter, not on a value of their own
+        return false;
+    case 98:  // nrpn lsb
+    case 99:  // nrpn msb
+    case 100: // rpn lsb
+    case 101: // rpn msb
+        // selecting one kind of parameter deselects the other, so resending
+        // an unchanged number still decides where data entry goes
+        return false;
+    default:
+        return true;
+    }
+}
+
+static bool analyse(
+    struct midi_t                *midi,
+    struct drop_t                *d,
+    struct midi_optimize_stats_t *stats)
+{
+    struct midi_mux_t* mux = midi_mux(midi);
+    if (!mux) {
+        return false;
+    }
+    struct channel_t* channels = malloc(sizeof(struct channel_t) * NUM_CHANNELS);
+    assert(channels);
+    for (int i = 0; i < NUM_CHANNELS; ++i) {
+        channel_reset(channels + i);
+        channels[i].serial = 0;
+    }
+    uint32_t* ordinal = calloc(midi->num_tracks, sizeof(uint32_t));
+    assert(ordinal);
+
+    struct midi_event_t event;
+    uint64_t tick = 0;
+    size_t index = 0;
+    while (midi_mux_next(mux, &event, &tick, &index)) {
+        const uint32_t track = (uint32_t)index;
+        const uint32_t id = ordinal[track]++;
+        ++stats->events_in;
+        if (event.type == e_midi_event_sysex) {
+            // a sysex may reset the device (GM, GS or XG reset) or change
+            // any of its parameters, so nothing set before it can be relied on
+            for (int i = 0; i < NUM_CHANNELS; ++i) {
+                state_reset(channels + i);
+            }
+            continue;
+        }
+        if (event.type >= e_midi_event_sysex && event.type != e_midi_event_channel_mode) {
+            continue;
+        }
+        struct channel_t* chan = channels + event.channel;
+        ++chan->serial;
+        bool remove = false;
+
+        switch (event.type) {
+        case e_midi_event_ctrl_change: {
+            const uint32_t ctrl = event.data[0];
+            if (ctrl == 0 || ctrl == 32) {
+                // bank select only applies on the next program change
+                chan->bank_dirty = true;
+            }
+            if (dedup_ctrl(ctrl)) {
+                remove = slot_set(chan->ctrl + ctrl, d, chan, event.data[1],
+                    tick, track, id, &stats->redundant_ctrl, &stats->overwritten);
+            }
+            break;
+        }
+        case e_midi_event_prog_change:
+            if (chan->bank_dirty) {
+                // force the program change so the new bank is applied
+                chan->prog.value = UNKNOWN;
+                chan->prog.live = false;
+                chan->bank_dirty = false;
+            }
+            remove = slot_set(&chan->prog, d, chan, event.data[0],
+                tick, track, id, &stats->redundant_prog, &stats->overwritten);
+            break;
+        case e_midi_event_pitch_wheel:
+            remove = slot_set(&chan->wheel, d, chan,
+                (uint16_t)(event.data[0] | (event.data[1] << 7)),
+                tick, track, id, &stats->redundant_wheel, &stats->overwritten);
+            break;
+        case e_midi_event_chan_aftertouch:
+            remove = slot_set(&chan->touch, d, chan, event.data[0],
+                tick, track, id, &stats->redundant_wheel, &stats->overwritten);
+            break;
+        case e_midi_event_channel_mode:
+            if (event.data[0] == e_midi_cmode_reset_all_controllers) {
+                for (int i = 0; i < NUM_CTRLS; ++i) {
+                    slot_reset(chan->ctrl + i);
+                }
+                slot_reset(&chan->wheel);
+                slot_reset(&chan->touch);
+            }
+            if (event.data[0] == e_midi_cmode_all_notes_off ||
+                event.data[0] == e_midi_cmode_all_sound_off) {
+                memset(chan->sounding, 0, sizeof(chan->sounding));
+            }
+            break;
+        case e_midi_event_note_on:
+            if (event.data[1] != 0) {
+                const uint32_t key = event.data[0] & 0x7f;
+                if (chan->sounding[key] < 0xff) {
+                    ++chan->sounding[key];
+                }
+                chan->on_tick[key]  = tick;
+                chan->on_track[key] = track;
+                chan->on_event[key] = id;
+                break;
+            }
+            // fall through
+        case e_midi_event_note_off: {
+            const uint32_t key = event.data[0] & 0x7f;
+            if (chan->sounding[key] == 0) {
+                ++stats->stray_note_off;
+                remove = true;
+                break;
+            }
+            const uint16_t sustain = chan->ctrl[SUSTAIN].value;
+            const bool held = (sustain != UNKNOWN) && (sustain >= 64);
+            if (--chan->sounding[key] == 0 &&
+                chan->on_tick[key] == tick &&
+                event.channel != DRUM_CHANNEL && !held) {
+                // a note that never sounded
+                drop(d, chan->on_track[key], chan->on_event[key]);
+                stats->zero_length += 2;
+                remove = true;
+            }
+            break;
+        }
+        }
+        if (remove) {
+            drop(d, track, id);
+        }
+    }
+    free(ordinal);
+    free(channels);
+    midi_mux_free(mux);
+    return true;
+}
+
+bool midi_optimize(
+    struct midi_t                *midi,
+    struct midi_writer_t         *w,
+    struct midi_optimize_stats_t *stats)
+{
+    assert(midi && w && stats);
+    memset(stats, 0, sizeof(struct midi_optimize_stats_t));
+
+    struct drop_t d;
+    d.bits = malloc(sizeof(uint8_t*) * midi->num_tracks);
+    assert(d.bits);
+    stats->bytes_in = 14;
+    for (uint32_t i = 0; i < midi->num_tracks; ++i) {
+        // every event takes at least two bytes, a delta and a data byte
+        const size_t events = midi->tracks[i].length / 2 + 1;
+        d.bits[i] = calloc(events / 8 + 1, 1);
+        assert(d.bits[i]);
+        stats->bytes_in += 8 + midi->tracks[i].length;
+    }
+
+    bool ok = analyse(midi, &d, stats);
+    ok = ok && midi_write_header(w, midi->format, midi->num_tracks, midi->divisions);
+    const size_t start = w->flushed + w->size - 14;
+
+    for (uint32_t i = 0; ok && i < midi->num_tracks; ++i) {
+        struct midi_stream_t* stream = midi_stream(midi, i);
+        if (!stream || !midi_write_track_begin(w)) {
+            ok = false;
+            break;
+        }
+        struct midi_event_t event;
+        uint64_t carry = 0;
+        for (uint32_t id = 0; ok && !midi_stream_end(stream); ++id) {
+            if (!midi_event_next(stream, &event)) {
+                ok = false;
+                break;
+            }
+            if (dropped(&d, i, id)) {
+                // keep later events at their original time
+                carry += event.delta;
+                continue;
+            }
+            event.delta += carry;
+            carry = 0;
+            ok = midi_write_event(w, &event);
+            ++stats->events_out;
+        }
+        midi_stream_free(stream);
+        ok = ok && midi_write_track_end(w);
+    }
+    ok = ok && midi_write_finish(w);
+    stats->bytes_out = w->flushed + w->size - start;
+
+    for (uint32_t i = 0; i < midi->num_tracks; ++i) {
+        free(d.bits[i]);
+    }
+    free(d.bits);
+    return ok;
+}
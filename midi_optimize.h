@@ -0,0 +1,42 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#pragma once
+#include "midi_writer.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+struct midi_optimize_stats_t {
+    uint64_t events_in;
+    uint64_t events_out;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+
+    // events removed by each rule
+    uint64_t redundant_ctrl;    // control change to the current value
+    uint64_t redundant_prog;    // program change to the current program
+    uint64_t redundant_wheel;   // pitch wheel or aftertouch to current value
+    uint64_t overwritten;       // replaced by a later event at the same tick
+    uint64_t zero_length;       // note on and off at the same tick
+    uint64_t stray_note_off;    // note off for a key that is not sounding
+};
+
+// write a copy of a midi file with events that have no audible effect removed
+// note: channel state is tracked across the merged stream of all tracks, but
+//       events are written back to the track they came from. the output uses
+//       running status throughout. any sysex event forgets controller and
+//       program state, as it may reset the device.
+bool midi_optimize(
+    struct midi_t* midi,
+    struct midi_writer_t* writer,
+    struct midi_optimize_stats_t* stats);
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
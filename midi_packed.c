@@ -0,0 +1,225 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "midi_packed.h"
+
+
+enum {
+    // status value of a slot carrying only delta time
+    e_delta_only = 0x00,
+    MAX_DELTA    = 0xffffffffu,
+};
+
+static bool reserve_slots(struct midi_packed_stream_t* s, size_t count)
+{
+    if (count <= s->capacity) {
+        return true;
+    }
+    size_t capacity = s->capacity ? s->capacity : 1024;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    struct midi_packed_t* slot = realloc(s->slot, capacity * sizeof(struct midi_packed_t));
+    if (!slot) {
+        return false;
+    }
+    s->slot = slot;
+    s->capacity = capacity;
+    return true;
+}
+
+static bool reserve_payload(struct midi_packed_stream_t* s, size_t size)
+{
+    if (size > MAX_DELTA) {
+        // offsets are 32 bit
+        return false;
+    }
+    if (size <= s->payload_capacity) {
+        return true;
+    }
+    size_t capacity = s->payload_capacity ? s->payload_capacity : 1024;
+    while (capacity < size) {
+        capacity *= 2;
+    }
+    uint8_t* payload = realloc(s->payload, capacity);
+    if (!payload) {
+        return false;
+    }
+    s->payload = payload;
+    s->payload_capacity = capacity;
+    return true;
+}
+
+static bool is_escape(uint8_t status)
+{
+    return status >= e_midi_event_sysex;
+}
+
+bool midi_pack_events(
+    struct midi_packed_stream_t *out,
+    const struct midi_event_t   *event,
+    size_t                       count)
+{
+    assert(out && (event || !count));
+    // worst case, every event is an escape
+    // note: on failure the stream is left as it was before the call
+    const size_t payload_size = out->payload_size;
+    if (!reserve_slots(out, out->count + count * 2)) {
+        return false;
+    }
+    struct midi_packed_t* slot = out->slot + out->count;
+
+    for (size_t i = 0; i < count; ++i) {
+        const struct midi_event_t* e = event + i;
+        uint64_t delta = e->delta;
+        while (delta > MAX_DELTA) {
+            // rare, but keep the stream exact for huge gaps
+            const size_t index = slot - out->slot;
+            if (!reserve_slots(out, index + 1 + (count - i) * 2)) {
+                out->payload_size = payload_size;
+                return false;
+            }
+            slot = out->slot + index;
+            slot->delta  = MAX_DELTA;
+            slot->status = e_delta_only;
+            memset(slot->data, 0, 3);
+            delta -= MAX_DELTA;
+            ++slot;
+        }
+        // channel mode events are encoded as the control change they came from
+        const uint32_t type = (e->type == e_midi_event_channel_mode) ?
+            e_midi_event_ctrl_change : e->type;
+        const uint8_t status = (uint8_t)((type & 0xf0) | (e->channel & 0x0f));
+        slot->delta   = (uint32_t)delta;
+        slot->status  = status;
+        slot->data[2] = 0;
+        if (!is_escape(status)) {
+            slot->data[0] = e->length > 0 ? e->data[0] : 0;
+            slot->data[1] = e->length > 1 ? e->data[1] : 0;
+            ++slot;
+            continue;
+        }
+        // escape, copy payload to the pool
+        slot->data[0] = (uint8_t)e->meta;
+        slot->data[1] = 0;
+        ++slot;
+        const size_t offset = out->payload_size;
+        if (!reserve_payload(out, offset + e->length)) {
+            out->payload_size = payload_size;
+            return false;
+        }
+        if (e->length) {
+            // a meta event without data may leave the pool unallocated
+            memcpy(out->payload + offset, e->data, (size_t)e->length);
+        }
+        out->payload_size += (size_t)e->length;
+        const struct midi_packed_payload_t payload = {
+            (uint32_t)offset, (uint32_t)e->length
+        };
+        memcpy(slot++, &payload, sizeof(payload));
+    }
+    out->count = slot - out->slot;
+    return true;
+}
+
+bool midi_pack(struct midi_t* midi, struct midi_packed_stream_t* out)
+{
+    assert(midi && out);
+    out->count = 0;
+    out->payload_size = 0;
+
+    struct midi_mux_t* mux = midi_mux(midi);
+    if (!mux) {
+        return false;
+    }
+    // convert in blocks to keep the event scratch space in cache
+    enum { BLOCK = 256 };
+    struct midi_event_t event[BLOCK];
+    uint64_t prev = 0, time = 0;
+    size_t track = 0, n = 0;
+    bool ok = true;
+    while (ok && midi_mux_next(mux, event + n, &time, &track)) {
+        // rebase delta onto the merged stream
+        event[n].delta = time - prev;
+        prev = time;
+        if (++n == BLOCK) {
+            ok = midi_pack_events(out, event, n);
+            n = 0;
+        }
+    }
+    ok = ok && midi_pack_events(out, event, n);
+    midi_mux_free(mux);
+    return ok;
+}
+
+size_t midi_unpack_events(
+    const struct midi_packed_stream_t *in,
+    size_t                            *pos,
+    struct midi_event_t               *event,
+    size_t                             max)
+{
+    assert(in && pos && (event || !max));
+    const struct midi_packed_t* slot = in->slot + *pos;
+    const struct midi_packed_t* const end = in->slot + in->count;
+    uint64_t carry = 0;
+    size_t n = 0;
+    for (; n < max && slot < end; ++slot) {
+        if (slot->status == e_delta_only) {
+            carry += slot->delta;
+            continue;
+        }
+        struct midi_event_t* e = event + n++;
+        e->delta   = carry + slot->delta;
+        e->type    = slot->status & 0xf0;
+        e->channel = slot->status & 0x0f;
+        e->meta    = 0;
+        carry = 0;
+        if (!is_escape(slot->status)) {
+            e->data = slot->data;
+            switch (e->type) {
+            case e_midi_event_prog_change:
+            case e_midi_event_chan_aftertouch:
+                e->length = 1;
+                break;
+            case e_midi_event_ctrl_change:
+                e->length = 2;
+                if (slot->data[0] >= 120) {
+                    e->type = e_midi_event_channel_mode;
+                }
+                break;
+            default:
+                e->length = 2;
+            }
+            continue;
+        }
+        if (slot->status == e_midi_event_meta) {
+            e->type = e_midi_event_meta;
+            e->meta = slot->data[0];
+        }
+        ++slot;
+        assert(slot < end);
+        struct midi_packed_payload_t payload;
+        memcpy(&payload, slot, sizeof(payload));
+        // a stream of empty metas has no pool at all
+        e->data   = payload.length ? in->payload + payload.offset : NULL;
+        e->length = payload.length;
+    }
+    *pos = slot - in->slot;
+    return n;
+}
+
+void midi_packed_free(struct midi_packed_stream_t* stream)
+{
+    assert(stream);
+    free(stream->slot);
+    free(stream->payload);
+    memset(stream, 0, sizeof(struct midi_packed_stream_t));
+}
@@ -0,0 +1,79 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#pragma once
+#include "libmidi.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// compact 8 byte event
+//
+// channel events:
+//   delta   ticks since the previous event
+//   status  1sssnnnn status and channel
+//   data    up to two data bytes
+//
+// sysex and meta events (status 0xf0, 0xf7, 0xff) are followed by a second
+// slot, read as a midi_packed_payload_t, referencing the event data bytes in
+// the payload pool. data[0] holds the meta type.
+//
+// a slot with status 0 carries only delta time, for gaps that do not fit in
+// 32 bits, and is folded into the following event when unpacked.
+struct midi_packed_t {
+    uint32_t delta;
+    uint8_t  status;
+    uint8_t  data[3];
+};
+
+struct midi_packed_payload_t {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct midi_packed_stream_t {
+    struct midi_packed_t* slot;
+    size_t count;
+    size_t capacity;
+
+    uint8_t* payload;
+    size_t payload_size;
+    size_t payload_capacity;
+};
+
+// convert the merged event stream of a midi file to packed events
+// note: 'out' should be zero initialised before first use, its storage is
+//       reset and reused by subsequent calls
+bool midi_pack(
+    struct midi_t* midi,
+    struct midi_packed_stream_t* out);
+
+// append events to a packed stream
+// note: each event delta is taken as relative to the previous event in the
+//       array, not to the previous event of its source track
+bool midi_pack_events(
+    struct midi_packed_stream_t* out,
+    const struct midi_event_t* event,
+    size_t count);
+
+// unpack up to 'max' events starting at slot index '*pos'
+// note: returns the number of events written and advances '*pos', event data
+//       points into the packed stream which must outlive the events
+size_t midi_unpack_events(
+    const struct midi_packed_stream_t* in,
+    size_t* pos,
+    struct midi_event_t* event,
+    size_t max);
+
+// release packed stream storage
+void midi_packed_free(
+    struct midi_packed_stream_t* stream);
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
@@ -0,0 +1,378 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "midi_patch.h"
+
+
+#define MALFORMED ((size_t)-1)
+
+enum {
+    NUM_CHANNELS = 16,
+    NUM_KEYS     = 128,
+};
+
+// a patch reduced to lookups, indexed by the original bytes
+struct table_t {
+    uint8_t status[256];
+    uint8_t upper[256];     // status of note events at or above the split
+    uint8_t key[NUM_KEYS];
+    uint8_t velocity[NUM_KEYS];
+    uint16_t keys;          // channels transposed
+    uint16_t velocities;    // channels with velocities scaled
+    uint8_t split_key;
+};
+
+struct split_t {
+    uint32_t track;
+    uint8_t source;         // original status of the run being split
+    size_t offset;          // of the first event needing its own status
+};
+
+static void table_build(const struct midi_patch_t* patch, struct table_t* t)
+{
+    for (uint32_t s = 0; s < 256; ++s) {
+        t->status[s] = t->upper[s] = (uint8_t)s;
+        if (s >= 0x80 && s < 0xf0) {
+            const uint32_t channel = s & 0x0f;
+            t->status[s] = (uint8_t)((s & 0xf0) | (patch->channel[channel] & 0x0f));
+            t->upper[s] = (uint8_t)((s & 0xf0) | (patch->split_channel[channel] & 0x0f));
+        }
+    }
+    for (int k = 0; k < NUM_KEYS; ++k) {
+        int key = k + patch->transpose % 120;
+        while (key >= NUM_KEYS) {
+            key -= 12;
+        }
+        while (key < 0) {
+            key += 12;
+        }
+        t->key[k] = (uint8_t)key;
+        // a zero velocity note on is a note off, and must remain one
+        uint32_t velocity = ((uint32_t)k * patch->velocity + 128) >> 8;
+        velocity = (velocity < 1) ? 1 : (velocity > 127) ? 127 : velocity;
+        t->velocity[k] = (k == 0) ? 0 : (uint8_t)velocity;
+    }
+    t->keys = patch->keys;
+    t->velocities = patch->velocities;
+    t->split_key = patch->split_key;
+}
+
+// edit the data bytes of a channel event, returning its new status
+static uint8_t patch_event(const struct table_t* t, uint8_t status, uint8_t* data)
+{
+    const uint8_t type = status & 0xf0;
+    if (type != e_midi_event_note_off && type != e_midi_event_note_on &&
+        type != e_midi_event_poly_aftertouch) {
+        return t->status[status];
+    }
+    const uint8_t key = data[0] & 0x7f;
+    const uint8_t out = (key >= t->split_key) ? t->upper[status] : t->status[status];
+    const uint32_t channel = 1u << (status & 0x0f);
+    if (t->keys & channel) {
+        data[0] = t->key[key];
+    }
+    if ((t->velocities & channel) && type == e_midi_event_note_on) {
+        data[1] = t->velocity[data[1] & 0x7f];
+    }
+    return out;
+}
+
+// read a VLQ that may run off the end of a track, returning 0 if it does
+static size_t vlq_get(const uint8_t* in, const uint8_t* end, uint64_t* out)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < 10 && in + i < end; ++i) {
+        value = (value << 7) | (in[i] & 0x7f);
+        if ((in[i] & 0x80) == 0) {
+            *out = value;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// step over a meta or sysex event body, returning NULL if it is malformed
+static const uint8_t* skip_message(
+    uint8_t status,
+    const uint8_t* p,
+    const uint8_t* end,
+    bool* end_of_track)
+{
+    uint8_t meta = 0;
+    if (status == e_midi_event_meta) {
+        if (p >= end) {
+            return NULL;
+        }
+        meta = *(p++);
+    }
+    uint64_t length = 0;
+    const size_t size = vlq_get(p, end, &length);
+    if (!size || length > (uint64_t)(end - p - size)) {
+        return NULL;
+    }
+    // the parser stops reading a track at its end of track event
+    *end_of_track = (status == e_midi_event_meta && meta == e_midi_meta_end_of_track);
+    return p + size + length;
+}
+
+// ----------------------------------------------------------------------------
+// In place
+// ----------------------------------------------------------------------------
+
+// edit a track where it lies, stopping at the first event that needs a status
+// byte of its own
+// note: returns the offset of that event, the track length once the whole
+//       track is edited, or MALFORMED
+static size_t patch_track(
+    const struct table_t* t,
+    uint8_t* data,
+    size_t length,
+    uint8_t* source,
+    struct midi_patch_stats_t* stats)
+{
+    uint8_t* p = data;
+    const uint8_t* const end = data + length;
+    // status in effect as it was and as it now reads, the parser starting
+    // from a meta event
+    uint8_t from = 0xff, running = 0xff;
+    uint64_t events = 0, changed = 0;
+    while (p < end) {
+        uint8_t* const event = p;
+        uint64_t delta;
+        const size_t size = vlq_get(p, end, &delta);
+        if (!size || p + size >= end) {
+            return MALFORMED;
+        }
+        p += size;
+        const bool explicit_status = (*p & 0x80) != 0;
+        if (explicit_status) {
+            from = *(p++);
+        }
+        if (from >= 0xf0) {
+            bool end_of_track = false;
+            p = (uint8_t*)skip_message(from, p, end, &end_of_track);
+            if (!p) {
+                return MALFORMED;
+            }
+            running = from;
+            if (end_of_track) {
+                break;
+            }
+            continue;
+        }
+        const uint8_t type = from & 0xf0;
+        const size_t bytes = (type == e_midi_event_prog_change ||
+                              type == e_midi_event_chan_aftertouch) ? 1 : 2;
+        if ((size_t)(end - p) < bytes) {
+            return MALFORMED;
+        }
+        uint8_t edit[2] = { p[0], (bytes > 1) ? p[1] : 0 };
+        const uint8_t status = patch_event(t, from, edit);
+        if (explicit_status) {
+            p[-1] = running = status;
+        } else if (status != running) {
+            *source = from;
+            stats->events += events;
+            stats->changed += changed;
+            return (size_t)(event - data);
+        }
+        ++events;
+        changed += (status != from) | (edit[0] != p[0]) | (edit[1] != ((bytes > 1) ? p[1] : 0));
+        memcpy(p, edit, bytes);
+        p += bytes;
+    }
+    stats->events += events;
+    stats->changed += changed;
+    return length;
+}
+
+// ----------------------------------------------------------------------------
+// Re-encoding
+// ----------------------------------------------------------------------------
+
+// write a track out, editing the events from 'stop' onwards, those before it
+// having been edited in place already
+static bool encode_track(
+    const struct table_t* t,
+    const uint8_t* data,
+    size_t length,
+    const struct split_t* split,
+    struct midi_writer_t* w,
+    struct midi_patch_stats_t* stats)
+{
+    const uint8_t* p = data;
+    const uint8_t* const end = data + length;
+    uint8_t running = 0xff;
+    bool ok = midi_write_track_begin(w);
+    while (ok && p < end) {
+        const size_t offset = (size_t)(p - data);
+        struct midi_event_t event;
+        const size_t size = vlq_get(p, end, &event.delta);
+        if (!size || p + size >= end) {
+            return false;
+        }
+        p += size;
+        if (*p & 0x80) {
+            running = *(p++);
+        } else if (offset == split->offset) {
+            // the buffer holds the edited status of this run
+            running = split->source;
+        }
+        if (running >= 0xf0) {
+            bool end_of_track = false;
+            const uint8_t* next = skip_message(running, p, end, &end_of_track);
+            if (!next) {
+                return false;
+            }
+            event.channel = running & 0x0f;
+            if (running == e_midi_event_meta) {
+                event.type = e_midi_event_meta;
+                event.meta = *(p++);
+                p += vlq_get(p, end, &event.length);
+            } else {
+                // sysex data holds the VLQ length as well as the message
+                event.type = e_midi_event_sysex;
+                event.meta = 0;
+                event.length = (uint64_t)(next - p);
+            }
+            event.data = p;
+            p = next;
+            ok = midi_write_event(w, &event);
+            if (end_of_track) {
+                break;
+            }
+            continue;
+        }
+        const uint8_t type = running & 0xf0;
+        const size_t bytes = (type == e_midi_event_prog_change ||
+                              type == e_midi_event_chan_aftertouch) ? 1 : 2;
+        if ((size_t)(end - p) < bytes) {
+            return false;
+        }
+        uint8_t edit[2] = { p[0], (bytes > 1) ? p[1] : 0 };
+        uint8_t status = running;
+        if (offset >= split->offset) {
+            status = patch_event(t, running, edit);
+            ++stats->events;
+            stats->changed += (status != running) | (edit[0] != p[0]) |
+                              (edit[1] != ((bytes > 1) ? p[1] : 0));
+        }
+        event.type = status & 0xf0;
+        event.channel = status & 0x0f;
+        event.meta = 0;
+        event.length = bytes;
+        event.data = edit;
+        p += bytes;
+        ok = midi_write_event(w, &event);
+    }
+    return ok && midi_write_track_end(w);
+}
+
+static bool encode(
+    const struct table_t* t,
+    struct midi_t* midi,
+    const struct split_t* split,
+    size_t splits,
+    struct midi_writer_t* w,
+    struct midi_patch_stats_t* stats)
+{
+    if (!midi_write_header(w, midi->format, midi->num_tracks, midi->divisions)) {
+        return false;
+    }
+    size_t next = 0;
+    for (uint32_t i = 0; i < midi->num_tracks; ++i) {
+        const struct midi_track_t* track = midi->tracks + i;
+        // tracks edited entirely in place are copied through
+        struct split_t whole = { i, 0, track->length };
+        const struct split_t* s = &whole;
+        if (next < splits && split[next].track == i) {
+            s = &split[next++];
+        }
+        if (!encode_track(t, track->data, track->length, s, w, stats)) {
+            return false;
+        }
+    }
+    return midi_write_finish(w);
+}
+
+// ----------------------------------------------------------------------------
+// Interface
+// ----------------------------------------------------------------------------
+
+void midi_patch_init(struct midi_patch_t* patch)
+{
+    assert(patch);
+    memset(patch, 0, sizeof(struct midi_patch_t));
+    patch->velocity = MIDI_PATCH_UNITY;
+    patch->split_key = MIDI_PATCH_NO_SPLIT;
+    patch->keys = patch->velocities = 0xffff;
+    for (uint8_t i = 0; i < NUM_CHANNELS; ++i) {
+        patch->channel[i] = patch->split_channel[i] = i;
+    }
+}
+
+enum midi_patch_result_t midi_patch(
+    void* data,
+    size_t size,
+    const struct midi_patch_t* patch,
+    struct midi_writer_t* writer,
+    struct midi_patch_stats_t* stats)
+{
+    assert(data && patch);
+    struct midi_patch_stats_t temp;
+    stats = stats ? stats : &temp;
+    memset(stats, 0, sizeof(struct midi_patch_stats_t));
+
+    // the loader finds the tracks, which are then edited through 'base'
+    struct midi_t* midi = midi_load(data, size);
+    if (!midi) {
+        return e_midi_patch_error;
+    }
+    uint8_t* const base = data;
+    struct table_t table;
+    table_build(patch, &table);
+
+    enum midi_patch_result_t result = e_midi_patch_in_place;
+    struct split_t* split = NULL;
+    size_t splits = 0;
+    for (uint32_t i = 0; i < midi->num_tracks; ++i) {
+        const struct midi_track_t* track = midi->tracks + i;
+        uint8_t* trk = base + (track->data - base);
+        uint8_t source = 0;
+        const size_t stop = patch_track(&table, trk, track->length, &source, stats);
+        stats->bytes += track->length;
+        ++stats->tracks;
+        if (stop == MALFORMED) {
+            result = e_midi_patch_error;
+            break;
+        }
+        if (stop < track->length) {
+            struct split_t* grown = realloc(split, (splits + 1) * sizeof(struct split_t));
+            if (!grown) {
+                result = e_midi_patch_error;
+                break;
+            }
+            split = grown;
+            split[splits].track = i;
+            split[splits].source = source;
+            split[splits].offset = stop;
+            ++splits;
+        }
+    }
+    stats->split_tracks = (uint32_t)splits;
+    if (result == e_midi_patch_in_place && splits) {
+        result = (writer && encode(&table, midi, split, splits, writer, stats)) ?
+            e_midi_patch_encoded : e_midi_patch_error;
+    }
+    free(split);
+    midi_free(midi);
+    return result;
+}
@@ -0,0 +1,75 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#pragma once
+#include "midi_writer.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// in place event editing
+//
+// transposing, remapping channels and scaling velocities never change the
+// length of a channel event, so they are applied directly to the bytes of a
+// loaded or writable mapped file, without decoding it into events.
+//
+// the one exception is running status. a key split can send events of one
+// run to two channels, which needs a status byte that is not there. such a
+// file is re-encoded instead: the tracks are written out through a writer,
+// with the edits applied as they go.
+enum {
+    MIDI_PATCH_UNITY    = 256, // velocity scale leaving velocities unchanged
+    MIDI_PATCH_NO_SPLIT = 128,
+};
+
+struct midi_patch_t {
+    int transpose;              // semitones, keys are folded into range by octaves
+    uint32_t velocity;          // note on velocity scale in 1/256ths
+    uint16_t keys;              // source channels transposed
+    uint16_t velocities;        // source channels with velocities scaled
+
+    uint8_t channel[16];        // destination of each source channel
+
+    // note events keyed at or above split_key go to split_channel instead
+    uint8_t split_key;
+    uint8_t split_channel[16];
+};
+
+enum midi_patch_result_t {
+    e_midi_patch_error = 0,
+    e_midi_patch_in_place,      // the buffer holds the edited file
+    e_midi_patch_encoded,       // the writer holds the edited file
+};
+
+struct midi_patch_stats_t {
+    uint64_t events;            // channel events visited
+    uint64_t changed;           // channel events with a byte changed
+    uint64_t bytes;             // track bytes scanned
+    uint32_t tracks;
+    uint32_t split_tracks;      // tracks needing a run split
+};
+
+// prepare a patch that leaves every event unchanged
+void midi_patch_init(
+    struct midi_patch_t* patch);
+
+// apply a patch to a midi file held in a writable buffer
+// note: the buffer is edited even when the file ends up re-encoded, or when
+//       it turns out to be malformed, so work on a copy on write mapping or a
+//       private copy. without a writer, files needing a re-encode fail.
+//       'stats' may be NULL.
+enum midi_patch_result_t midi_patch(
+    void* data,
+    size_t size,
+    const struct midi_patch_t* patch,
+    struct midi_writer_t* writer,
+    struct midi_patch_stats_t* stats);
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
@@ -0,0 +1,279 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#include <assert.h>
+#include <string.h>
+
+#include "midi_pipeline.h"
+
+
+enum {
+    // event type marking an event removed by a stage
+    e_dropped = 0,
+};
+
+uint32_t midi_type_mask(uint32_t type)
+{
+    switch (type) {
+    case e_midi_event_meta:         return e_midi_mask_meta;
+    case e_midi_event_channel_mode: return e_midi_mask_channel_mode;
+    case e_dropped:                 return 0;
+    default:                        return 1u << ((type >> 4) & 7);
+    }
+}
+
+static bool is_channel_event(uint32_t type)
+{
+    return (type >= e_midi_event_note_off && type < e_midi_event_sysex) ||
+           (type == e_midi_event_channel_mode);
+}
+
+static bool pipeline_push(struct midi_pipeline_t* pipe, struct midi_stage_t** out)
+{
+    assert(pipe);
+    if (pipe->count >= MIDI_MAX_STAGES) {
+        return false;
+    }
+    *out = pipe->stage + pipe->count++;
+    memset(*out, 0, sizeof(struct midi_stage_t));
+    return true;
+}
+
+void midi_pipeline_init(struct midi_pipeline_t* pipe)
+{
+    assert(pipe);
+    pipe->count = 0;
+}
+
+bool midi_pipeline_filter(struct midi_pipeline_t* pipe, uint32_t types, uint16_t channels)
+{
+    struct midi_stage_t* stage;
+    if (!pipeline_push(pipe, &stage)) {
+        return false;
+    }
+    stage->type = e_midi_stage_filter;
+    stage->channels = channels;
+    stage->types = types;
+    return true;
+}
+
+bool midi_pipeline_channel_map(struct midi_pipeline_t* pipe, const uint8_t map[16])
+{
+    struct midi_stage_t* stage;
+    if (!pipeline_push(pipe, &stage)) {
+        return false;
+    }
+    stage->type = e_midi_stage_channel_map;
+    stage->channels = MIDI_ALL_CHANNELS;
+    for (int i = 0; i < 16; ++i) {
+        stage->map[i] = map[i] & 0x0f;
+    }
+    return true;
+}
+
+bool midi_pipeline_transpose(struct midi_pipeline_t* pipe, int32_t semitones, uint16_t channels)
+{
+    struct midi_stage_t* stage;
+    if (!pipeline_push(pipe, &stage)) {
+        return false;
+    }
+    stage->type = e_midi_stage_transpose;
+    stage->channels = channels;
+    stage->semitones = semitones;
+    return true;
+}
+
+bool midi_pipeline_velocity(struct midi_pipeline_t* pipe, uint32_t scale, uint16_t channels)
+{
+    struct midi_stage_t* stage;
+    if (!pipeline_push(pipe, &stage)) {
+        return false;
+    }
+    stage->type = e_midi_stage_velocity;
+    stage->channels = channels;
+    stage->scale = scale;
+    return true;
+}
+
+bool midi_pipeline_time_scale(struct midi_pipeline_t* pipe, uint32_t num, uint32_t den)
+{
+    struct midi_stage_t* stage;
+    if (den == 0 || !pipeline_push(pipe, &stage)) {
+        return false;
+    }
+    stage->type = e_midi_stage_time_scale;
+    stage->channels = MIDI_ALL_CHANNELS;
+    stage->time.num = num;
+    stage->time.den = den;
+    return true;
+}
+
+size_t midi_batch_fill(struct midi_batch_t* batch, struct midi_mux_t* mux)
+{
+    assert(batch && mux);
+    size_t n = 0;
+    size_t track = 0;
+    for (; n < MIDI_BATCH_SIZE; ++n) {
+        struct midi_event_t* event = batch->event + n;
+        if (!midi_mux_next(mux, event, batch->time + n, &track)) {
+            break;
+        }
+        batch->track[n] = (uint16_t)track;
+        if (is_channel_event(event->type)) {
+            // take a private copy of the data bytes so stages can edit them
+            batch->bytes[n][0] = event->data[0];
+            batch->bytes[n][1] = (event->length > 1) ? event->data[1] : 0;
+            event->data = batch->bytes[n];
+        }
+    }
+    batch->count = n;
+    return n;
+}
+
+// ----------------------------------------------------------------------------
+// Stages
+// ----------------------------------------------------------------------------
+
+// each stage is a plain loop over the whole batch so that dispatch happens
+// once per batch rather than once per event
+
+static bool stage_filter(const struct midi_stage_t* stage, struct midi_batch_t* batch)
+{
+    bool dropped = false;
+    for (size_t i = 0; i < batch->count; ++i) {
+        struct midi_event_t* event = batch->event + i;
+        const uint32_t bit = midi_type_mask(event->type);
+        const bool channel = !is_channel_event(event->type) ||
+            (stage->channels & (1u << event->channel));
+        if ((stage->types & bit) && channel) {
+            event->type = e_dropped;
+            dropped = true;
+        }
+    }
+    return dropped;
+}
+
+static void stage_channel_map(const struct midi_stage_t* stage, struct midi_batch_t* batch)
+{
+    for (size_t i = 0; i < batch->count; ++i) {
+        struct midi_event_t* event = batch->event + i;
+        if (is_channel_event(event->type)) {
+            event->channel = stage->map[event->channel & 0x0f];
+        }
+    }
+}
+
+static bool stage_transpose(const struct midi_stage_t* stage, struct midi_batch_t* batch)
+{
+    bool dropped = false;
+    for (size_t i = 0; i < batch->count; ++i) {
+        struct midi_event_t* event = batch->event + i;
+        switch (event->type) {
+        case e_midi_event_note_off:
+        case e_midi_event_note_on:
+        case e_midi_event_poly_aftertouch:
+            break;
+        default:
+            continue;
+        }
+        if (!(stage->channels & (1u << event->channel))) {
+            continue;
+        }
+        const int32_t key = batch->bytes[i][0] + stage->semitones;
+        if (key < 0 || key > 127) {
+            event->type = e_dropped;
+            dropped = true;
+            continue;
+        }
+        batch->bytes[i][0] = (uint8_t)key;
+    }
+    return dropped;
+}
+
+static void stage_velocity(const struct midi_stage_t* stage, struct midi_batch_t* batch)
+{
+    for (size_t i = 0; i < batch->count; ++i) {
+        const struct midi_event_t* event = batch->event + i;
+        if (event->type != e_midi_event_note_on) {
+            continue;
+        }
+        if (!(stage->channels & (1u << event->channel))) {
+            continue;
+        }
+        const uint32_t velocity = batch->bytes[i][1];
+        if (velocity == 0) {
+            // keep note off semantics
+            continue;
+        }
+        uint32_t scaled = (velocity * stage->scale) >> 8;
+        scaled = (scaled < 1) ? 1 : (scaled > 127) ? 127 : scaled;
+        batch->bytes[i][1] = (uint8_t)scaled;
+    }
+}
+
+static void stage_time_scale(const struct midi_stage_t* stage, struct midi_batch_t* batch)
+{
+    const uint64_t num = stage->time.num;
+    const uint64_t den = stage->time.den;
+    for (size_t i = 0; i < batch->count; ++i) {
+        batch->time[i] = batch->time[i] * num / den;
+    }
+}
+
+// remove dropped events, keeping order
+static void batch_compact(struct midi_batch_t* batch)
+{
+    size_t out = 0;
+    for (size_t i = 0; i < batch->count; ++i) {
+        if (batch->event[i].type == e_dropped) {
+            continue;
+        }
+        if (out != i) {
+            struct midi_event_t* event = batch->event + out;
+            *event = batch->event[i];
+            batch->time[out] = batch->time[i];
+            batch->track[out] = batch->track[i];
+            if (event->data == batch->bytes[i]) {
+                memcpy(batch->bytes[out], batch->bytes[i], 2);
+                event->data = batch->bytes[out];
+            }
+        }
+        ++out;
+    }
+    batch->count = out;
+}
+
+void midi_pipeline_run(const struct midi_pipeline_t* pipe, struct midi_batch_t* batch)
+{
+    assert(pipe && batch);
+    bool dropped = false;
+    for (size_t s = 0; s < pipe->count; ++s) {
+        const struct midi_stage_t* stage = pipe->stage + s;
+        switch (stage->type) {
+        case e_midi_stage_filter:
+            dropped |= stage_filter(stage, batch);
+            break;
+        case e_midi_stage_channel_map:
+            stage_channel_map(stage, batch);
+            break;
+        case e_midi_stage_transpose:
+            dropped |= stage_transpose(stage, batch);
+            break;
+        case e_midi_stage_velocity:
+            stage_velocity(stage, batch);
+            break;
+        case e_midi_stage_time_scale:
+            stage_time_scale(stage, batch);
+            break;
+        default:
+            assert(!"unknown stage type");
+        }
+    }
+    if (dropped) {
+        batch_compact(batch);
+    }
+}
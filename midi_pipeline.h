@@ -0,0 +1,139 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#pragma once
+#include "libmidi.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+enum {
+    MIDI_BATCH_SIZE  = 256,
+    MIDI_MAX_STAGES  = 16,
+    MIDI_ALL_CHANNELS = 0xffff,
+};
+
+// event type bits used by the filter stage
+enum midi_type_mask_t {
+    e_midi_mask_note_off        = 1 << 0,
+    e_midi_mask_note_on         = 1 << 1,
+    e_midi_mask_poly_aftertouch = 1 << 2,
+    e_midi_mask_ctrl_change     = 1 << 3,
+    e_midi_mask_prog_change     = 1 << 4,
+    e_midi_mask_chan_aftertouch = 1 << 5,
+    e_midi_mask_pitch_wheel     = 1 << 6,
+    e_midi_mask_sysex           = 1 << 7,
+    e_midi_mask_meta            = 1 << 8,
+    e_midi_mask_channel_mode    = 1 << 9,
+};
+
+enum midi_stage_type_t {
+    // drop events matching a type mask and channel mask
+    e_midi_stage_filter,
+
+    // move events from one channel to another
+    e_midi_stage_channel_map,
+
+    // shift the key of note and poly aftertouch events
+    // note: notes shifted outside of 0-127 are dropped
+    e_midi_stage_transpose,
+
+    // scale note on velocity, in 8.8 fixed point
+    e_midi_stage_velocity,
+
+    // scale absolute event times by num / den
+    e_midi_stage_time_scale,
+};
+
+struct midi_stage_t {
+    uint32_t type;
+    uint16_t channels; // channels the stage applies to, one bit each
+    union {
+        uint32_t types;
+        uint8_t  map[16];
+        int32_t  semitones;
+        uint32_t scale;
+        struct {
+            uint32_t num;
+            uint32_t den;
+        } time;
+    };
+};
+
+// a chain of transform stages
+// note: stages are applied in the order they were added
+struct midi_pipeline_t {
+    struct midi_stage_t stage[MIDI_MAX_STAGES];
+    size_t count;
+};
+
+// a block of events taken from a merged stream
+// note: channel event data bytes are copied into 'bytes' so that stages can
+//       rewrite them, 'time' holds absolute ticks and is authoritative over
+//       the per track midi_event_t::delta
+struct midi_batch_t {
+    struct midi_event_t event[MIDI_BATCH_SIZE];
+    uint64_t time[MIDI_BATCH_SIZE];
+    uint16_t track[MIDI_BATCH_SIZE];
+    uint8_t  bytes[MIDI_BATCH_SIZE][2];
+    size_t count;
+};
+
+// return the filter mask bit for an event type
+uint32_t midi_type_mask(
+    uint32_t type);
+
+// reset a pipeline to have no stages
+void midi_pipeline_init(
+    struct midi_pipeline_t* pipe);
+
+// append a stage dropping events of the given types on the given channels
+// note: sysex and meta events are matched regardless of channel
+bool midi_pipeline_filter(
+    struct midi_pipeline_t* pipe,
+    uint32_t types,
+    uint16_t channels);
+
+// append a stage moving each channel c to map[c]
+bool midi_pipeline_channel_map(
+    struct midi_pipeline_t* pipe,
+    const uint8_t map[16]);
+
+// append a stage transposing notes on the given channels
+bool midi_pipeline_transpose(
+    struct midi_pipeline_t* pipe,
+    int32_t semitones,
+    uint16_t channels);
+
+// append a stage scaling note on velocity by scale / 256
+bool midi_pipeline_velocity(
+    struct midi_pipeline_t* pipe,
+    uint32_t scale,
+    uint16_t channels);
+
+// append a stage scaling event times by num / den
+bool midi_pipeline_time_scale(
+    struct midi_pipeline_t* pipe,
+    uint32_t num,
+    uint32_t den);
+
+// fill a batch with the next events of a merged stream
+// note: returns the number of events read, 0 when the stream has ended
+size_t midi_batch_fill(
+    struct midi_batch_t* batch,
+    struct midi_mux_t* mux);
+
+// apply all pipeline stages to a batch in place
+// note: dropped events are removed, so batch->count may shrink
+void midi_pipeline_run(
+    const struct midi_pipeline_t* pipe,
+    struct midi_batch_t* batch);
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
@@ -0,0 +1,202 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "midi_profile.h"
+#include "midi_tempo.h"
+
+
+enum {
+    // initial event times held for the sliding window, a power of two
+    RING_CAPACITY = 256,
+
+    CTRL_ALL_SOUND_OFF = 120,
+    CTRL_ALL_NOTES_OFF = 123,
+};
+
+// event times within the window, oldest at 'tail'
+struct ring_t {
+    uint64_t* usec;
+    size_t mask;
+    size_t head;
+    size_t tail;
+};
+
+static bool ring_push(struct ring_t* r, uint64_t usec)
+{
+    if (r->head - r->tail > r->mask) {
+        // indices keep counting up so entries land in place in the larger ring
+        const size_t mask = r->mask * 2 + 1;
+        uint64_t* grown = malloc((mask + 1) * sizeof(uint64_t));
+        if (!grown) {
+            return false;
+        }
+        for (size_t i = r->tail; i != r->head; ++i) {
+            grown[i & mask] = r->usec[i & r->mask];
+        }
+        free(r->usec);
+        r->usec = grown;
+        r->mask = mask;
+    }
+    r->usec[r->head++ & r->mask] = usec;
+    return true;
+}
+
+uint32_t midi_profile_bin(uint64_t value)
+{
+    uint32_t bin = 0;
+    for (; value > 1 && bin < MIDI_PROFILE_LOG2_BINS - 1; value >>= 1) {
+        ++bin;
+    }
+    return bin;
+}
+
+static void block_end(struct midi_profile_t* p, uint32_t size)
+{
+    if (size == 0) {
+        return;
+    }
+    ++p->blocks;
+    ++p->block[midi_profile_bin(size)];
+    p->max_block = (size > p->max_block) ? size : p->max_block;
+}
+
+bool midi_profile(
+    struct midi_t* midi,
+    uint32_t window_usec,
+    struct midi_profile_t* p)
+{
+    assert(midi && p);
+    memset(p, 0, sizeof(struct midi_profile_t));
+    p->window_usec = window_usec ? window_usec : MIDI_PROFILE_WINDOW_USEC;
+
+    struct midi_tempo_map_t map;
+    if (!midi_tempo_map_build(midi, &map)) {
+        return false;
+    }
+    struct ring_t ring = { malloc(RING_CAPACITY * sizeof(uint64_t)), RING_CAPACITY - 1, 0, 0 };
+    struct midi_mux_t* mux = midi_mux(midi);
+    bool ok = ring.usec && mux;
+
+    // notes sounding per key, so a stray note off does not lower the count
+    uint16_t sounding[16][128];
+    uint32_t channel[16];
+    uint32_t voices = 0;
+    memset(sounding, 0, sizeof(sounding));
+    memset(channel, 0, sizeof(channel));
+
+    struct midi_event_t event;
+    uint64_t time = 0, block_tick = 0, usec = 0;
+    uint32_t block = 0;
+    size_t track = 0, entry = 0;
+    while (ok && midi_mux_next(mux, &event, &time, &track)) {
+        if (event.type == e_midi_event_meta) {
+            continue;
+        }
+        // times only increase, so walk the tempo map along with them
+        while (entry + 1 < map.count && map.entry[entry + 1].tick <= time) {
+            ++entry;
+        }
+        const struct midi_tempo_t* tempo = map.entry + entry;
+        usec = tempo->usec + (time - tempo->tick) * tempo->tempo / map.divisions;
+        ++p->events;
+
+        if (block == 0 || time != block_tick) {
+            block_end(p, block);
+            block_tick = time;
+            block = 0;
+        }
+        ++block;
+
+        while (ring.tail != ring.head && ring.usec[ring.tail & ring.mask] + p->window_usec <= usec) {
+            ++ring.tail;
+        }
+        if (!ring_push(&ring, usec)) {
+            ok = false;
+            break;
+        }
+        const size_t within = ring.head - ring.tail;
+        ++p->window[midi_profile_bin(within)];
+        p->max_window = (within > p->max_window) ? (uint32_t)within : p->max_window;
+
+        const uint32_t ch = event.channel & 0x0f;
+        switch (event.type) {
+        case e_midi_event_note_on:
+            if (event.data[1] != 0) {
+                const uint32_t key = event.data[0] & 0x7f;
+                ++sounding[ch][key];
+                ++channel[ch];
+                ++voices;
+                ++p->notes;
+                ++p->voices[(voices < MIDI_PROFILE_VOICES) ? voices : MIDI_PROFILE_VOICES - 1];
+                p->max_voices = (voices > p->max_voices) ? voices : p->max_voices;
+                if (channel[ch] > p->max_channel_voices[ch]) {
+                    p->max_channel_voices[ch] = channel[ch];
+                }
+                break;
+            }
+            // a note on with zero velocity is a note off
+            // fall through
+        case e_midi_event_note_off: {
+            // releases every note of the key, retriggered ones included
+            const uint32_t key = event.data[0] & 0x7f;
+            channel[ch] -= sounding[ch][key];
+            voices -= sounding[ch][key];
+            sounding[ch][key] = 0;
+            break;
+        }
+        case e_midi_event_channel_mode:
+            if (event.data[0] == CTRL_ALL_SOUND_OFF || event.data[0] == CTRL_ALL_NOTES_OFF) {
+                voices -= channel[ch];
+                channel[ch] = 0;
+                memset(sounding[ch], 0, sizeof(sounding[ch]));
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    block_end(p, block);
+    p->usec = usec;
+
+    if (mux) {
+        midi_mux_free(mux);
+    }
+    free(ring.usec);
+    midi_tempo_map_free(&map);
+    return ok;
+}
+
+void midi_profile_merge(
+    struct midi_profile_t* total,
+    const struct midi_profile_t* p)
+{
+    assert(total && p);
+    total->events += p->events;
+    total->notes  += p->notes;
+    total->blocks += p->blocks;
+    total->usec   += p->usec;
+    total->window_usec = p->window_usec;
+    total->max_voices = (p->max_voices > total->max_voices) ? p->max_voices : total->max_voices;
+    total->max_window = (p->max_window > total->max_window) ? p->max_window : total->max_window;
+    total->max_block  = (p->max_block  > total->max_block)  ? p->max_block  : total->max_block;
+    for (uint32_t i = 0; i < 16; ++i) {
+        if (p->max_channel_voices[i] > total->max_channel_voices[i]) {
+            total->max_channel_voices[i] = p->max_channel_voices[i];
+        }
+    }
+    for (uint32_t i = 0; i < MIDI_PROFILE_VOICES; ++i) {
+        total->voices[i] += p->voices[i];
+    }
+    for (uint32_t i = 0; i < MIDI_PROFILE_LOG2_BINS; ++i) {
+        total->block[i]  += p->block[i];
+        total->window[i] += p->window[i];
+    }
+}
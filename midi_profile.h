@@ -0,0 +1,72 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#pragma once
+#include "libmidi.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+enum {
+    // default sliding window for event density
+    MIDI_PROFILE_WINDOW_USEC = 1000,
+
+    // voices histogram, the last bin holds everything above it
+    MIDI_PROFILE_VOICES = 64,
+
+    // burst and density histograms, bin n holds counts in [2^n, 2^(n+1))
+    MIDI_PROFILE_LOG2_BINS = 16,
+};
+
+// how much a file asks of a synthesizer and its output queue
+// note: events are the channel and sysex events sent to a device, meta events
+//       are not counted. a block is the run of events sharing one tick, which
+//       a player sends together.
+struct midi_profile_t {
+    uint64_t events;
+    uint64_t notes;
+    uint64_t blocks;
+    uint64_t usec;                      // time of the last event
+
+    uint32_t max_voices;                // most notes sounding at once
+    uint32_t max_channel_voices[16];
+    uint32_t max_window;                // most events within one window
+    uint32_t max_block;                 // most events in one block
+    uint32_t window_usec;
+
+    uint64_t voices[MIDI_PROFILE_VOICES];       // note ons by notes sounding,
+                                                // itself included
+    uint64_t block[MIDI_PROFILE_LOG2_BINS];     // blocks by events
+    uint64_t window[MIDI_PROFILE_LOG2_BINS];    // events by events within the
+                                                // window ending at them
+};
+
+// profile the merged event stream of a midi file in one pass
+// note: a note sounds from its note on until a note off of its key, or an
+//       all notes off or all sound off on its channel. as in device_adlib.c,
+//       one note off releases a key struck several times. 'window_usec' of 0
+//       uses MIDI_PROFILE_WINDOW_USEC.
+bool midi_profile(
+    struct midi_t* midi,
+    uint32_t window_usec,
+    struct midi_profile_t* profile);
+
+// accumulate a file's profile into a summary, taking maxima and summing
+// counts, times and histograms
+// note: 'total' should be zero initialised before the first file
+void midi_profile_merge(
+    struct midi_profile_t* total,
+    const struct midi_profile_t* profile);
+
+// index of the log2 histogram bin holding 'value'
+uint32_t midi_profile_bin(
+    uint64_t value);
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
@@ -0,0 +1,192 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "midi_sysex.h"
+
+
+enum {
+    SYSEX_START = 0xf0,
+    SYSEX_END   = 0xf7,
+};
+
+struct midi_sysex_block_t {
+    struct midi_sysex_block_t* next;
+    size_t size;
+    size_t capacity;
+    uint8_t data[];
+};
+
+// find the message bytes of a sysex event
+// note: event data holds the VLQ length as well as the message bytes
+static size_t event_payload(const struct midi_event_t* event, const uint8_t** data)
+{
+    size_t i = 0;
+    while (i < event->length && (event->data[i++] & 0x80)) {
+    }
+    *data = event->data + i;
+    return (size_t)event->length - i;
+}
+
+static bool span_push(struct midi_sysex_t* s, const uint8_t* data, size_t size)
+{
+    if (size == 0) {
+        return true;
+    }
+    if (s->count == s->capacity) {
+        const size_t capacity = s->capacity ? s->capacity * 2 : 8;
+        struct midi_span_t* span = realloc(s->span, capacity * sizeof(struct midi_span_t));
+        if (!span) {
+            return false;
+        }
+        s->span = span;
+        s->capacity = capacity;
+    }
+    s->span[s->count].data = data;
+    s->span[s->count].size = size;
+    ++s->count;
+    s->size += size;
+    return true;
+}
+
+static void message_begin(struct midi_sysex_t* s, bool escape)
+{
+    if (s->pending) {
+        ++s->dropped;
+    }
+    s->count = 0;
+    s->size = 0;
+    s->escape = escape;
+    s->pending = false;
+}
+
+enum midi_sysex_result_t midi_sysex_push(
+    struct midi_sysex_t* s,
+    const struct midi_event_t* event)
+{
+    assert(s && event);
+    if (event->type != e_midi_event_sysex) {
+        return e_midi_sysex_none;
+    }
+    const uint8_t* data = NULL;
+    const size_t size = event_payload(event, &data);
+    const bool ends = size && data[size - 1] == SYSEX_END;
+    switch (event->channel) {
+    case SYSEX_START & 0x0f:
+        message_begin(s, false);
+        break;
+    case SYSEX_END & 0x0f:
+        if (!s->pending) {
+            // an escape, its bytes are sent as they are
+            message_begin(s, true);
+            if (!span_push(s, data, size)) {
+                ++s->dropped;
+                return e_midi_sysex_none;
+            }
+            return e_midi_sysex_escape;
+        }
+        // continues the pending message
+        break;
+    default:
+        return e_midi_sysex_none;
+    }
+    if (!span_push(s, data, size)) {
+        // drop the message rather than give part of it
+        s->pending = false;
+        ++s->dropped;
+        return e_midi_sysex_none;
+    }
+    s->pending = !ends;
+    return ends ? e_midi_sysex_message : e_midi_sysex_none;
+}
+
+void midi_sysex_free(struct midi_sysex_t* s)
+{
+    assert(s);
+    free(s->span);
+    memset(s, 0, sizeof(struct midi_sysex_t));
+}
+
+// ----------------------------------------------------------------------------
+// Flat copies
+// ----------------------------------------------------------------------------
+
+static struct midi_sysex_block_t* pool_block(struct midi_sysex_pool_t* pool, size_t need)
+{
+    struct midi_sysex_block_t* block = pool->head;
+    if (block && block->capacity - block->size >= need) {
+        return block;
+    }
+    // reuse a spare block that fits before allocating
+    struct midi_sysex_block_t** link = &pool->spare;
+    while (*link && (*link)->capacity < need) {
+        link = &(*link)->next;
+    }
+    block = *link;
+    if (block) {
+        *link = block->next;
+    } else {
+        const size_t capacity = (need > MIDI_SYSEX_POOL_BLOCK) ? need : MIDI_SYSEX_POOL_BLOCK;
+        block = malloc(sizeof(struct midi_sysex_block_t) + capacity);
+        if (!block) {
+            return NULL;
+        }
+        block->capacity = capacity;
+    }
+    block->size = 0;
+    block->next = pool->head;
+    pool->head = block;
+    return block;
+}
+
+const uint8_t* midi_sysex_copy(
+    const struct midi_sysex_t* s,
+    struct midi_sysex_pool_t* pool)
+{
+    assert(s && pool);
+    const size_t need = (size_t)s->size + (s->escape ? 0 : 1);
+    struct midi_sysex_block_t* block = pool_block(pool, need ? need : 1);
+    if (!block) {
+        return NULL;
+    }
+    uint8_t* const out = block->data + block->size;
+    uint8_t* p = out;
+    if (!s->escape) {
+        *(p++) = SYSEX_START;
+    }
+    for (size_t i = 0; i < s->count; ++i) {
+        memcpy(p, s->span[i].data, s->span[i].size);
+        p += s->span[i].size;
+    }
+    block->size += need;
+    return out;
+}
+
+void midi_sysex_pool_reset(struct midi_sysex_pool_t* pool)
+{
+    assert(pool);
+    while (pool->head) {
+        struct midi_sysex_block_t* block = pool->head;
+        pool->head = block->next;
+        block->next = pool->spare;
+        pool->spare = block;
+    }
+}
+
+void midi_sysex_pool_free(struct midi_sysex_pool_t* pool)
+{
+    assert(pool);
+    midi_sysex_pool_reset(pool);
+    while (pool->spare) {
+        struct midi_sysex_block_t* block = pool->spare;
+        pool->spare = block->next;
+        free(block);
+    }
+}
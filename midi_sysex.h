@@ -0,0 +1,91 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#pragma once
+#include "libmidi.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// system exclusive message assembly
+//
+// a midi file may split one sysex message over several events: an F0 event
+// holding the start, then F7 events continuing it, the last of them ending
+// in F7. an F7 event outside of such a message is an escape, carrying bytes
+// to be sent as they are.
+//
+// the events of one track are pushed in order and each complete message is
+// given as a list of spans pointing into the track data, nothing is copied.
+// span storage is kept between messages, so once it has grown to the largest
+// message, assembly no longer allocates. the F0 that starts a message is not
+// part of any span.
+enum {
+    MIDI_SYSEX_POOL_BLOCK = 64 * 1024,
+};
+
+struct midi_span_t {
+    const uint8_t* data;
+    size_t size;
+};
+
+enum midi_sysex_result_t {
+    e_midi_sysex_none = 0,  // the event did not complete a message
+    e_midi_sysex_message,   // a complete F0 ... F7 message
+    e_midi_sysex_escape,    // the bytes of an F7 escape event
+};
+
+struct midi_sysex_t {
+    struct midi_span_t* span;
+    size_t count;
+    size_t capacity;
+    uint64_t size;          // bytes across all spans
+
+    bool escape;            // the spans hold an escape rather than a message
+    bool pending;           // a message has been started but not ended
+    uint64_t dropped;       // messages cut short, or lost for want of memory
+};
+
+// a chunked arena for flat copies of messages
+// note: copies stay valid until the pool is reset or freed
+struct midi_sysex_block_t;
+
+struct midi_sysex_pool_t {
+    struct midi_sysex_block_t* head;    // block being filled
+    struct midi_sysex_block_t* spare;   // blocks kept by a reset
+};
+
+// push the next event of a track
+// note: 'sysex' should be zero initialised before first use. spans refer to
+//       the track data of the midi file, and to the last message only.
+enum midi_sysex_result_t midi_sysex_push(
+    struct midi_sysex_t* sysex,
+    const struct midi_event_t* event);
+
+// release span storage
+void midi_sysex_free(
+    struct midi_sysex_t* sysex);
+
+// copy the last message into one run of bytes, starting with F0 unless it
+// was an escape
+// note: 'pool' should be zero initialised before first use. returns NULL if
+//       out of memory.
+const uint8_t* midi_sysex_copy(
+    const struct midi_sysex_t* sysex,
+    struct midi_sysex_pool_t* pool);
+
+// drop every copy, keeping the pool's blocks for reuse
+void midi_sysex_pool_reset(
+    struct midi_sysex_pool_t* pool);
+
+// release a pool
+void midi_sysex_pool_free(
+    struct midi_sysex_pool_t* pool);
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
@@ -0,0 +1,140 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "midi_tempo.h"
+
+
+enum {
+    // 120 bpm, the midi default until a tempo event is seen
+    DEFAULT_TEMPO = 500000,
+};
+
+static void map_push(struct midi_tempo_map_t* map, size_t* capacity,
+    uint64_t tick, uint32_t tempo)
+{
+    struct midi_tempo_t* last = map->entry + map->count - 1;
+    if (last->tick == tick) {
+        // a later event at the same tick replaces the earlier one
+        last->tempo = tempo;
+        return;
+    }
+    if (last->tempo == tempo) {
+        // no change in tempo
+        return;
+    }
+    if (map->count == *capacity) {
+        *capacity *= 2;
+        map->entry = realloc(map->entry, *capacity * sizeof(struct midi_tempo_t));
+        assert(map->entry);
+        last = map->entry + map->count - 1;
+    }
+    struct midi_tempo_t* next = map->entry + map->count++;
+    next->tick  = tick;
+    next->usec  = last->usec +
+        (tick - last->tick) * last->tempo / map->divisions;
+    next->tempo = tempo;
+}
+
+bool midi_tempo_map_build(struct midi_t* midi, struct midi_tempo_map_t* map)
+{
+    assert(midi && map);
+    memset(map, 0, sizeof(struct midi_tempo_map_t));
+
+    size_t capacity = 16;
+    map->entry = malloc(capacity * sizeof(struct midi_tempo_t));
+    assert(map->entry);
+    map->count = 1;
+    map->entry[0].tick  = 0;
+    map->entry[0].usec  = 0;
+    map->entry[0].tempo = DEFAULT_TEMPO;
+
+    if (midi->divisions & 0x8000) {
+        // SMPTE timing, upper byte is negative frames per second and lower
+        // byte is ticks per frame
+        // note: 29 is drop frame 30fps, which runs at 29.97 frames per second
+        const int fps = -(int8_t)(midi->divisions >> 8);
+        const uint32_t res = midi->divisions & 0xff;
+        map->smpte = true;
+        map->divisions = (fps == 29) ? 2997 * res : fps * res * 100;
+        map->entry[0].tempo = 100000000;
+        if (map->divisions == 0) {
+            map->divisions = 1;
+        }
+        // tempo events have no effect on SMPTE timing
+        return true;
+    }
+    map->divisions = midi->divisions ? midi->divisions : 1;
+
+    struct midi_mux_t* mux = midi_mux(midi);
+    if (!mux) {
+        midi_tempo_map_free(map);
+        return false;
+    }
+    struct midi_event_t event;
+    uint64_t time = 0;
+    size_t track = 0;
+    while (midi_mux_next(mux, &event, &time, &track)) {
+        if (event.type != e_midi_event_meta || event.meta != e_midi_meta_tempo) {
+            continue;
+        }
+        if (event.length != 3) {
+            continue;
+        }
+        const uint32_t tempo =
+            (event.data[0] << 16) | (event.data[1] << 8) | event.data[2];
+        if (tempo) {
+            map_push(map, &capacity, time, tempo);
+        }
+    }
+    midi_mux_free(mux);
+    return true;
+}
+
+void midi_tempo_map_free(struct midi_tempo_map_t* map)
+{
+    assert(map);
+    free(map->entry);
+    memset(map, 0, sizeof(struct midi_tempo_map_t));
+}
+
+uint64_t midi_tempo_usec(const struct midi_tempo_map_t* map, uint64_t tick)
+{
+    assert(map && map->count);
+    // find the last entry at or before tick
+    size_t lo = 0, hi = map->count;
+    while (hi - lo > 1) {
+        const size_t mid = (lo + hi) / 2;
+        if (map->entry[mid].tick <= tick) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    const struct midi_tempo_t* e = map->entry + lo;
+    return e->usec + (tick - e->tick) * e->tempo / map->divisions;
+}
+
+uint64_t midi_tempo_tick(const struct midi_tempo_map_t* map, uint64_t usec)
+{
+    assert(map && map->count);
+    // find the last entry at or before usec
+    size_t lo = 0, hi = map->count;
+    while (hi - lo > 1) {
+        const size_t mid = (lo + hi) / 2;
+        if (map->entry[mid].usec <= usec) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    const struct midi_tempo_t* e = map->entry + lo;
+    return e->tick + (usec - e->usec) * map->divisions / e->tempo;
+}
@@ -0,0 +1,56 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#pragma once
+#include "libmidi.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// a point at which the tempo changes
+struct midi_tempo_t {
+    uint64_t tick;  // absolute time in ticks
+    uint64_t usec;  // absolute time in microseconds
+    uint32_t tempo; // microseconds per quarter note from this point on
+};
+
+// maps between ticks and wall clock time for one midi file
+struct midi_tempo_map_t {
+    struct midi_tempo_t* entry;
+    size_t count;
+
+    // microseconds per tick is tempo / divisions
+    // note: for SMPTE files divisions holds ticks per 100 seconds and the
+    //       single tempo entry is fixed at 100 seconds
+    uint32_t divisions;
+    bool smpte;
+};
+
+// collect all tempo changes of a midi file
+// note: there is always at least one entry, at tick 0
+bool midi_tempo_map_build(
+    struct midi_t* midi,
+    struct midi_tempo_map_t* map);
+
+// release a tempo map
+void midi_tempo_map_free(
+    struct midi_tempo_map_t* map);
+
+// convert an absolute tick time to microseconds
+uint64_t midi_tempo_usec(
+    const struct midi_tempo_map_t* map,
+    uint64_t tick);
+
+// convert microseconds to the absolute tick sounding at that time
+uint64_t midi_tempo_tick(
+    const struct midi_tempo_map_t* map,
+    uint64_t usec);
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
@@ -0,0 +1,150 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "midi_thread.h"
+
+
+enum {
+    MAX_THREADS = 64,
+};
+
+struct midi_thread_t {
+#if defined(_WIN32)
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+    midi_thread_func_t func;
+    void* user;
+};
+
+#if defined(_WIN32)
+static DWORD WINAPI thread_entry(LPVOID arg)
+{
+    struct midi_thread_t* thread = arg;
+    thread->func(thread->user);
+    return 0;
+}
+#else
+static void* thread_entry(void* arg)
+{
+    struct midi_thread_t* thread = arg;
+    thread->func(thread->user);
+    return NULL;
+}
+#endif
+
+struct midi_thread_t* midi_thread_start(midi_thread_func_t func, void* user)
+{
+    assert(func);
+    struct midi_thread_t* thread = malloc(sizeof(struct midi_thread_t));
+    assert(thread);
+    thread->func = func;
+    thread->user = user;
+#if defined(_WIN32)
+    thread->handle = CreateThread(NULL, 0, thread_entry, thread, 0, NULL);
+    if (thread->handle == NULL) {
+        free(thread);
+        return NULL;
+    }
+#else
+    if (pthread_create(&thread->handle, NULL, thread_entry, thread) != 0) {
+        free(thread);
+        return NULL;
+    }
+#endif
+    return thread;
+}
+
+void midi_thread_join(struct midi_thread_t* thread)
+{
+    assert(thread);
+#if defined(_WIN32)
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->handle, NULL);
+#endif
+    free(thread);
+}
+
+size_t midi_thread_count(void)
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors ? info.dwNumberOfProcessors : 1;
+#else
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? (size_t)count : 1;
+#endif
+}
+
+size_t midi_atomic_add(volatile size_t* value, size_t amount)
+{
+#if defined(_MSC_VER) && defined(_WIN64)
+    return (size_t)InterlockedExchangeAdd64((volatile LONG64*)value, amount);
+#elif defined(_MSC_VER)
+    return (size_t)InterlockedExchangeAdd((volatile LONG*)value, amount);
+#else
+    return __atomic_fetch_add(value, amount, __ATOMIC_ACQ_REL);
+#endif
+}
+
+struct parallel_t {
+    volatile size_t next;
+    size_t count;
+    midi_job_t job;
+    void* user;
+};
+
+static void parallel_worker(void* arg)
+{
+    struct parallel_t* p = arg;
+    for (;;) {
+        const size_t index = midi_atomic_add(&p->next, 1);
+        if (index >= p->count) {
+            break;
+        }
+        p->job(p->user, index);
+    }
+}
+
+void midi_parallel_for(size_t count, size_t threads, midi_job_t job, void* user)
+{
+    assert(job);
+    if (threads == 0) {
+        threads = midi_thread_count();
+    }
+    threads = (threads > count) ? count : threads;
+    threads = (threads > MAX_THREADS) ? MAX_THREADS : threads;
+
+    struct parallel_t p = { 0, count, job, user };
+    struct midi_thread_t* thread[MAX_THREADS];
+    size_t started = 0;
+    // the calling thread is one of the workers
+    for (size_t i = 1; i < threads; ++i) {
+        if ((thread[started] = midi_thread_start(parallel_worker, &p)) != NULL) {
+            ++started;
+        }
+    }
+    parallel_worker(&p);
+    for (size_t i = 0; i < started; ++i) {
+        midi_thread_join(thread[i]);
+    }
+}
@@ -0,0 +1,50 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+struct midi_thread_t;
+
+typedef void (*midi_thread_func_t)(void* user);
+typedef void (*midi_job_t)(void* user, size_t index);
+
+// start a new thread running func(user)
+struct midi_thread_t* midi_thread_start(
+    midi_thread_func_t func,
+    void* user);
+
+// wait for a thread to finish and release it
+void midi_thread_join(
+    struct midi_thread_t* thread);
+
+// return the number of hardware threads available
+size_t midi_thread_count(void);
+
+// atomically add to a counter returning its previous value
+size_t midi_atomic_add(
+    volatile size_t* value,
+    size_t amount);
+
+// run job(user, i) for every i in [0, count) across a number of threads
+// note: when threads is 0 the hardware thread count is used, the calling
+//       thread also takes part, and indices are handed out dynamically so
+//       uneven job sizes balance out
+void midi_parallel_for(
+    size_t count,
+    size_t threads,
+    midi_job_t job,
+    void* user);
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
@@ -0,0 +1,298 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "midi_thread.h"
+#include "midi_timeline.h"
+
+
+enum {
+    // samples taken from each track when choosing partition boundaries
+    SAMPLES_PER_TRACK = 64,
+
+    // partitions per thread, so that uneven partitions balance out
+    PARTITIONS_PER_THREAD = 4,
+};
+
+// events of one decoded track
+struct track_t {
+    struct midi_timed_event_t* event;
+    size_t count;
+};
+
+// a slice of every track covering one time range of the output
+struct partition_t {
+    size_t* begin; // per track
+    size_t* end;   // per track
+    size_t out;    // first output index
+};
+
+struct build_t {
+    struct midi_t* midi;
+    struct track_t* track;
+    struct partition_t* part;
+    struct midi_timed_event_t* out;
+    bool failed;
+};
+
+// ----------------------------------------------------------------------------
+// Decoding
+// ----------------------------------------------------------------------------
+
+static void decode_track(void* user, size_t index)
+{
+    struct build_t* b = user;
+    struct track_t* t = b->track + index;
+    const struct midi_track_t* src = b->midi->tracks + index;
+    struct midi_stream_t* stream = midi_stream(b->midi, (uint32_t)index);
+    if (!stream) {
+        b->failed = true;
+        return;
+    }
+    // about three bytes per event with running status
+    size_t capacity = src->length / 3 + 16;
+    t->event = malloc(capacity * sizeof(struct midi_timed_event_t));
+    assert(t->event);
+    t->count = 0;
+    uint64_t time = 0;
+    struct midi_event_t event;
+    while (!midi_stream_end(stream) && midi_event_next(stream, &event)) {
+        if (t->count == capacity) {
+            capacity *= 2;
+            t->event = realloc(t->event, capacity * sizeof(struct midi_timed_event_t));
+            assert(t->event);
+        }
+        time += event.delta;
+        struct midi_timed_event_t* out = t->event + t->count++;
+        out->event = event;
+        out->time = time;
+        out->track = (uint32_t)index;
+    }
+    midi_stream_free(stream);
+}
+
+// ----------------------------------------------------------------------------
+// Merging
+// ----------------------------------------------------------------------------
+
+// min heap of track cursors ordered by (time, track)
+struct cursor_t {
+    uint64_t time;
+    uint32_t track;
+};
+
+static bool cursor_less(const struct cursor_t* a, const struct cursor_t* b)
+{
+    return (a->time < b->time) || (a->time == b->time && a->track < b->track);
+}
+
+static void heap_down(struct cursor_t* heap, size_t count, size_t i)
+{
+    for (;;) {
+        const size_t l = i * 2 + 1, r = l + 1;
+        size_t m = i;
+        if (l < count && cursor_less(heap + l, heap + m)) {
+            m = l;
+        }
+        if (r < count && cursor_less(heap + r, heap + m)) {
+            m = r;
+        }
+        if (m == i) {
+            return;
+        }
+        const struct cursor_t t = heap[i];
+        heap[i] = heap[m];
+        heap[m] = t;
+        i = m;
+    }
+}
+
+static void merge_partition(void* user, size_t index)
+{
+    struct build_t* b = user;
+    const struct partition_t* p = b->part + index;
+    const size_t num_tracks = b->midi->num_tracks;
+    size_t* pos = malloc(num_tracks * sizeof(size_t));
+    struct cursor_t* heap = malloc(num_tracks * sizeof(struct cursor_t));
+    assert(pos && heap);
+
+    size_t count = 0;
+    for (size_t i = 0; i < num_tracks; ++i) {
+        pos[i] = p->begin[i];
+        if (pos[i] < p->end[i]) {
+            heap[count].time = b->track[i].event[pos[i]].time;
+            heap[count].track = (uint32_t)i;
+            ++count;
+        }
+    }
+    for (size_t i = count / 2; i-- > 0;) {
+        heap_down(heap, count, i);
+    }
+    struct midi_timed_event_t* out = b->out + p->out;
+    while (count) {
+        const uint32_t t = heap->track;
+        *(out++) = b->track[t].event[pos[t]++];
+        if (pos[t] < p->end[t]) {
+            heap->time = b->track[t].event[pos[t]].time;
+        } else {
+            *heap = heap[--count];
+        }
+        heap_down(heap, count, 0);
+    }
+    free(heap);
+    free(pos);
+}
+
+static int compare_u64(const void* a, const void* b)
+{
+    const uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// first event in a track at or after time
+static size_t lower_bound(const struct track_t* t, uint64_t time)
+{
+    size_t lo = 0, hi = t->count;
+    while (lo < hi) {
+        const size_t mid = (lo + hi) / 2;
+        if (t->event[mid].time < time) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// split the output into time ranges that can be merged independently
+// note: all events sharing a time land in the same partition, so ties are
+//       resolved inside a single merge
+static size_t make_partitions(struct build_t* b, size_t wanted)
+{
+    const size_t num_tracks = b->midi->num_tracks;
+    uint64_t* sample = malloc(num_tracks * SAMPLES_PER_TRACK * sizeof(uint64_t));
+    assert(sample);
+    size_t samples = 0;
+    for (size_t i = 0; i < num_tracks; ++i) {
+        const struct track_t* t = b->track + i;
+        for (size_t j = 0; j < SAMPLES_PER_TRACK && t->count; ++j) {
+            // weight tracks by their size by sampling evenly in each
+            sample[samples++] = t->event[(t->count * j) / SAMPLES_PER_TRACK].time;
+        }
+    }
+    qsort(sample, samples, sizeof(uint64_t), compare_u64);
+
+    // boundaries, partition i covers [bound[i], bound[i + 1])
+    uint64_t* bound = malloc((wanted + 1) * sizeof(uint64_t));
+    assert(bound);
+    size_t parts = 0;
+    bound[parts++] = 0;
+    for (size_t i = 1; i < wanted && samples; ++i) {
+        const uint64_t time = sample[(samples * i) / wanted];
+        if (time > bound[parts - 1]) {
+            bound[parts++] = time;
+        }
+    }
+    free(sample);
+
+    b->part = malloc(parts * sizeof(struct partition_t));
+    assert(b->part);
+    size_t out = 0;
+    for (size_t p = 0; p < parts; ++p) {
+        struct partition_t* part = b->part + p;
+        part->begin = malloc(num_tracks * sizeof(size_t) * 2);
+        assert(part->begin);
+        part->end = part->begin + num_tracks;
+        part->out = out;
+        for (size_t i = 0; i < num_tracks; ++i) {
+            const struct track_t* t = b->track + i;
+            part->begin[i] = (p == 0) ? 0 : lower_bound(t, bound[p]);
+            part->end[i] = (p + 1 == parts) ? t->count : lower_bound(t, bound[p + 1]);
+            out += part->end[i] - part->begin[i];
+        }
+    }
+    free(bound);
+    return parts;
+}
+
+bool midi_timeline_build(
+    struct midi_t          *midi,
+    struct midi_timeline_t *timeline,
+    size_t                  threads)
+{
+    assert(midi && timeline);
+    memset(timeline, 0, sizeof(struct midi_timeline_t));
+    const size_t num_tracks = midi->num_tracks;
+
+    size_t bytes = 0;
+    for (size_t i = 0; i < num_tracks; ++i) {
+        bytes += midi->tracks[i].length;
+    }
+    if (threads == 0) {
+        threads = midi_thread_count();
+    }
+    if (bytes < MIDI_TIMELINE_SERIAL_BYTES || num_tracks < 2) {
+        threads = 1;
+    }
+
+    struct build_t b;
+    memset(&b, 0, sizeof(b));
+    b.midi = midi;
+    b.track = calloc(num_tracks, sizeof(struct track_t));
+    assert(b.track);
+
+    if (threads > 1) {
+        midi_parallel_for(num_tracks, threads, decode_track, &b);
+    } else {
+        for (size_t i = 0; i < num_tracks; ++i) {
+            decode_track(&b, i);
+        }
+    }
+
+    size_t total = 0;
+    for (size_t i = 0; i < num_tracks; ++i) {
+        total += b.track[i].count;
+    }
+    b.out = malloc((total ? total : 1) * sizeof(struct midi_timed_event_t));
+    assert(b.out);
+
+    const size_t parts = make_partitions(&b, (threads > 1) ? threads * PARTITIONS_PER_THREAD : 1);
+    if (threads > 1 && parts > 1) {
+        midi_parallel_for(parts, threads, merge_partition, &b);
+    } else {
+        for (size_t p = 0; p < parts; ++p) {
+            merge_partition(&b, p);
+        }
+    }
+
+    for (size_t p = 0; p < parts; ++p) {
+        free(b.part[p].begin);
+    }
+    free(b.part);
+    for (size_t i = 0; i < num_tracks; ++i) {
+        free(b.track[i].event);
+    }
+    free(b.track);
+
+    if (b.failed) {
+        free(b.out);
+        return false;
+    }
+    timeline->event = b.out;
+    timeline->count = total;
+    return true;
+}
+
+void midi_timeline_free(struct midi_timeline_t* timeline)
+{
+    assert(timeline);
+    free(timeline->event);
+    memset(timeline, 0, sizeof(struct midi_timeline_t));
+}
@@ -0,0 +1,48 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#pragma once
+#include "libmidi.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+enum {
+    // files with less track data than this are decoded on the calling thread
+    MIDI_TIMELINE_SERIAL_BYTES = 64 * 1024,
+};
+
+struct midi_timed_event_t {
+    struct midi_event_t event; // delta is relative to the previous event in its track
+    uint64_t time;             // absolute time in ticks
+    uint32_t track;
+};
+
+// all events of a midi file in merged time order
+struct midi_timeline_t {
+    struct midi_timed_event_t* event;
+    size_t count;
+};
+
+// decode every track in parallel and merge them by absolute time
+// note: the order matches midi_stream_mux(), ties going to the lower track
+//       index. when threads is 0 the hardware thread count is used, small
+//       files always take the serial path. unlike midi_stream_mux(), a track
+//       that fails to parse only ends that track.
+bool midi_timeline_build(
+    struct midi_t* midi,
+    struct midi_timeline_t* timeline,
+    size_t threads);
+
+// release a timeline
+void midi_timeline_free(
+    struct midi_timeline_t* timeline);
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
@@ -0,0 +1,573 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "midi_sysex.h"
+#include "midi_tempo.h"
+#include "midi_ump.h"
+
+
+enum {
+    // utility packet status
+    UTILITY_JR_TIMESTAMP = 0x2,
+    UTILITY_DCTPQ        = 0x3,
+    UTILITY_DELTA_CLOCK  = 0x4,
+
+    DELTA_CLOCK_MAX      = 0xfffff,
+    JR_TIMESTAMP_USEC    = 32,
+
+    // flex data, in status bank 0
+    FLEX_GROUP           = 0x1,    // address the whole group
+    FLEX_TEMPO           = 0x00,
+    FLEX_TIME_SIGNATURE  = 0x01,
+
+    // sysex7 packet status
+    SYSEX7_COMPLETE      = 0x0,
+    SYSEX7_START         = 0x1,
+    SYSEX7_CONTINUE      = 0x2,
+    SYSEX7_END           = 0x3,
+    SYSEX7_BYTES         = 6,
+
+    // room kept ahead of read back sysex bytes for their VLQ length
+    SYSEX_VLQ_ROOM       = 10,
+};
+
+// words per packet, indexed by message type
+static const uint8_t packet_words[16] = {
+    1, 1, 1, 2, 2, 4, 1, 1, 2, 2, 2, 3, 3, 4, 4, 4
+};
+
+// data bytes following each system status byte from 0xf0
+static const int8_t system_bytes[16] = {
+    -1, 1, 2, 1, -1, -1, 0, -1, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+static bool reserve(struct midi_ump_t* u, size_t extra)
+{
+    const size_t need = u->count + extra;
+    if (need <= u->capacity) {
+        return true;
+    }
+    size_t capacity = u->capacity ? u->capacity : 1024;
+    while (capacity < need) {
+        capacity *= 2;
+    }
+    uint32_t* word = realloc(u->word, capacity * sizeof(uint32_t));
+    if (!word) {
+        return false;
+    }
+    u->word = word;
+    u->capacity = capacity;
+    return true;
+}
+
+static uint32_t utility(uint32_t status, uint32_t value)
+{
+    return ((uint32_t)e_midi_ump_utility << 28) | (status << 20) | value;
+}
+
+static uint32_t header(uint32_t type, uint8_t group)
+{
+    return (type << 28) | ((uint32_t)(group & 0xf) << 24);
+}
+
+void midi_ump_pack_voice(
+    const uint8_t* status,
+    const uint8_t* data1,
+    const uint8_t* data2,
+    uint8_t group,
+    uint32_t* out,
+    size_t count)
+{
+    const uint32_t head = header(e_midi_ump_voice1, group);
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = head | ((uint32_t)status[i] << 16) | ((uint32_t)data1[i] << 8) | data2[i];
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Encoding
+// ----------------------------------------------------------------------------
+
+// channel events waiting to be packed
+struct batch_t {
+    uint8_t status[MIDI_UMP_BATCH];
+    uint8_t data1[MIDI_UMP_BATCH];
+    uint8_t data2[MIDI_UMP_BATCH];
+    size_t count;
+};
+
+static bool batch_flush(struct batch_t* b, uint8_t group, struct midi_ump_t* u)
+{
+    if (b->count == 0) {
+        return true;
+    }
+    if (!reserve(u, b->count)) {
+        return false;
+    }
+    midi_ump_pack_voice(b->status, b->data1, b->data2, group, u->word + u->count, b->count);
+    u->count += b->count;
+    b->count = 0;
+    return true;
+}
+
+static bool emit_time(
+    struct midi_ump_t* u,
+    uint32_t flags,
+    uint64_t delta,
+    uint64_t usec)
+{
+    if (flags & MIDI_UMP_CLOCKSTAMPS) {
+        for (; delta; ) {
+            const uint64_t step = (delta > DELTA_CLOCK_MAX) ? DELTA_CLOCK_MAX : delta;
+            if (!reserve(u, 1)) {
+                return false;
+            }
+            u->word[u->count++] = utility(UTILITY_DELTA_CLOCK, (uint32_t)step);
+            delta -= step;
+        }
+    }
+    if (flags & MIDI_UMP_JR_TIMESTAMPS) {
+        if (!reserve(u, 1)) {
+            return false;
+        }
+        const uint32_t stamp = (uint32_t)(usec / JR_TIMESTAMP_USEC) & 0xffff;
+        u->word[u->count++] = utility(UTILITY_JR_TIMESTAMP, stamp);
+    }
+    return true;
+}
+
+// split a complete message into sysex7 packets, leaving out the F0 and F7
+static bool emit_sysex(struct midi_ump_t* u, uint8_t group, const struct midi_sysex_t* s)
+{
+    size_t total = (size_t)s->size;
+    if (total && s->count) {
+        const struct midi_span_t* last = &s->span[s->count - 1];
+        total -= (last->data[last->size - 1] == 0xf7) ? 1 : 0;
+    }
+    const size_t packets = total ? (total + SYSEX7_BYTES - 1) / SYSEX7_BYTES : 1;
+    if (!reserve(u, packets * 2)) {
+        return false;
+    }
+    size_t span = 0, offset = 0;
+    for (size_t p = 0; p < packets; ++p) {
+        const size_t bytes = (total - p * SYSEX7_BYTES < SYSEX7_BYTES) ?
+            total - p * SYSEX7_BYTES : SYSEX7_BYTES;
+        uint8_t data[SYSEX7_BYTES] = { 0 };
+        for (size_t i = 0; i < bytes; ++i) {
+            while (offset == s->span[span].size) {
+                ++span;
+                offset = 0;
+            }
+            data[i] = s->span[span].data[offset++] & 0x7f;
+        }
+        const uint32_t status = (packets == 1) ? SYSEX7_COMPLETE :
+                                (p == 0) ? SYSEX7_START :
+                                (p + 1 == packets) ? SYSEX7_END : SYSEX7_CONTINUE;
+        u->word[u->count++] = header(e_midi_ump_sysex7, group) | (status << 20) |
+            ((uint32_t)bytes << 16) | ((uint32_t)data[0] << 8) | data[1];
+        u->word[u->count++] = ((uint32_t)data[2] << 24) | ((uint32_t)data[3] << 16) |
+            ((uint32_t)data[4] << 8) | data[5];
+    }
+    return true;
+}
+
+// system common and real time messages carried by an escape
+// note: returns the number of bytes that had no packet form
+static size_t emit_escape(
+    struct midi_ump_t* u,
+    uint8_t group,
+    const struct midi_sysex_t* s,
+    bool* ok)
+{
+    uint8_t bytes[3];
+    size_t have = 0, need = 0, left_out = 0;
+    for (size_t i = 0; i < s->count; ++i) {
+        for (size_t j = 0; j < s->span[i].size; ++j) {
+            const uint8_t c = s->span[i].data[j];
+            if (have == 0) {
+                if (c < 0xf0 || system_bytes[c & 0xf] < 0) {
+                    ++left_out;
+                    continue;
+                }
+                need = 1 + (size_t)system_bytes[c & 0xf];
+            }
+            bytes[have] = have ? c & 0x7f : c;
+            ++have;
+            if (have == need) {
+                if (!reserve(u, 1)) {
+                    *ok = false;
+                    return left_out;
+                }
+                u->word[u->count++] = header(e_midi_ump_system, group) |
+                    ((uint32_t)bytes[0] << 16) |
+                    ((need > 1) ? (uint32_t)bytes[1] << 8 : 0) |
+                    ((need > 2) ? (uint32_t)bytes[2] : 0);
+                have = 0;
+            }
+        }
+    }
+    return left_out + have;
+}
+
+static bool emit_meta(
+    struct midi_ump_t* u,
+    uint8_t group,
+    const struct midi_event_t* event)
+{
+    uint32_t status = 0, value = 0;
+    if (event->meta == e_midi_meta_tempo && event->length >= 3) {
+        // in 10 nanosecond units per quarter note
+        const uint32_t tempo = ((uint32_t)event->data[0] << 16) |
+                               ((uint32_t)event->data[1] << 8) | event->data[2];
+        status = FLEX_TEMPO;
+        value = tempo * 100;
+    } else if (event->meta == e_midi_meta_time_signature && event->length >= 4) {
+        status = FLEX_TIME_SIGNATURE;
+        value = ((uint32_t)event->data[0] << 24) | ((uint32_t)event->data[1] << 16) |
+                ((uint32_t)event->data[3] << 8);
+    }
+    if (!reserve(u, 4)) {
+        return false;
+    }
+    u->word[u->count++] = header(e_midi_ump_flex, group) | (FLEX_GROUP << 20) | status;
+    u->word[u->count++] = value;
+    u->word[u->count++] = 0;
+    u->word[u->count++] = 0;
+    return true;
+}
+
+static bool is_flex_meta(const struct midi_event_t* event)
+{
+    return (event->meta == e_midi_meta_tempo && event->length >= 3) ||
+           (event->meta == e_midi_meta_time_signature && event->length >= 4);
+}
+
+bool midi_ump_encode(
+    struct midi_t* midi,
+    uint32_t flags,
+    uint8_t group,
+    struct midi_ump_t* u)
+{
+    assert(midi && u);
+    u->count = 0;
+    u->skipped = 0;
+    struct midi_tempo_map_t tempo;
+    if (!midi_tempo_map_build(midi, &tempo)) {
+        return false;
+    }
+    // split messages continue within their own track
+    struct midi_sysex_t* sysex = calloc(midi->num_tracks, sizeof(struct midi_sysex_t));
+    struct batch_t* batch = malloc(sizeof(struct batch_t));
+    struct midi_mux_t* mux = midi_mux(midi);
+    bool ok = sysex && batch && mux;
+    if (ok && (flags & MIDI_UMP_CLOCKSTAMPS)) {
+        ok = reserve(u, 1);
+        if (ok) {
+            u->word[u->count++] = utility(UTILITY_DCTPQ, midi->divisions);
+        }
+    }
+    if (batch) {
+        batch->count = 0;
+    }
+
+    struct midi_event_t event;
+    uint64_t time = 0, prev = 0, end = 0;
+    size_t track = 0;
+    bool first = true;
+    while (ok && midi_mux_next(mux, &event, &time, &track)) {
+        enum midi_sysex_result_t message = e_midi_sysex_none;
+        const bool channel = event.type < e_midi_event_sysex ||
+                             event.type == e_midi_event_channel_mode;
+        if (event.type == e_midi_event_sysex) {
+            message = midi_sysex_push(&sysex[track], &event);
+            if (message == e_midi_sysex_none) {
+                continue;
+            }
+        } else if (event.type == e_midi_event_meta && !is_flex_meta(&event)) {
+            if (event.meta == e_midi_meta_end_of_track) {
+                end = (time > end) ? time : end;
+            } else {
+                ++u->skipped;
+            }
+            continue;
+        }
+        // stamp the first message at each new time
+        if (first || time != prev) {
+            ok = batch_flush(batch, group, u) &&
+                 emit_time(u, flags, time - prev, midi_tempo_usec(&tempo, time));
+            prev = time;
+            first = false;
+        }
+        if (!ok) {
+            break;
+        }
+        if (channel) {
+            const uint32_t type = (event.type == e_midi_event_channel_mode) ?
+                e_midi_event_ctrl_change : event.type;
+            const size_t i = batch->count++;
+            batch->status[i] = (uint8_t)((type & 0xf0) | (event.channel & 0xf));
+            batch->data1[i] = event.data[0] & 0x7f;
+            batch->data2[i] = (event.length > 1) ? event.data[1] & 0x7f : 0;
+            if (batch->count == MIDI_UMP_BATCH) {
+                ok = batch_flush(batch, group, u);
+            }
+            continue;
+        }
+        ok = batch_flush(batch, group, u);
+        if (ok && message == e_midi_sysex_message) {
+            ok = emit_sysex(u, group, &sysex[track]);
+        } else if (ok && message == e_midi_sysex_escape) {
+            u->skipped += emit_escape(u, group, &sysex[track], &ok) ? 1 : 0;
+        } else if (ok) {
+            ok = emit_meta(u, group, &event);
+        }
+    }
+    ok = ok && batch_flush(batch, group, u);
+    // carry the length of the song
+    if (ok && end > prev && (flags & MIDI_UMP_CLOCKSTAMPS)) {
+        ok = emit_time(u, flags & MIDI_UMP_CLOCKSTAMPS, end - prev, 0);
+    }
+
+    if (mux) {
+        midi_mux_free(mux);
+    }
+    for (size_t i = 0; sysex && i < midi->num_tracks; ++i) {
+        midi_sysex_free(&sysex[i]);
+    }
+    free(sysex);
+    free(batch);
+    midi_tempo_map_free(&tempo);
+    return ok;
+}
+
+void midi_ump_free(struct midi_ump_t* u)
+{
+    assert(u);
+    free(u->word);
+    memset(u, 0, sizeof(struct midi_ump_t));
+}
+
+// ----------------------------------------------------------------------------
+// Decoding
+// ----------------------------------------------------------------------------
+
+void midi_ump_reader_init(
+    struct midi_ump_reader_t* r,
+    const uint32_t* word,
+    size_t count)
+{
+    assert(r);
+    memset(r, 0, sizeof(struct midi_ump_reader_t));
+    r->word = word;
+    r->count = count;
+}
+
+void midi_ump_reader_free(struct midi_ump_reader_t* r)
+{
+    assert(r);
+    free(r->sysex);
+    r->sysex = NULL;
+    r->sysex_size = r->sysex_capacity = 0;
+}
+
+static bool sysex_append(struct midi_ump_reader_t* r, const uint8_t* data, size_t size)
+{
+    if (r->sysex_size == 0) {
+        r->sysex_size = SYSEX_VLQ_ROOM;
+    }
+    const size_t need = r->sysex_size + size + 1;
+    if (need > r->sysex_capacity) {
+        size_t capacity = r->sysex_capacity ? r->sysex_capacity : 256;
+        while (capacity < need) {
+            capacity *= 2;
+        }
+        uint8_t* sysex = realloc(r->sysex, capacity);
+        if (!sysex) {
+            return false;
+        }
+        r->sysex = sysex;
+        r->sysex_capacity = capacity;
+    }
+    memcpy(r->sysex + r->sysex_size, data, size);
+    r->sysex_size += size;
+    return true;
+}
+
+// finish a read back message as libmidi gives it, VLQ length first
+static void sysex_finish(struct midi_ump_reader_t* r, struct midi_event_t* event)
+{
+    r->sysex[r->sysex_size++] = 0xf7;
+    uint64_t length = r->sysex_size - SYSEX_VLQ_ROOM;
+    uint8_t vlq[SYSEX_VLQ_ROOM];
+    size_t n = 0;
+    do {
+        vlq[n++] = (uint8_t)(length & 0x7f);
+        length >>= 7;
+    } while (length);
+    uint8_t* out = r->sysex + SYSEX_VLQ_ROOM - n;
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = vlq[n - 1 - i] | ((i + 1 < n) ? 0x80 : 0x00);
+    }
+    event->type = e_midi_event_sysex;
+    event->channel = 0;
+    event->data = out;
+    event->length = r->sysex_size - SYSEX_VLQ_ROOM + n;
+    r->sysex_size = 0;
+}
+
+static bool read_packet(struct midi_ump_reader_t* r, const uint32_t* w, struct midi_event_t* event)
+{
+    const uint32_t type = w[0] >> 28;
+    switch (type) {
+    case e_midi_ump_utility: {
+        const uint32_t status = (w[0] >> 20) & 0xf;
+        if (status == UTILITY_DCTPQ) {
+            r->divisions = (uint16_t)(w[0] & 0xffff);
+        } else if (status == UTILITY_DELTA_CLOCK) {
+            r->time += w[0] & DELTA_CLOCK_MAX;
+        }
+        return false;
+    }
+    case e_midi_ump_system: {
+        const uint8_t status = (uint8_t)(w[0] >> 16);
+        const size_t bytes = 1 + (size_t)((system_bytes[status & 0xf] > 0) ? system_bytes[status & 0xf] : 0);
+        // an escape, with its VLQ length
+        r->data[0] = (uint8_t)bytes;
+        r->data[1] = status;
+        r->data[2] = (uint8_t)(w[0] >> 8) & 0x7f;
+        r->data[3] = (uint8_t)w[0] & 0x7f;
+        event->type = e_midi_event_sysex;
+        event->channel = 0x7;
+        event->data = r->data;
+        event->length = 1 + bytes;
+        return true;
+    }
+    case e_midi_ump_voice1: {
+        const uint8_t status = (uint8_t)(w[0] >> 16);
+        r->data[0] = (uint8_t)(w[0] >> 8) & 0x7f;
+        r->data[1] = (uint8_t)w[0] & 0x7f;
+        event->type = status & 0xf0;
+        event->channel = status & 0x0f;
+        event->data = r->data;
+        event->length = (event->type == e_midi_event_prog_change ||
+                         event->type == e_midi_event_chan_aftertouch) ? 1 : 2;
+        if (event->type == e_midi_event_ctrl_change && r->data[0] >= 120) {
+            event->type = e_midi_event_channel_mode;
+        }
+        return true;
+    }
+    case e_midi_ump_sysex7: {
+        const uint32_t status = (w[0] >> 20) & 0xf;
+        const size_t bytes = (w[0] >> 16) & 0xf;
+        const uint8_t data[SYSEX7_BYTES] = {
+            (uint8_t)(w[0] >> 8), (uint8_t)w[0],
+            (uint8_t)(w[1] >> 24), (uint8_t)(w[1] >> 16), (uint8_t)(w[1] >> 8), (uint8_t)w[1]
+        };
+        if (status == SYSEX7_COMPLETE || status == SYSEX7_START) {
+            r->sysex_size = 0;
+        }
+        if (!sysex_append(r, data, (bytes < SYSEX7_BYTES) ? bytes : SYSEX7_BYTES)) {
+            return false;
+        }
+        if (status == SYSEX7_COMPLETE || status == SYSEX7_END) {
+            sysex_finish(r, event);
+            return true;
+        }
+        return false;
+    }
+    case e_midi_ump_flex: {
+        const uint32_t bank = (w[0] >> 8) & 0xff;
+        const uint32_t status = w[0] & 0xff;
+        event->type = e_midi_event_meta;
+        event->channel = 0x0f;
+        event->data = r->data;
+        if (bank == 0 && status == FLEX_TEMPO) {
+            const uint32_t tempo = w[1] / 100;
+            r->data[0] = (uint8_t)(tempo >> 16);
+            r->data[1] = (uint8_t)(tempo >> 8);
+            r->data[2] = (uint8_t)tempo;
+            event->meta = e_midi_meta_tempo;
+            event->length = 3;
+            return true;
+        }
+        if (bank == 0 && status == FLEX_TIME_SIGNATURE) {
+            // midi clocks per metronome click have no place in the packet
+            r->data[0] = (uint8_t)(w[1] >> 24);
+            r->data[1] = (uint8_t)(w[1] >> 16);
+            r->data[2] = 24;
+            r->data[3] = (uint8_t)(w[1] >> 8);
+            event->meta = e_midi_meta_time_signature;
+            event->length = 4;
+            return true;
+        }
+        return false;
+    }
+    default:
+        return false;
+    }
+}
+
+bool midi_ump_next(
+    struct midi_ump_reader_t* r,
+    struct midi_event_t* event,
+    uint64_t* time)
+{
+    assert(r && event && time);
+    while (r->pos < r->count) {
+        const uint32_t* w = r->word + r->pos;
+        const size_t words = packet_words[w[0] >> 28];
+        if (r->pos + words > r->count) {
+            r->pos = r->count;
+            break;
+        }
+        r->pos += words;
+        memset(event, 0, sizeof(struct midi_event_t));
+        if (read_packet(r, w, event)) {
+            *time = r->time;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool midi_ump_save(
+    const uint32_t* word,
+    size_t count,
+    struct midi_writer_t* writer)
+{
+    assert(word && writer);
+    // the ticks per quarter note packet leads
+    if (count == 0 || (word[0] >> 28) != e_midi_ump_utility ||
+        ((word[0] >> 20) & 0xf) != UTILITY_DCTPQ) {
+        return false;
+    }
+    const uint16_t divisions = (uint16_t)(word[0] & 0xffff);
+    struct midi_ump_reader_t reader;
+    midi_ump_reader_init(&reader, word, count);
+    bool ok = midi_write_header(writer, e_midi_fmt_one_track, 1, divisions) &&
+              midi_write_track_begin(writer);
+    struct midi_event_t event;
+    uint64_t time = 0, prev = 0;
+    while (ok && midi_ump_next(&reader, &event, &time)) {
+        event.delta = time - prev;
+        prev = time;
+        ok = midi_write_event(writer, &event);
+    }
+    if (ok) {
+        const struct midi_event_t eot = {
+            reader.time - prev, e_midi_event_meta, e_midi_meta_end_of_track, 0x0f, 0, NULL
+        };
+        ok = midi_write_event(writer, &eot) && midi_write_track_end(writer) &&
+             midi_write_finish(writer);
+    }
+    midi_ump_reader_free(&reader);
+    return ok;
+}
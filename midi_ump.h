@@ -0,0 +1,120 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#pragma once
+#include "libmidi.h"
+#include "midi_writer.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// universal midi packet conversion
+//
+// the merged event stream of a file becomes an array of UMP words:
+//  - channel voice events as MIDI 1.0 channel voice packets, one word each
+//  - sysex messages as sysex7 packets, two words per six bytes
+//  - tempo and time signature meta events as flex data packets
+//  - escapes holding system common or real time bytes as system packets
+// other meta events have no packet form and are left out.
+//
+// time goes in as utility packets ahead of the first message at each new
+// time. delta clockstamps count ticks, after one ticks per quarter note
+// packet giving the file's divisions, and let the words be turned back into
+// events. jitter reduction timestamps carry the time from the tempo map, in
+// 32 microsecond units modulo 2^16, for players.
+enum {
+    MIDI_UMP_CLOCKSTAMPS   = 1 << 0,
+    MIDI_UMP_JR_TIMESTAMPS = 1 << 1,
+
+    // channel events gathered before packing
+    MIDI_UMP_BATCH = 256,
+};
+
+enum midi_ump_type_t {
+    e_midi_ump_utility  = 0x0,
+    e_midi_ump_system   = 0x1,
+    e_midi_ump_voice1   = 0x2,
+    e_midi_ump_sysex7   = 0x3,
+    e_midi_ump_flex     = 0xd,
+};
+
+struct midi_ump_t {
+    uint32_t* word;
+    size_t count;
+    size_t capacity;
+
+    uint64_t skipped;   // events with no packet form
+};
+
+// turns words back into events
+struct midi_ump_reader_t {
+    const uint32_t* word;
+    size_t count;
+    size_t pos;
+
+    uint64_t time;      // in ticks, from delta clockstamps
+    uint16_t divisions; // from the ticks per quarter note packet, or 0
+
+    // event data, valid until the next event
+    uint8_t data[8];
+    uint8_t* sysex;
+    size_t sysex_size;
+    size_t sysex_capacity;
+};
+
+// pack channel voice messages held as columns, one word per message
+// note: status includes the channel, a plain loop over the arrays that
+//       compilers vectorise
+void midi_ump_pack_voice(
+    const uint8_t* status,
+    const uint8_t* data1,
+    const uint8_t* data2,
+    uint8_t group,
+    uint32_t* out,
+    size_t count);
+
+// convert the merged event stream of a midi file
+// note: 'ump' should be zero initialised before first use, its storage is
+//       kept and reused by subsequent calls. flags are MIDI_UMP_*.
+bool midi_ump_encode(
+    struct midi_t* midi,
+    uint32_t flags,
+    uint8_t group,
+    struct midi_ump_t* ump);
+
+// release word storage
+void midi_ump_free(
+    struct midi_ump_t* ump);
+
+// prepare to read back events from words
+void midi_ump_reader_init(
+    struct midi_ump_reader_t* reader,
+    const uint32_t* word,
+    size_t count);
+
+// release reader storage
+void midi_ump_reader_free(
+    struct midi_ump_reader_t* reader);
+
+// return the next event, along with its absolute time in ticks
+// note: events are as libmidi decodes them, sysex data starting with a VLQ
+//       length. the delta field is left 0.
+bool midi_ump_next(
+    struct midi_ump_reader_t* reader,
+    struct midi_event_t* event,
+    uint64_t* time);
+
+// write words holding clockstamps back out as a format 0 midi file
+bool midi_ump_save(
+    const uint32_t* word,
+    size_t count,
+    struct midi_writer_t* writer);
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
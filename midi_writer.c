@@ -0,0 +1,318 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "midi_writer.h"
+
+
+#define NO_TRACK ((size_t)-1)
+
+static bool reserve(struct midi_writer_t* w, size_t extra)
+{
+    const size_t need = w->size + extra;
+    if (need <= w->capacity) {
+        return true;
+    }
+    size_t capacity = w->capacity ? w->capacity : 4096;
+    while (capacity < need) {
+        capacity *= 2;
+    }
+    uint8_t* data = realloc(w->data, capacity);
+    if (!data) {
+        w->error = true;
+        return false;
+    }
+    w->data = data;
+    w->capacity = capacity;
+    return true;
+}
+
+static void put32(uint8_t* out, uint32_t value)
+{
+    out[0] = (uint8_t)(value >> 24);
+    out[1] = (uint8_t)(value >> 16);
+    out[2] = (uint8_t)(value >>  8);
+    out[3] = (uint8_t)(value >>  0);
+}
+
+static void put16(uint8_t* out, uint16_t value)
+{
+    out[0] = (uint8_t)(value >> 8);
+    out[1] = (uint8_t)(value >> 0);
+}
+
+// encode a VLQ, returning the number of bytes written (at most 10)
+static size_t vlq_write(uint8_t* out, uint64_t value)
+{
+    uint8_t temp[10];
+    size_t n = 0;
+    do {
+        temp[n++] = (uint8_t)(value & 0x7f);
+        value >>= 7;
+    } while (value);
+    for (size_t i = 0; i < n; ++i) {
+        // all but the last byte carry the continuation bit
+        out[i] = temp[n - 1 - i] | ((i + 1 < n) ? 0x80 : 0x00);
+    }
+    return n;
+}
+
+static bool flush(struct midi_writer_t* w)
+{
+    if (!w->file || w->size == 0) {
+        return true;
+    }
+    if (fwrite(w->data, 1, w->size, w->file) != w->size) {
+        w->error = true;
+        return false;
+    }
+    w->flushed += w->size;
+    w->size = 0;
+    return true;
+}
+
+// write a chunk length that has already been flushed to the file
+static bool patch_file(struct midi_writer_t* w, size_t pos, uint32_t value)
+{
+    uint8_t bytes[4];
+    put32(bytes, value);
+    const long offset = w->origin + (long)pos;
+    if (fseek(w->file, offset, SEEK_SET) != 0 ||
+        fwrite(bytes, 1, 4, w->file) != 4 ||
+        fseek(w->file, 0, SEEK_END) != 0) {
+        w->error = true;
+        return false;
+    }
+    return true;
+}
+
+void midi_writer_init(struct midi_writer_t* writer, FILE* file)
+{
+    assert(writer);
+    memset(writer, 0, sizeof(struct midi_writer_t));
+    writer->file = file;
+    writer->track = NO_TRACK;
+    if (file) {
+        writer->origin = ftell(file);
+        writer->seekable = (writer->origin >= 0);
+    }
+}
+
+void midi_writer_free(struct midi_writer_t* writer)
+{
+    assert(writer);
+    free(writer->data);
+    memset(writer, 0, sizeof(struct midi_writer_t));
+    writer->track = NO_TRACK;
+}
+
+bool midi_write_header(
+    struct midi_writer_t *w,
+    uint16_t              format,
+    uint16_t              num_tracks,
+    uint16_t              divisions)
+{
+    assert(w);
+    if (w->error || !reserve(w, 14)) {
+        return false;
+    }
+    uint8_t* out = w->data + w->size;
+    memcpy(out, "MThd", 4);
+    put32(out + 4, 6);
+    put16(out + 8, format);
+    put16(out + 10, num_tracks);
+    put16(out + 12, divisions);
+    w->size += 14;
+    w->num_tracks = num_tracks;
+    w->tracks_written = 0;
+    return true;
+}
+
+bool midi_write_track_begin(struct midi_writer_t* w)
+{
+    assert(w && w->track == NO_TRACK);
+    if (w->error || !reserve(w, 8)) {
+        return false;
+    }
+    w->track = w->flushed + w->size;
+    memcpy(w->data + w->size, "MTrk", 4);
+    // length is back-patched in midi_write_track_end()
+    put32(w->data + w->size + 4, 0);
+    w->size += 8;
+    w->running = 0;
+    w->end_of_track = false;
+    return true;
+}
+
+bool midi_write_event(struct midi_writer_t* w, const struct midi_event_t* event)
+{
+    assert(w && event && w->track != NO_TRACK);
+    if (w->error) {
+        return false;
+    }
+    if (w->end_of_track) {
+        // nothing may follow the end of track
+        return true;
+    }
+    const size_t length = (size_t)event->length;
+    // delta + status + meta type + meta length + payload
+    if (!reserve(w, 10 + 1 + 1 + 10 + length)) {
+        return false;
+    }
+    uint8_t* out = w->data + w->size;
+    out += vlq_write(out, event->delta);
+
+    switch (event->type) {
+    case e_midi_event_meta:
+        *(out++) = e_midi_event_meta;
+        *(out++) = (uint8_t)event->meta;
+        out += vlq_write(out, length);
+        if (length) {
+            // a synthesised end of track has no data at all
+            memcpy(out, event->data, length);
+        }
+        out += length;
+        w->running = 0;
+        w->end_of_track = (event->meta == e_midi_meta_end_of_track);
+        break;
+    case e_midi_event_sysex:
+        // data holds the VLQ length as well as the message bytes
+        *(out++) = (uint8_t)(e_midi_event_sysex | event->channel);
+        memcpy(out, event->data, length);
+        out += length;
+        w->running = 0;
+        break;
+    default: {
+        const uint32_t type = (event->type == e_midi_event_channel_mode) ?
+            e_midi_event_ctrl_change : event->type;
+        const uint8_t status = (uint8_t)((type & 0xf0) | (event->channel & 0x0f));
+        if (status != w->running) {
+            *(out++) = status;
+            w->running = status;
+        }
+        memcpy(out, event->data, length);
+        out += length;
+    }
+    }
+    w->size = out - w->data;
+    if (w->seekable && w->size >= MIDI_WRITER_FLUSH) {
+        return flush(w);
+    }
+    return true;
+}
+
+bool midi_write_track_end(struct midi_writer_t* w)
+{
+    assert(w && w->track != NO_TRACK);
+    if (!w->end_of_track) {
+        const struct midi_event_t eot = {
+            0, e_midi_event_meta, e_midi_meta_end_of_track, 0x0f, 0, NULL
+        };
+        if (!midi_write_event(w, &eot)) {
+            return false;
+        }
+    }
+    if (w->error) {
+        return false;
+    }
+    const size_t length = w->flushed + w->size - w->track - 8;
+    if (length > 0xffffffffu) {
+        w->error = true;
+        return false;
+    }
+    if (w->track >= w->flushed) {
+        put32(w->data + (w->track - w->flushed) + 4, (uint32_t)length);
+    } else if (!patch_file(w, w->track + 4, (uint32_t)length)) {
+        return false;
+    }
+    w->track = NO_TRACK;
+    ++w->tracks_written;
+    return flush(w);
+}
+
+bool midi_write_finish(struct midi_writer_t* w)
+{
+    assert(w && w->track == NO_TRACK);
+    if (w->error || w->tracks_written != w->num_tracks) {
+        return false;
+    }
+    if (!flush(w)) {
+        return false;
+    }
+    return !w->file || fflush(w->file) == 0;
+}
+
+bool midi_save(struct midi_t* midi, struct midi_writer_t* w)
+{
+    assert(midi && w);
+    if (!midi_write_header(w, midi->format, midi->num_tracks, midi->divisions)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < midi->num_tracks; ++i) {
+        struct midi_stream_t* stream = midi_stream(midi, i);
+        if (!stream) {
+            return false;
+        }
+        // re-encoding rarely grows a track, so this avoids most regrowth
+        reserve(w, midi->tracks[i].length + 16);
+        bool ok = midi_write_track_begin(w);
+        struct midi_event_t event;
+        while (ok && !midi_stream_end(stream)) {
+            ok = midi_event_next(stream, &event) && midi_write_event(w, &event);
+        }
+        midi_stream_free(stream);
+        if (!ok || !midi_write_track_end(w)) {
+            return false;
+        }
+    }
+    return midi_write_finish(w);
+}
+
+bool midi_flatten(struct midi_t* midi, struct midi_writer_t* w)
+{
+    assert(midi && w);
+    if (midi->format == e_midi_fmt_multi_song) {
+        // tracks are separate songs and can not be merged
+        return false;
+    }
+    struct midi_mux_t* mux = midi_mux(midi);
+    if (!mux) {
+        return false;
+    }
+    bool ok = midi_write_header(w, e_midi_fmt_one_track, 1, midi->divisions) &&
+              midi_write_track_begin(w);
+
+    struct midi_event_t event;
+    uint64_t prev = 0, time = 0, end = 0;
+    size_t track = 0;
+    while (ok && midi_mux_next(mux, &event, &time, &track)) {
+        if (event.type == e_midi_event_meta &&
+            event.meta == e_midi_meta_end_of_track) {
+            // the song ends when the last track does
+            end = (time > end) ? time : end;
+            continue;
+        }
+        // recompute delta from absolute time in the merged stream
+        event.delta = time - prev;
+        prev = time;
+        ok = midi_write_event(w, &event);
+    }
+    midi_mux_free(mux);
+    if (!ok) {
+        return false;
+    }
+    const struct midi_event_t eot = {
+        (end > prev) ? end - prev : 0,
+        e_midi_event_meta, e_midi_meta_end_of_track, 0x0f, 0, NULL
+    };
+    return midi_write_event(w, &eot) &&
+           midi_write_track_end(w) &&
+           midi_write_finish(w);
+}
@@ -0,0 +1,101 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#pragma once
+#include <stdio.h>
+
+#include "libmidi.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// standard midi file writer
+//
+// output is encoded into a growable buffer. chunk lengths are back-patched
+// when a track ends, at which point, if a file is attached, the buffer is
+// flushed to it. seekable files are also flushed part way through a track
+// once MIDI_WRITER_FLUSH bytes are pending, with the chunk length patched
+// in the file afterwards, so memory use does not depend on track length.
+enum {
+    MIDI_WRITER_FLUSH = 64 * 1024,
+};
+
+struct midi_writer_t {
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+
+    // optional output file, may be NULL
+    FILE* file;
+    long origin;     // file position of the first byte written
+    bool seekable;
+    size_t flushed;  // bytes already written to the file
+
+    // output position of the current MTrk chunk, or SIZE_MAX outside of
+    // a track
+    size_t track;
+    uint16_t num_tracks;
+    uint16_t tracks_written;
+
+    // status byte of the previous event, 0 if running status is not valid
+    uint8_t running;
+    bool end_of_track;
+    bool error;
+};
+
+// prepare a writer, output goes to memory only if file is NULL
+void midi_writer_init(
+    struct midi_writer_t* writer,
+    FILE* file);
+
+// release writer storage
+// note: does not close the attached file
+void midi_writer_free(
+    struct midi_writer_t* writer);
+
+// write the MThd chunk
+bool midi_write_header(
+    struct midi_writer_t* writer,
+    uint16_t format,
+    uint16_t num_tracks,
+    uint16_t divisions);
+
+// start a new MTrk chunk
+bool midi_write_track_begin(
+    struct midi_writer_t* writer);
+
+// write an event to the current track using running status where possible
+// note: event->delta is the time since the previous event in this track
+bool midi_write_event(
+    struct midi_writer_t* writer,
+    const struct midi_event_t* event);
+
+// finish the current track
+// note: appends an end of track event if one was not written
+bool midi_write_track_end(
+    struct midi_writer_t* writer);
+
+// finish writing, checking that all tracks were written
+bool midi_write_finish(
+    struct midi_writer_t* writer);
+
+// re-encode all tracks of a midi file
+bool midi_save(
+    struct midi_t* midi,
+    struct midi_writer_t* writer);
+
+// write a midi file as format 0, merging all of its tracks into one
+// note: events are written as they come off the merged stream, per track
+//       end of track events are replaced by one at the end of the song
+bool midi_flatten(
+    struct midi_t* midi,
+    struct midi_writer_t* writer);
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif
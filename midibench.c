@@ -0,0 +1,110 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#if defined(_MSC_VER)
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libmidi.h"
+#include "tool_common.h"
+
+
+// measure merged stream decoding throughput
+//
+// usage:
+//   midibench <file or dir> [iterations]
+
+// decode every event of every file through the merged stream
+static uint64_t bench_mux(struct midi_t** midi, size_t count)
+{
+    uint64_t events = 0;
+    for (size_t i = 0; i < count; ++i) {
+        struct midi_mux_t* mux = midi_mux(midi[i]);
+        if (!mux) {
+            continue;
+        }
+        struct midi_event_t event;
+        uint64_t time = 0;
+        size_t track = 0;
+        while (midi_mux_next(mux, &event, &time, &track)) {
+            ++events;
+        }
+        midi_mux_free(mux);
+    }
+    return events;
+}
+
+int main(const int argc, const char* args[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <file or dir> [iterations]\n", args[0]);
+        return 1;
+    }
+    const int iterations = (argc > 2) ? atoi(args[2]) : 10;
+
+    struct path_list_t list = { NULL, 0, 0 };
+    if (path_is_dir(args[1])) {
+        path_scan(args[1], ".mid", &list);
+    } else {
+        list.path = malloc(sizeof(char*));
+        list.path[0] = malloc(strlen(args[1]) + 1);
+        strcpy(list.path[0], args[1]);
+        list.count = list.capacity = 1;
+    }
+
+    // load everything up front so only decoding is measured
+    struct file_t* file = calloc(list.count, sizeof(struct file_t));
+    struct midi_t** midi = calloc(list.count, sizeof(struct midi_t*));
+    size_t loaded = 0;
+    for (size_t i = 0; i < list.count; ++i) {
+        if (!file_load(list.path[i], file + loaded)) {
+            continue;
+        }
+        if ((midi[loaded] = midi_load(file[loaded].file_, file[loaded].size_)) == NULL) {
+            file_free(file + loaded);
+            continue;
+        }
+        ++loaded;
+    }
+
+    midi_stats_reset();
+    uint64_t events = 0;
+    const double start = timer_seconds();
+    for (int i = 0; i < iterations; ++i) {
+        events += bench_mux(midi, loaded);
+    }
+    const double elapsed = timer_seconds() - start;
+
+    printf("%zu files, %llu events in %.3fs\n",
+        loaded, (unsigned long long)events, elapsed);
+    if (events) {
+        printf("%.1f ns/event, %.2f Mevents/s\n",
+            elapsed * 1e9 / (double)events, (double)events / elapsed * 1e-6);
+    }
+    struct midi_stats_t stats;
+    if (midi_stats_get(&stats) && events) {
+        printf("%.2f vlq bytes/event, %.2f mux compares/event, %llu peeks\n",
+            (double)stats.vlq_bytes / (double)events,
+            (double)stats.mux_compares / (double)events,
+            (unsigned long long)stats.peeks);
+    }
+
+    for (size_t i = 0; i < loaded; ++i) {
+        midi_free(midi[i]);
+        file_free(file + i);
+    }
+    free(midi);
+    free(file);
+    path_list_free(&list);
+    return 0;
+}
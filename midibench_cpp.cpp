@@ -0,0 +1,106 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "libmidi.hpp"
+#include "tool_common.h"
+
+
+// compare the C++ range and dispatch layer against a hand written C loop
+//
+// usage:
+//   midibench_cpp <dir> [iterations]
+
+namespace {
+
+struct counter : midi::handler {
+    uint64_t notes = 0;
+    uint64_t keys = 0;
+    void note_on(const midi::event& ev)
+    {
+        ++notes;
+        keys += ev.data[0];
+    }
+};
+
+uint64_t run_c(const std::vector<midi::file>& files, uint64_t& keys)
+{
+    uint64_t notes = 0;
+    for (const midi::file& f : files) {
+        midi_mux_t* mux = midi_mux(f.get());
+        if (!mux) {
+            continue;
+        }
+        midi_event_t event;
+        uint64_t time = 0;
+        size_t track = 0;
+        while (midi_mux_next(mux, &event, &time, &track)) {
+            if (event.type == e_midi_event_note_on) {
+                ++notes;
+                keys += event.data[0];
+            }
+        }
+        midi_mux_free(mux);
+    }
+    return notes;
+}
+
+uint64_t run_cpp(const std::vector<midi::file>& files, uint64_t& keys)
+{
+    counter c;
+    for (const midi::file& f : files) {
+        midi::visit(midi::merged(f), c);
+    }
+    keys += c.keys;
+    return c.notes;
+}
+
+template <typename FUNC>
+void measure(const char* name, FUNC func, const std::vector<midi::file>& files, int iterations)
+{
+    uint64_t notes = 0, keys = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        notes += func(files, keys);
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::printf("%-4s %.3fs, %llu note ons (%llu)\n", name, elapsed.count(),
+        (unsigned long long)notes, (unsigned long long)keys);
+}
+
+} // namespace
+
+int main(const int argc, const char* args[])
+{
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <dir> [iterations]\n", args[0]);
+        return 1;
+    }
+    const int iterations = (argc > 2) ? std::atoi(args[2]) : 10;
+
+    path_list_t list = { nullptr, 0, 0 };
+    if (!path_scan(args[1], ".mid", &list)) {
+        std::fprintf(stderr, "Unable to scan '%s'\n", args[1]);
+        return 1;
+    }
+    std::vector<midi::file> files;
+    for (size_t i = 0; i < list.count; ++i) {
+        midi::file f = midi::file::load(list.path[i]);
+        if (f) {
+            files.push_back(std::move(f));
+        }
+    }
+    path_list_free(&list);
+
+    measure("c", run_c, files, iterations);
+    measure("c++", run_cpp, files, iterations);
+    return 0;
+}
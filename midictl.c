@@ -0,0 +1,321 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "midid.h"
+
+
+// client for midid
+//
+// usage:
+//   midictl <socket> play <file>
+//   midictl <socket> bench <file> <sessions> [seconds]
+//
+// play prints every event received along with how late it arrived. bench
+// runs many sessions at once and reports throughput and lateness.
+
+enum {
+    RECORD_SIZE = sizeof(struct midid_record_t),
+
+    // lateness histogram in 100us buckets
+    LATE_BUCKETS = 1000,
+};
+
+static uint64_t clock_usec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static int client_connect(const char* path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool client_send(int fd, const char* text)
+{
+    size_t size = strlen(text);
+    while (size) {
+        const ssize_t sent = send(fd, text, size, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return false;
+        }
+        text += sent;
+        size -= (size_t)sent;
+    }
+    return true;
+}
+
+static bool client_record(int fd, struct midid_record_t* record)
+{
+    uint8_t* out = (uint8_t*)record;
+    size_t size = RECORD_SIZE;
+    while (size) {
+        const ssize_t got = recv(fd, out, size, 0);
+        if (got <= 0) {
+            return false;
+        }
+        out += got;
+        size -= (size_t)got;
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Play a single session
+// ----------------------------------------------------------------------------
+
+static int play(const char* socket_path, const char* file)
+{
+    const int fd = client_connect(socket_path);
+    if (fd < 0) {
+        fprintf(stderr, "Unable to connect to '%s'\n", socket_path);
+        return 1;
+    }
+    char line[MIDID_LINE_MAX];
+    snprintf(line, sizeof(line), "load %s\n", file);
+    struct midid_record_t record;
+    if (!client_send(fd, line) || !client_record(fd, &record) || record.kind != e_midid_ok) {
+        fprintf(stderr, "Unable to load '%s'\n", file);
+        close(fd);
+        return 1;
+    }
+    printf("loaded: %u events, %.3fs\n", record.value, (double)record.usec / 1e6);
+    if (!client_send(fd, "play\n") || !client_record(fd, &record) || record.kind != e_midid_ok) {
+        close(fd);
+        return 1;
+    }
+    const uint64_t start = clock_usec();
+    while (client_record(fd, &record)) {
+        const double late = ((double)(clock_usec() - start) - (double)record.usec) / 1000.0;
+        if (record.kind == e_midid_end) {
+            printf("%10.3fms end\n", (double)record.usec / 1000.0);
+            break;
+        }
+        printf("%10.3fms %02x %02x %02x (%+.3fms)\n", (double)record.usec / 1000.0,
+            record.status, record.data[0], record.data[1], late);
+    }
+    close(fd);
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Many concurrent sessions
+// ----------------------------------------------------------------------------
+
+struct conn_t {
+    int fd;
+    uint64_t start; // wall time playback started, 0 until acknowledged
+    int replies;
+    bool done;
+    uint8_t partial[RECORD_SIZE];
+    size_t partial_size;
+};
+
+struct bench_t {
+    uint64_t events;
+    uint64_t reads;
+    uint64_t late_sum;
+    uint64_t late_max;
+    uint64_t late[LATE_BUCKETS];
+    size_t done;
+    size_t failed;
+};
+
+static void bench_record(struct bench_t* b, struct conn_t* c,
+    const struct midid_record_t* record, uint64_t now)
+{
+    switch (record->kind) {
+    case e_midid_ok:
+        // the second reply acknowledges play
+        if (++c->replies == 2) {
+            c->start = now;
+        }
+        break;
+    case e_midid_error:
+        c->done = true;
+        ++b->failed;
+        break;
+    case e_midid_end:
+        c->done = true;
+        ++b->done;
+        break;
+    case e_midid_event: {
+        ++b->events;
+        // events are sent up to a slot early, only count lateness
+        const uint64_t due = c->start + record->usec;
+        const uint64_t late = (now > due) ? now - due : 0;
+        b->late_sum += late;
+        if (late > b->late_max) {
+            b->late_max = late;
+        }
+        const uint64_t bucket = late / 100;
+        ++b->late[(bucket < LATE_BUCKETS) ? bucket : LATE_BUCKETS - 1];
+        break;
+    }
+    }
+}
+
+static void bench_read(struct bench_t* b, struct conn_t* c)
+{
+    uint8_t buffer[64 * 1024];
+    const ssize_t got = recv(c->fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (got <= 0) {
+        if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            c->done = true;
+            ++b->failed;
+        }
+        return;
+    }
+    ++b->reads;
+    const uint64_t now = clock_usec();
+    size_t i = 0;
+    struct midid_record_t record;
+    if (c->partial_size) {
+        const size_t need = RECORD_SIZE - c->partial_size;
+        const size_t take = ((size_t)got < need) ? (size_t)got : need;
+        memcpy(c->partial + c->partial_size, buffer, take);
+        c->partial_size += take;
+        i = take;
+        if (c->partial_size < RECORD_SIZE) {
+            return;
+        }
+        memcpy(&record, c->partial, RECORD_SIZE);
+        bench_record(b, c, &record, now);
+        c->partial_size = 0;
+    }
+    for (; i + RECORD_SIZE <= (size_t)got; i += RECORD_SIZE) {
+        memcpy(&record, buffer + i, RECORD_SIZE);
+        bench_record(b, c, &record, now);
+    }
+    c->partial_size = (size_t)got - i;
+    memcpy(c->partial, buffer + i, c->partial_size);
+}
+
+static uint64_t bench_percentile(const struct bench_t* b, double p)
+{
+    const uint64_t target = (uint64_t)((double)b->events * p);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LATE_BUCKETS; ++i) {
+        seen += b->late[i];
+        if (seen > target) {
+            return i * 100;
+        }
+    }
+    return LATE_BUCKETS * 100;
+}
+
+static int bench(const char* socket_path, const char* file, size_t sessions, double seconds)
+{
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    struct conn_t* conn = calloc(sessions, sizeof(struct conn_t));
+    struct bench_t* b = calloc(1, sizeof(struct bench_t));
+    const int ep = epoll_create1(EPOLL_CLOEXEC);
+    if (!conn || !b || ep < 0) {
+        return 1;
+    }
+    char line[MIDID_LINE_MAX];
+    snprintf(line, sizeof(line), "load %s\nplay\n", file);
+    const uint64_t start = clock_usec();
+    for (size_t i = 0; i < sessions; ++i) {
+        conn[i].fd = client_connect(socket_path);
+        if (conn[i].fd < 0 || !client_send(conn[i].fd, line)) {
+            fprintf(stderr, "Unable to open session %zu\n", i);
+            return 1;
+        }
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = &conn[i];
+        epoll_ctl(ep, EPOLL_CTL_ADD, conn[i].fd, &ev);
+    }
+    const uint64_t connected = clock_usec();
+
+    const uint64_t limit_usec = (uint64_t)(seconds * 1e6);
+    struct epoll_event events[256];
+    while (b->done + b->failed < sessions && clock_usec() - connected < limit_usec) {
+        const int count = epoll_wait(ep, events, 256, 100);
+        for (int i = 0; i < count; ++i) {
+            struct conn_t* c = events[i].data.ptr;
+            if (!c->done) {
+                bench_read(b, c);
+            }
+        }
+    }
+    const double elapsed = (double)(clock_usec() - connected) / 1e6;
+
+    for (size_t i = 0; i < sessions; ++i) {
+        close(conn[i].fd);
+    }
+    close(ep);
+
+    printf("sessions: %zu (connect %.3fs), %zu finished, %zu failed\n", sessions,
+        (double)(connected - start) / 1e6, b->done, b->failed);
+    printf("events:   %llu in %.3fs, %.0f/s, %.1f per read\n",
+        (unsigned long long)b->events, elapsed, (double)b->events / elapsed,
+        b->reads ? (double)b->events / (double)b->reads : 0.0);
+    printf("late:     avg %.3fms, p99 %.1fms, max %.3fms\n",
+        b->events ? (double)b->late_sum / (double)b->events / 1000.0 : 0.0,
+        (double)bench_percentile(b, 0.99) / 1000.0, (double)b->late_max / 1000.0);
+    free(conn);
+    free(b);
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// Program entry point
+// ----------------------------------------------------------------------------
+
+int main(const int argc, const char* args[])
+{
+    if (argc >= 4 && strcmp(args[2], "play") == 0) {
+        return play(args[1], args[3]);
+    }
+    if (argc >= 5 && strcmp(args[2], "bench") == 0) {
+        const int sessions = atoi(args[4]);
+        const double seconds = (argc > 5) ? atof(args[5]) : 10.0;
+        if (sessions > 0 && seconds > 0) {
+            return bench(args[1], args[3], (size_t)sessions, seconds);
+        }
+    }
+    fprintf(stderr, "usage: %s <socket> play <file>\n", args[0]);
+    fprintf(stderr, "       %s <socket> bench <file> <sessions> [seconds]\n", args[0]);
+    return 1;
+}
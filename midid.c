@@ -0,0 +1,814 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libmidi.h"
+#include "midi_tempo.h"
+#include "midid.h"
+#include "tool_common.h"
+
+
+// playback daemon serving many concurrent sessions over a unix socket
+//
+// usage:
+//   midid [socket]
+//
+// everything runs on one thread around a single epoll loop. sessions that
+// are playing sit in a min heap keyed on the wall time of their next event
+// and one timerfd is armed for the earliest of them. each wakeup emits every
+// event due within the next slot into per session buffers, which are then
+// written out with one send per session.
+
+enum {
+    // events due within this window are sent in the same batch
+    SLOT_USEC = 1000,
+
+    // a client with this much unread output is disconnected
+    OUT_LIMIT = 1024 * 1024,
+
+    MAX_EPOLL_EVENTS = 256,
+    CACHE_BUCKETS = 1024,
+};
+
+// heap slot of a session that is not scheduled
+#define NO_HEAP SIZE_MAX
+
+static volatile sig_atomic_t quit;
+
+static uint64_t clock_usec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+// ----------------------------------------------------------------------------
+// Song cache
+// ----------------------------------------------------------------------------
+
+// a channel message ready to be sent
+struct cue_t {
+    uint64_t usec;
+    uint8_t status;
+    uint8_t data[2];
+};
+
+// a decoded song, shared by every session that has it loaded
+struct song_t {
+    struct song_t* next;
+    char* path;
+    uint32_t hash;
+    size_t refs;
+    struct cue_t* cue;
+    size_t count;
+    uint64_t length;
+};
+
+static struct song_t* cache[CACHE_BUCKETS];
+
+static uint32_t hash_string(const char* str)
+{
+    // fnv-1a
+    uint32_t hash = 2166136261u;
+    for (; *str; ++str) {
+        hash = (hash ^ (uint8_t)*str) * 16777619u;
+    }
+    return hash;
+}
+
+// flatten a midi file into timed channel messages
+static bool song_decode(struct midi_t* midi, struct song_t* song)
+{
+    struct midi_tempo_map_t map;
+    if (!midi_tempo_map_build(midi, &map)) {
+        return false;
+    }
+    struct midi_mux_t* mux = midi_mux(midi);
+    if (!mux) {
+        midi_tempo_map_free(&map);
+        return false;
+    }
+    size_t capacity = 0;
+    struct midi_event_t event;
+    uint64_t time = 0;
+    size_t track = 0;
+    while (midi_mux_next(mux, &event, &time, &track)) {
+        const uint64_t usec = midi_tempo_usec(&map, time);
+        if (usec > song->length) {
+            song->length = usec;
+        }
+        uint32_t type = event.type;
+        if (type == e_midi_event_channel_mode) {
+            type = e_midi_event_ctrl_change;
+        }
+        if (type >= e_midi_event_sysex) {
+            continue;
+        }
+        if (song->count == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            struct cue_t* cue = realloc(song->cue, capacity * sizeof(struct cue_t));
+            if (!cue) {
+                midi_mux_free(mux);
+                midi_tempo_map_free(&map);
+                return false;
+            }
+            song->cue = cue;
+        }
+        struct cue_t* cue = &song->cue[song->count++];
+        cue->usec = usec;
+        cue->status = (uint8_t)(type | (event.channel & 0xf));
+        cue->data[0] = (event.length > 0) ? event.data[0] : 0;
+        cue->data[1] = (event.length > 1) ? event.data[1] : 0;
+    }
+    midi_mux_free(mux);
+    midi_tempo_map_free(&map);
+    return true;
+}
+
+static void song_free(struct song_t* song)
+{
+    free(song->cue);
+    free(song->path);
+    free(song);
+}
+
+// find a song in the cache or load it
+// note: loading happens on the event loop, a cache hit costs a path lookup
+static struct song_t* cache_acquire(const char* path)
+{
+    char* real = realpath(path, NULL);
+    if (!real) {
+        return NULL;
+    }
+    const uint32_t hash = hash_string(real);
+    struct song_t** bucket = &cache[hash % CACHE_BUCKETS];
+    for (struct song_t* song = *bucket; song; song = song->next) {
+        if (song->hash == hash && strcmp(song->path, real) == 0) {
+            free(real);
+            ++song->refs;
+            return song;
+        }
+    }
+    struct file_t file;
+    if (!file_load(real, &file)) {
+        free(real);
+        return NULL;
+    }
+    struct song_t* song = calloc(1, sizeof(struct song_t));
+    struct midi_t* midi = midi_load(file.file_, file.size_);
+    if (!song || !midi || !song_decode(midi, song)) {
+        if (song) {
+            free(song->cue);
+            free(song);
+        }
+        midi_free(midi);
+        file_free(&file);
+        free(real);
+        return NULL;
+    }
+    midi_free(midi);
+    file_free(&file);
+    song->path = real;
+    song->hash = hash;
+    song->refs = 1;
+    song->next = *bucket;
+    *bucket = song;
+    return song;
+}
+
+// drop a reference, the last one releases the song
+static void cache_release(struct song_t* song)
+{
+    if (!song || --song->refs) {
+        return;
+    }
+    struct song_t** link = &cache[song->hash % CACHE_BUCKETS];
+    while (*link != song) {
+        link = &(*link)->next;
+    }
+    *link = song->next;
+    song_free(song);
+}
+
+// ----------------------------------------------------------------------------
+// Sessions
+// ----------------------------------------------------------------------------
+
+struct session_t {
+    int fd;
+    bool closed;
+    bool dirty;   // in the dirty list
+    bool writing; // waiting for EPOLLOUT
+
+    struct song_t* song;
+    size_t pos; // next cue to send
+    bool playing;
+
+    // song time song_base was reached at wall time wall_base
+    uint64_t song_base;
+    uint64_t wall_base;
+    uint32_t rate; // percent
+
+    // schedule heap slot and wall time of the next cue
+    size_t heap;
+    uint64_t due;
+
+    char line[MIDID_LINE_MAX];
+    size_t line_size;
+
+    uint8_t* out;
+    size_t out_size;
+    size_t out_capacity;
+};
+
+struct session_list_t {
+    struct session_t** item;
+    size_t count;
+    size_t capacity;
+};
+
+static int epoll_fd = -1;
+static int listen_fd = -1;
+static int timer_fd = -1;
+static uint64_t timer_armed;
+
+static struct session_list_t heap;
+static struct session_list_t dirty;
+static struct session_list_t graveyard;
+
+static struct {
+    uint64_t sessions;
+    uint64_t records;
+    uint64_t sends;
+    uint64_t wakeups;
+} totals;
+
+static bool list_push(struct session_list_t* list, struct session_t* s)
+{
+    if (list->count == list->capacity) {
+        const size_t capacity = list->capacity ? list->capacity * 2 : 256;
+        struct session_t** item = realloc(list->item, capacity * sizeof(struct session_t*));
+        if (!item) {
+            return false;
+        }
+        list->item = item;
+        list->capacity = capacity;
+    }
+    list->item[list->count++] = s;
+    return true;
+}
+
+static void heap_swap(size_t a, size_t b)
+{
+    struct session_t* t = heap.item[a];
+    heap.item[a] = heap.item[b];
+    heap.item[b] = t;
+    heap.item[a]->heap = a;
+    heap.item[b]->heap = b;
+}
+
+static void heap_up(size_t i)
+{
+    while (i > 0) {
+        const size_t parent = (i - 1) / 2;
+        if (heap.item[parent]->due <= heap.item[i]->due) {
+            break;
+        }
+        heap_swap(i, parent);
+        i = parent;
+    }
+}
+
+static void heap_down(size_t i)
+{
+    for (;;) {
+        const size_t l = i * 2 + 1;
+        const size_t r = l + 1;
+        size_t min = i;
+        if (l < heap.count && heap.item[l]->due < heap.item[min]->due) {
+            min = l;
+        }
+        if (r < heap.count && heap.item[r]->due < heap.item[min]->due) {
+            min = r;
+        }
+        if (min == i) {
+            break;
+        }
+        heap_swap(i, min);
+        i = min;
+    }
+}
+
+static void heap_remove(struct session_t* s)
+{
+    const size_t i = s->heap;
+    if (i == NO_HEAP) {
+        return;
+    }
+    s->heap = NO_HEAP;
+    if (i != --heap.count) {
+        heap.item[i] = heap.item[heap.count];
+        heap.item[i]->heap = i;
+        heap_up(i);
+        heap_down(i);
+    }
+}
+
+static void session_close(struct session_t* s)
+{
+    if (s->closed) {
+        return;
+    }
+    s->closed = true;
+    heap_remove(s);
+    cache_release(s->song);
+    s->song = NULL;
+    close(s->fd);
+    // freed at the end of the loop iteration, epoll may still hold it
+    list_push(&graveyard, s);
+}
+
+static void session_emit(struct session_t* s, uint8_t kind, uint64_t usec, uint32_t value,
+    uint8_t status, uint8_t data0, uint8_t data1)
+{
+    const size_t size = sizeof(struct midid_record_t);
+    if (s->closed) {
+        return;
+    }
+    if (s->out_size + size > s->out_capacity) {
+        const size_t capacity = s->out_capacity ? s->out_capacity * 2 : 4096;
+        uint8_t* out = realloc(s->out, capacity);
+        if (!out) {
+            session_close(s);
+            return;
+        }
+        s->out = out;
+        s->out_capacity = capacity;
+    }
+    const struct midid_record_t record = { usec, value, kind, status, { data0, data1 } };
+    memcpy(s->out + s->out_size, &record, size);
+    s->out_size += size;
+    ++totals.records;
+    if (!s->dirty) {
+        s->dirty = true;
+        list_push(&dirty, s);
+    }
+}
+
+static uint64_t session_song_time(const struct session_t* s, uint64_t now)
+{
+    if (!s->playing || now < s->wall_base) {
+        return s->song_base;
+    }
+    return s->song_base + (now - s->wall_base) * s->rate / 100;
+}
+
+// (re)insert a session in the schedule at the time of its next cue
+static void session_schedule(struct session_t* s, uint64_t now)
+{
+    heap_remove(s);
+    if (!s->playing) {
+        return;
+    }
+    s->due = now;
+    if (s->pos < s->song->count) {
+        const uint64_t usec = s->song->cue[s->pos].usec;
+        if (usec > s->song_base) {
+            // round up so the cue never falls inside the slot just pumped
+            s->due = s->wall_base + ((usec - s->song_base) * 100 + s->rate - 1) / s->rate;
+        }
+    }
+    if (!list_push(&heap, s)) {
+        session_close(s);
+        return;
+    }
+    s->heap = heap.count - 1;
+    heap_up(s->heap);
+}
+
+// send all cues sounding before the end of the current slot
+static void session_pump(struct session_t* s, uint64_t now)
+{
+    const struct song_t* song = s->song;
+    const uint64_t horizon = session_song_time(s, now + SLOT_USEC);
+    for (; s->pos < song->count; ++s->pos) {
+        const struct cue_t* cue = &song->cue[s->pos];
+        if (cue->usec > horizon) {
+            return;
+        }
+        session_emit(s, e_midid_event, cue->usec, 0, cue->status, cue->data[0], cue->data[1]);
+        if (s->closed) {
+            return;
+        }
+    }
+    session_emit(s, e_midid_end, song->length, 0, 0, 0, 0);
+    s->song_base = song->length;
+    s->playing = false;
+}
+
+// release any notes a client may be holding
+static void session_silence(struct session_t* s)
+{
+    for (uint8_t channel = 0; channel < 16; ++channel) {
+        session_emit(s, e_midid_event, s->song_base, 0,
+            (uint8_t)(e_midi_event_ctrl_change | channel), e_midi_cmode_all_notes_off, 0);
+    }
+}
+
+static void session_reply(struct session_t* s, bool ok, uint32_t error)
+{
+    if (ok) {
+        session_emit(s, e_midid_ok, s->song_base, 0, 0, 0, 0);
+    } else {
+        session_emit(s, e_midid_error, s->song_base, error, 0, 0, 0);
+    }
+}
+
+static void session_command(struct session_t* s, char* line, uint64_t now)
+{
+    char* arg = line;
+    while (*arg && *arg != ' ') {
+        ++arg;
+    }
+    if (*arg) {
+        *arg++ = '\0';
+    }
+    while (*arg == ' ') {
+        ++arg;
+    }
+
+    if (strcmp(line, "load") == 0) {
+        struct song_t* song = cache_acquire(arg);
+        if (!song) {
+            session_reply(s, false, e_midid_bad_file);
+            return;
+        }
+        cache_release(s->song);
+        s->song = song;
+        s->pos = 0;
+        s->song_base = 0;
+        s->playing = false;
+        heap_remove(s);
+        session_emit(s, e_midid_ok, song->length, (uint32_t)song->count, 0, 0, 0);
+        return;
+    }
+    if (!s->song) {
+        session_reply(s, false,
+            (strcmp(line, "play") == 0 || strcmp(line, "seek") == 0 ||
+                strcmp(line, "tempo") == 0 || strcmp(line, "stop") == 0)
+                ? e_midid_no_file
+                : e_midid_bad_command);
+        return;
+    }
+
+    if (strcmp(line, "play") == 0) {
+        if (!s->playing) {
+            s->playing = true;
+            s->wall_base = now;
+            session_schedule(s, now);
+        }
+        session_reply(s, true, 0);
+    } else if (strcmp(line, "stop") == 0) {
+        if (s->playing) {
+            s->song_base = session_song_time(s, now);
+            s->playing = false;
+            heap_remove(s);
+            session_silence(s);
+        }
+        session_reply(s, true, 0);
+    } else if (strcmp(line, "seek") == 0) {
+        char* end = NULL;
+        const unsigned long long ms = strtoull(arg, &end, 10);
+        if (end == arg) {
+            session_reply(s, false, e_midid_bad_command);
+            return;
+        }
+        const struct song_t* song = s->song;
+        s->song_base = (ms * 1000 < song->length) ? ms * 1000 : song->length;
+        // first cue at or after the new position
+        size_t lo = 0, hi = song->count;
+        while (lo < hi) {
+            const size_t mid = lo + (hi - lo) / 2;
+            if (song->cue[mid].usec < s->song_base) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        s->pos = lo;
+        s->wall_base = now;
+        if (s->playing) {
+            session_silence(s);
+            session_schedule(s, now);
+        }
+        session_reply(s, true, 0);
+    } else if (strcmp(line, "tempo") == 0) {
+        const long rate = strtol(arg, NULL, 10);
+        if (rate < 1 || rate > 1000) {
+            session_reply(s, false, e_midid_bad_command);
+            return;
+        }
+        s->song_base = session_song_time(s, now);
+        s->wall_base = now;
+        s->rate = (uint32_t)rate;
+        session_schedule(s, now);
+        session_reply(s, true, 0);
+    } else {
+        session_reply(s, false, e_midid_bad_command);
+    }
+}
+
+static void session_read(struct session_t* s, uint64_t now)
+{
+    char buffer[4096];
+    for (;;) {
+        const ssize_t size = recv(s->fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (size < 0 && errno == EINTR) {
+            continue;
+        }
+        if (size <= 0) {
+            session_close(s);
+            return;
+        }
+        for (ssize_t i = 0; i < size && !s->closed; ++i) {
+            const char c = buffer[i];
+            if (c == '\n') {
+                s->line[s->line_size] = '\0';
+                s->line_size = 0;
+                session_command(s, s->line, now);
+            } else if (c != '\r') {
+                if (s->line_size + 1 >= MIDID_LINE_MAX) {
+                    session_close(s);
+                    return;
+                }
+                s->line[s->line_size++] = c;
+            }
+        }
+    }
+}
+
+static void session_want_write(struct session_t* s, bool want)
+{
+    if (s->writing == want) {
+        return;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN | (want ? EPOLLOUT : 0);
+    ev.data.ptr = s;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, s->fd, &ev) != 0) {
+        session_close(s);
+        return;
+    }
+    s->writing = want;
+}
+
+// write as much pending output as the socket takes, in one send
+static void session_flush(struct session_t* s)
+{
+    if (s->closed || s->out_size == 0) {
+        return;
+    }
+    const ssize_t sent = send(s->fd, s->out, s->out_size, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        session_close(s);
+        return;
+    }
+    ++totals.sends;
+    if (sent > 0) {
+        s->out_size -= (size_t)sent;
+        memmove(s->out, s->out + sent, s->out_size);
+    }
+    if (s->out_size > OUT_LIMIT) {
+        session_close(s);
+        return;
+    }
+    session_want_write(s, s->out_size != 0);
+}
+
+static void session_accept(void)
+{
+    for (;;) {
+        const int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EMFILE || errno == ENFILE) {
+                fprintf(stderr, "midid: out of file descriptors\n");
+            }
+            return;
+        }
+        struct session_t* s = calloc(1, sizeof(struct session_t));
+        if (!s) {
+            close(fd);
+            continue;
+        }
+        s->fd = fd;
+        s->rate = 100;
+        s->heap = NO_HEAP;
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = s;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            close(fd);
+            free(s);
+            continue;
+        }
+        ++totals.sessions;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Event loop
+// ----------------------------------------------------------------------------
+
+// pump every session with a cue inside the current slot
+static void schedule(uint64_t now)
+{
+    while (heap.count && heap.item[0]->due <= now + SLOT_USEC) {
+        struct session_t* s = heap.item[0];
+        heap_remove(s);
+        session_pump(s, now);
+        if (s->playing && !s->closed) {
+            session_schedule(s, now);
+        }
+    }
+}
+
+// arm the timer for the slot holding the earliest cue
+static void timer_update(void)
+{
+    const uint64_t due = heap.count ? heap.item[0]->due - SLOT_USEC : 0;
+    if (due == timer_armed) {
+        return;
+    }
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (heap.count) {
+        // zero would disarm the timer
+        const uint64_t at = due ? due : 1;
+        spec.it_value.tv_sec = (time_t)(at / 1000000);
+        spec.it_value.tv_nsec = (long)(at % 1000000) * 1000;
+    }
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+    timer_armed = due;
+}
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    quit = 1;
+}
+
+static void raise_fd_limit(void)
+{
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+static bool server_open(const char* path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long '%s'\n", path);
+        return false;
+    }
+    strcpy(addr.sun_path, path);
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        return false;
+    }
+    unlink(path);
+    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(listen_fd, SOMAXCONN) != 0) {
+        fprintf(stderr, "Unable to listen on '%s'\n", path);
+        return false;
+    }
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (epoll_fd < 0 || timer_fd < 0) {
+        return false;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = &listen_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) != 0) {
+        return false;
+    }
+    ev.data.ptr = &timer_fd;
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev) == 0;
+}
+
+static void server_run(void)
+{
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    while (!quit) {
+        const int count = epoll_wait(epoll_fd, events, MAX_EPOLL_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        const uint64_t now = clock_usec();
+        for (int i = 0; i < count; ++i) {
+            void* ptr = events[i].data.ptr;
+            if (ptr == &listen_fd) {
+                session_accept();
+                continue;
+            }
+            if (ptr == &timer_fd) {
+                uint64_t expired;
+                if (read(timer_fd, &expired, sizeof(expired)) > 0) {
+                    ++totals.wakeups;
+                }
+                timer_armed = 0;
+                continue;
+            }
+            struct session_t* s = ptr;
+            if (s->closed) {
+                continue;
+            }
+            if (events[i].events & EPOLLIN) {
+                session_read(s, now);
+            }
+            if (events[i].events & EPOLLOUT) {
+                session_flush(s);
+            }
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                session_close(s);
+            }
+        }
+        schedule(clock_usec());
+        for (size_t i = 0; i < dirty.count; ++i) {
+            dirty.item[i]->dirty = false;
+            session_flush(dirty.item[i]);
+        }
+        dirty.count = 0;
+        for (size_t i = 0; i < graveyard.count; ++i) {
+            free(graveyard.item[i]->out);
+            free(graveyard.item[i]);
+        }
+        graveyard.count = 0;
+        timer_update();
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Program entry point
+// ----------------------------------------------------------------------------
+
+int main(const int argc, const char* args[])
+{
+    const char* path = (argc > 1) ? args[1] : MIDID_SOCKET;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    raise_fd_limit();
+
+    if (!server_open(path)) {
+        fprintf(stderr, "Unable to start midid\n");
+        return 1;
+    }
+    printf("midid: listening on '%s'\n", path);
+    fflush(stdout);
+
+    server_run();
+
+    unlink(path);
+    printf("midid: %llu sessions, %llu records, %llu sends, %llu wakeups\n",
+        (unsigned long long)totals.sessions, (unsigned long long)totals.records,
+        (unsigned long long)totals.sends, (unsigned long long)totals.wakeups);
+    return 0;
+}
@@ -0,0 +1,52 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#pragma once
+#include <stdint.h>
+
+// wire protocol shared by midid and its clients
+//
+// clients send text commands, one per line:
+//   load <path>      open a file through the daemon's shared cache
+//   play             start or resume playback
+//   seek <ms>        move the play position
+//   tempo <percent>  playback speed, 100 is the song's own tempo
+//   stop             pause playback, the position is kept
+//
+// the daemon answers every command with one e_midid_ok or e_midid_error
+// record. while playing, channel events are streamed slightly ahead of time
+// in batches, each stamped with its song time, followed by e_midid_end.
+
+#define MIDID_SOCKET "/tmp/midid.sock"
+
+enum {
+    // longest command line accepted
+    MIDID_LINE_MAX = 1024,
+};
+
+enum midid_kind_t {
+    e_midid_event = 0, // status and data hold a channel message
+    e_midid_ok,        // command succeeded, usec is the play position
+    e_midid_error,     // command failed, value holds a midid_error_t
+    e_midid_end,       // playback reached the end of the song
+};
+
+enum midid_error_t {
+    e_midid_bad_command = 1,
+    e_midid_bad_file,
+    e_midid_no_file,
+};
+
+// fixed size record sent from the daemon to a client
+// note: after a load, usec is the song length and value the event count
+struct midid_record_t {
+    uint64_t usec;  // song time in microseconds
+    uint32_t value;
+    uint8_t kind;
+    uint8_t status;
+    uint8_t data[2];
+};
@@ -0,0 +1,467 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#if defined(_MSC_VER)
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libmidi.h"
+#include "midi_tempo.h"
+#include "midi_thread.h"
+#include "tool_common.h"
+
+
+// export merged event streams as typed columns
+//
+// usage:
+//   midiexport [-csv] <file or dir> <out> [threads]
+//
+// binary layout, native byte order, every array padded to 8 bytes:
+//
+//   header   u32 magic 'MCOL', u32 version, u64 blocks
+//   then one block per file that loaded:
+//     u32 magic 'MCB1', u32 file id, u64 rows, u64 payload bytes,
+//     u32 path bytes, u32 reserved
+//     char path[]
+//     u32 file_id[rows]
+//     u64 tick[rows]            absolute time in ticks
+//     u64 usec[rows]            absolute time in microseconds
+//     u16 track[rows]
+//     u16 type[rows]            midi_event_type_t
+//     u8  channel[rows]
+//     u8  data1[rows]           meta type for meta events
+//     u8  data2[rows]
+//     u32 payload_offset[rows]  into this block's payload, or 0xffffffff
+//     u8  payload[]             u32 length then the bytes, per meta or sysex
+//
+// the csv fallback has one row per event with the same columns, except the
+// payload offset is replaced by the payload bytes in hex. the csv has no
+// paths, so a sidecar <out>.paths lists 'file_id,path' for every exported
+// file to join against. paths are quoted, with '"' doubled.
+
+enum {
+    EXPORT_MAGIC       = 0x4c4f434d, // 'MCOL'
+    EXPORT_BLOCK_MAGIC = 0x3142434d, // 'MCB1'
+    EXPORT_VERSION     = 1,
+
+    // files decoded in parallel before their blocks are written
+    BATCH_FILES = 64,
+
+    OUTPUT_BUFFER = 4 * 1024 * 1024,
+};
+
+#define NO_PAYLOAD 0xffffffffu
+
+struct export_header_t {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t blocks;    // patched once every block is written
+};
+
+struct export_block_t {
+    uint32_t magic;
+    uint32_t file_id;
+    uint64_t rows;
+    uint64_t payload_size;
+    uint32_t path_size;
+    uint32_t reserved;
+};
+
+// the columns of one file
+struct columns_t {
+    uint32_t* file_id;
+    uint64_t* tick;
+    uint64_t* usec;
+    uint16_t* track;
+    uint16_t* type;
+    uint8_t* channel;
+    uint8_t* data1;
+    uint8_t* data2;
+    uint32_t* payload_offset;
+    size_t rows;
+    size_t capacity;
+
+    uint8_t* payload;
+    size_t payload_size;
+    size_t payload_capacity;
+
+    // csv rows, when exporting text
+    char* text;
+    size_t text_size;
+
+    bool ok;
+};
+
+static bool grow(void** ptr, size_t count, size_t size)
+{
+    void* grown = realloc(*ptr, count * size);
+    if (!grown) {
+        return false;
+    }
+    *ptr = grown;
+    return true;
+}
+
+static bool columns_reserve(struct columns_t* c, size_t rows)
+{
+    if (rows <= c->capacity) {
+        return true;
+    }
+    size_t capacity = c->capacity ? c->capacity : 1024;
+    while (capacity < rows) {
+        capacity *= 2;
+    }
+    if (!grow((void**)&c->file_id, capacity, sizeof(uint32_t)) ||
+        !grow((void**)&c->tick, capacity, sizeof(uint64_t)) ||
+        !grow((void**)&c->usec, capacity, sizeof(uint64_t)) ||
+        !grow((void**)&c->track, capacity, sizeof(uint16_t)) ||
+        !grow((void**)&c->type, capacity, sizeof(uint16_t)) ||
+        !grow((void**)&c->channel, capacity, 1) ||
+        !grow((void**)&c->data1, capacity, 1) ||
+        !grow((void**)&c->data2, capacity, 1) ||
+        !grow((void**)&c->payload_offset, capacity, sizeof(uint32_t))) {
+        return false;
+    }
+    c->capacity = capacity;
+    return true;
+}
+
+static bool columns_payload(struct columns_t* c, const uint8_t* data, uint32_t length)
+{
+    const size_t need = c->payload_size + sizeof(uint32_t) + length;
+    if (need > c->payload_capacity) {
+        size_t capacity = c->payload_capacity ? c->payload_capacity : 4096;
+        while (capacity < need) {
+            capacity *= 2;
+        }
+        if (!grow((void**)&c->payload, capacity, 1)) {
+            return false;
+        }
+        c->payload_capacity = capacity;
+    }
+    memcpy(c->payload + c->payload_size, &length, sizeof(uint32_t));
+    memcpy(c->payload + c->payload_size + sizeof(uint32_t), data, length);
+    c->payload_size = need;
+    return true;
+}
+
+static void columns_free(struct columns_t* c)
+{
+    free(c->file_id);
+    free(c->tick);
+    free(c->usec);
+    free(c->track);
+    free(c->type);
+    free(c->channel);
+    free(c->data1);
+    free(c->data2);
+    free(c->payload_offset);
+    free(c->payload);
+    free(c->text);
+    memset(c, 0, sizeof(struct columns_t));
+}
+
+static bool columns_fill(struct midi_t* midi, uint32_t file_id, struct columns_t* c)
+{
+    struct midi_tempo_map_t map;
+    if (!midi_tempo_map_build(midi, &map)) {
+        return false;
+    }
+    struct midi_mux_t* mux = midi_mux(midi);
+    if (!mux) {
+        midi_tempo_map_free(&map);
+        return false;
+    }
+    bool ok = true;
+    struct midi_event_t event;
+    uint64_t time = 0;
+    size_t track = 0;
+    while (ok && midi_mux_next(mux, &event, &time, &track)) {
+        if (!columns_reserve(c, c->rows + 1)) {
+            ok = false;
+            break;
+        }
+        const size_t row = c->rows++;
+        c->file_id[row] = file_id;
+        c->tick[row] = time;
+        c->usec[row] = midi_tempo_usec(&map, time);
+        c->track[row] = (uint16_t)track;
+        c->type[row] = (uint16_t)event.type;
+        c->channel[row] = (uint8_t)event.channel;
+        c->payload_offset[row] = NO_PAYLOAD;
+        if (event.type == e_midi_event_meta || event.type == e_midi_event_sysex) {
+            c->data1[row] = (uint8_t)event.meta;
+            c->data2[row] = 0;
+            c->payload_offset[row] = (uint32_t)c->payload_size;
+            ok = columns_payload(c, event.data, (uint32_t)event.length);
+        } else {
+            c->data1[row] = (event.length > 0) ? event.data[0] : 0;
+            c->data2[row] = (event.length > 1) ? event.data[1] : 0;
+        }
+    }
+    midi_mux_free(mux);
+    midi_tempo_map_free(&map);
+    return ok;
+}
+
+// ----------------------------------------------------------------------------
+// CSV formatting
+// ----------------------------------------------------------------------------
+
+static char* put_uint(char* out, uint64_t value)
+{
+    char digits[20];
+    size_t n = 0;
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    while (n) {
+        *out++ = digits[--n];
+    }
+    return out;
+}
+
+static bool columns_csv(struct columns_t* c)
+{
+    // worst case per row: 9 numbers, separators and no payload
+    size_t size = c->rows * (10 + 20 + 20 + 5 + 5 + 3 + 3 + 3 + 10);
+    size += c->payload_size * 2;
+    c->text = malloc(size ? size : 1);
+    if (!c->text) {
+        return false;
+    }
+    static const char hex[] = "0123456789abcdef";
+    char* out = c->text;
+    for (size_t i = 0; i < c->rows; ++i) {
+        out = put_uint(out, c->file_id[i]);
+        *out++ = ',';
+        out = put_uint(out, c->tick[i]);
+        *out++ = ',';
+        out = put_uint(out, c->usec[i]);
+        *out++ = ',';
+        out = put_uint(out, c->track[i]);
+        *out++ = ',';
+        out = put_uint(out, c->type[i]);
+        *out++ = ',';
+        out = put_uint(out, c->channel[i]);
+        *out++ = ',';
+        out = put_uint(out, c->data1[i]);
+        *out++ = ',';
+        out = put_uint(out, c->data2[i]);
+        *out++ = ',';
+        if (c->payload_offset[i] != NO_PAYLOAD) {
+            const uint8_t* payload = c->payload + c->payload_offset[i];
+            uint32_t length;
+            memcpy(&length, payload, sizeof(uint32_t));
+            payload += sizeof(uint32_t);
+            for (uint32_t j = 0; j < length; ++j) {
+                *out++ = hex[payload[j] >> 4];
+                *out++ = hex[payload[j] & 0xf];
+            }
+        }
+        *out++ = '\n';
+    }
+    c->text_size = (size_t)(out - c->text);
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Export
+// ----------------------------------------------------------------------------
+
+struct batch_t {
+    struct path_list_t list;
+    struct columns_t* columns;
+    size_t first;
+    bool csv;
+};
+
+static void batch_job(void* user, size_t index)
+{
+    struct batch_t* batch = user;
+    const size_t file_id = batch->first + index;
+    struct columns_t* c = &batch->columns[index];
+    struct file_t file;
+    if (!file_load(batch->list.path[file_id], &file)) {
+        return;
+    }
+    struct midi_t* midi = midi_load(file.file_, file.size_);
+    if (midi) {
+        c->ok = columns_fill(midi, (uint32_t)file_id, c) && (!batch->csv || columns_csv(c));
+        midi_free(midi);
+    }
+    file_free(&file);
+}
+
+static bool write_padded(FILE* fd, const void* data, size_t size)
+{
+    static const uint8_t zero[8] = { 0 };
+    const size_t pad = (8 - (size & 7)) & 7;
+    return (size == 0 || fwrite(data, 1, size, fd) == size) &&
+           (pad == 0 || fwrite(zero, 1, pad, fd) == pad);
+}
+
+static bool write_block(FILE* fd, const char* path, uint32_t file_id, const struct columns_t* c)
+{
+    const size_t rows = c->rows;
+    const struct export_block_t block = {
+        EXPORT_BLOCK_MAGIC, file_id, rows, c->payload_size, (uint32_t)strlen(path), 0
+    };
+    return write_padded(fd, &block, sizeof(block)) &&
+           write_padded(fd, path, block.path_size) &&
+           write_padded(fd, c->file_id, rows * sizeof(uint32_t)) &&
+           write_padded(fd, c->tick, rows * sizeof(uint64_t)) &&
+           write_padded(fd, c->usec, rows * sizeof(uint64_t)) &&
+           write_padded(fd, c->track, rows * sizeof(uint16_t)) &&
+           write_padded(fd, c->type, rows * sizeof(uint16_t)) &&
+           write_padded(fd, c->channel, rows) &&
+           write_padded(fd, c->data1, rows) &&
+           write_padded(fd, c->data2, rows) &&
+           write_padded(fd, c->payload_offset, rows * sizeof(uint32_t)) &&
+           write_padded(fd, c->payload, c->payload_size);
+}
+
+static bool write_path_row(FILE* fd, uint32_t file_id, const char* path)
+{
+    if (fprintf(fd, "%u,\"", (unsigned)file_id) < 0) {
+        return false;
+    }
+    for (; *path; ++path) {
+        if ((*path == '"' && fputc('"', fd) == EOF) || fputc(*path, fd) == EOF) {
+            return false;
+        }
+    }
+    return fputs("\"\n", fd) != EOF;
+}
+
+static int export_paths(struct path_list_t* list, const char* out_path, bool csv, size_t threads)
+{
+    FILE* fd = fopen(out_path, csv ? "w" : "wb");
+    if (!fd) {
+        fprintf(stderr, "Unable to open '%s'\n", out_path);
+        return 1;
+    }
+    setvbuf(fd, NULL, _IOFBF, OUTPUT_BUFFER);
+
+    // the csv rows only carry file ids, so the paths go to a sidecar
+    char* paths_path = NULL;
+    FILE* paths_fd = NULL;
+    if (csv) {
+        paths_path = malloc(strlen(out_path) + sizeof(".paths"));
+        if (paths_path) {
+            strcpy(paths_path, out_path);
+            strcat(paths_path, ".paths");
+            paths_fd = fopen(paths_path, "w");
+        }
+        if (!paths_fd) {
+            fprintf(stderr, "Unable to open '%s.paths'\n", out_path);
+            free(paths_path);
+            fclose(fd);
+            return 1;
+        }
+    }
+
+    struct batch_t batch;
+    memset(&batch, 0, sizeof(batch));
+    batch.list = *list;
+    batch.csv = csv;
+    batch.columns = calloc(BATCH_FILES, sizeof(struct columns_t));
+    bool ok = batch.columns != NULL;
+    if (ok && csv) {
+        static const char header[] =
+            "file_id,tick,usec,track,type,channel,data1,data2,payload\n";
+        static const char paths_header[] = "file_id,path\n";
+        ok = fwrite(header, 1, sizeof(header) - 1, fd) == sizeof(header) - 1 &&
+             fwrite(paths_header, 1, sizeof(paths_header) - 1, paths_fd) == sizeof(paths_header) - 1;
+    } else if (ok) {
+        const struct export_header_t header = { EXPORT_MAGIC, EXPORT_VERSION, list->count };
+        ok = fwrite(&header, sizeof(header), 1, fd) == 1;
+    }
+
+    uint64_t rows = 0, blocks = 0;
+    size_t failed = 0;
+    for (size_t first = 0; ok && first < list->count; first += BATCH_FILES) {
+        const size_t count = (list->count - first < BATCH_FILES) ? list->count - first : BATCH_FILES;
+        batch.first = first;
+        midi_parallel_for(count, threads, batch_job, &batch);
+        for (size_t i = 0; i < count; ++i) {
+            struct columns_t* c = &batch.columns[i];
+            if (!c->ok) {
+                fprintf(stderr, "failed: %s\n", list->path[first + i]);
+                ++failed;
+            } else if (ok) {
+                const uint32_t file_id = (uint32_t)(first + i);
+                ok = csv ? fwrite(c->text, 1, c->text_size, fd) == c->text_size &&
+                               write_path_row(paths_fd, file_id, list->path[first + i])
+                         : write_block(fd, list->path[first + i], file_id, c);
+                rows += c->rows;
+                ++blocks;
+            }
+            columns_free(c);
+        }
+    }
+    free(batch.columns);
+    if (ok && !csv) {
+        // failed files have no block, so count only those written
+        const struct export_header_t header = { EXPORT_MAGIC, EXPORT_VERSION, blocks };
+        ok = fseek(fd, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, fd) == 1;
+    }
+    ok = (fclose(fd) == 0) && ok;
+    if (paths_fd) {
+        ok = (fclose(paths_fd) == 0) && ok;
+        free(paths_path);
+    }
+    if (!ok) {
+        fprintf(stderr, "Unable to write '%s'\n", out_path);
+        return 1;
+    }
+    printf("%zu files, %zu failed, %llu rows\n", list->count, failed, (unsigned long long)rows);
+    return failed ? 1 : 0;
+}
+
+int main(const int argc, const char* args[])
+{
+    int arg = 1;
+    bool csv = false;
+    if (argc > 1 && strcmp(args[1], "-csv") == 0) {
+        csv = true;
+        ++arg;
+    }
+    if (argc - arg < 2) {
+        fprintf(stderr, "usage: %s [-csv] <file or dir> <out> [threads]\n", args[0]);
+        return 1;
+    }
+    const char* in_path = args[arg];
+    const char* out_path = args[arg + 1];
+    const size_t threads = (argc - arg > 2) ? (size_t)atoi(args[arg + 2]) : 0;
+
+    const double start = timer_seconds();
+    struct path_list_t list = { NULL, 0, 0 };
+    if (path_is_dir(in_path)) {
+        if (!path_scan(in_path, ".mid", &list)) {
+            fprintf(stderr, "Unable to scan '%s'\n", in_path);
+            return 1;
+        }
+    } else {
+        list.path = malloc(sizeof(char*));
+        list.path[0] = malloc(strlen(in_path) + 1);
+        strcpy(list.path[0], in_path);
+        list.count = list.capacity = 1;
+    }
+    const int ret_val = export_paths(&list, out_path, csv, threads);
+    path_list_free(&list);
+    printf("%.3fs\n", timer_seconds() - start);
+    return ret_val;
+}
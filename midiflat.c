@@ -0,0 +1,156 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#if defined(_MSC_VER)
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libmidi.h"
+#include "midi_thread.h"
+#include "midi_writer.h"
+#include "tool_common.h"
+
+
+// convert format 1 midi files to format 0
+//
+// usage:
+//   midiflat <in.mid> <out.mid>
+//   midiflat <in dir> <out dir> [threads]
+//
+// the input is mapped rather than read, and output is flushed as it is
+// written, so memory does not grow with the file. the one exception is an
+// output that cannot seek, such as a pipe: the merged track's length comes
+// before its events, so the whole track is then held in memory until it ends.
+
+enum {
+    e_ok = 0,
+    e_failed,
+    e_skipped,
+};
+
+static int flatten_file(const char* in_path, const char* out_path)
+{
+    // the input is mapped, so only the pages being merged are resident
+    struct file_t file;
+    if (!file_map(in_path, &file)) {
+        return e_failed;
+    }
+    struct midi_t* midi = midi_load(file.file_, file.size_);
+    if (!midi) {
+        file_unmap(&file);
+        return e_failed;
+    }
+    if (midi->format == e_midi_fmt_multi_song) {
+        midi_free(midi);
+        file_unmap(&file);
+        return e_skipped;
+    }
+    FILE* fd = fopen(out_path, "wb");
+    if (!fd) {
+        midi_free(midi);
+        file_unmap(&file);
+        return e_failed;
+    }
+    struct midi_writer_t writer;
+    midi_writer_init(&writer, fd);
+    const bool ok = midi_flatten(midi, &writer);
+    midi_writer_free(&writer);
+    fclose(fd);
+    midi_free(midi);
+    file_unmap(&file);
+    if (!ok) {
+        remove(out_path);
+    }
+    return ok ? e_ok : e_failed;
+}
+
+struct batch_t {
+    struct path_list_t list;
+    const char* in_root;
+    const char* out_root;
+    volatile size_t failed;
+    volatile size_t skipped;
+};
+
+static void batch_job(void* user, size_t index)
+{
+    struct batch_t* batch = user;
+    const char* in_path = batch->list.path[index];
+    // mirror the input directory layout under the output root
+    char out_path[1024];
+    snprintf(out_path, sizeof(out_path), "%s%s",
+        batch->out_root, in_path + strlen(batch->in_root));
+    char* slash = strrchr(out_path, '/');
+    char* bslash = strrchr(out_path, '\\');
+    slash = (bslash > slash) ? bslash : slash;
+    if (slash) {
+        *slash = '\0';
+        const bool made = path_make_dirs(out_path);
+        *slash = '/';
+        if (!made) {
+            midi_atomic_add(&batch->failed, 1);
+            return;
+        }
+    }
+    switch (flatten_file(in_path, out_path)) {
+    case e_failed:
+        fprintf(stderr, "failed: %s\n", in_path);
+        midi_atomic_add(&batch->failed, 1);
+        break;
+    case e_skipped:
+        fprintf(stderr, "skipped (format 2): %s\n", in_path);
+        midi_atomic_add(&batch->skipped, 1);
+        break;
+    }
+}
+
+static int flatten_dir(const char* in_root, const char* out_root, size_t threads)
+{
+    struct batch_t batch;
+    memset(&batch, 0, sizeof(batch));
+    batch.in_root = in_root;
+    batch.out_root = out_root;
+    if (!path_scan(in_root, ".mid", &batch.list)) {
+        fprintf(stderr, "Unable to scan '%s'\n", in_root);
+        return 1;
+    }
+    midi_parallel_for(batch.list.count, threads, batch_job, &batch);
+    printf("%zu files, %zu failed, %zu skipped\n",
+        batch.list.count, batch.failed, batch.skipped);
+    const int ret_val = batch.failed ? 1 : 0;
+    path_list_free(&batch.list);
+    return ret_val;
+}
+
+int main(const int argc, const char* args[])
+{
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <in> <out> [threads]\n", args[0]);
+        return 1;
+    }
+    if (path_is_dir(args[1])) {
+        const size_t threads = (argc > 3) ? (size_t)atoi(args[3]) : 0;
+        return flatten_dir(args[1], args[2], threads);
+    }
+    switch (flatten_file(args[1], args[2])) {
+    case e_ok:
+        return 0;
+    case e_skipped:
+        fprintf(stderr, "Format 2 files can not be flattened\n");
+        return 1;
+    default:
+        fprintf(stderr, "Unable to flatten '%s'\n", args[1]);
+        return 1;
+    }
+}
@@ -0,0 +1,158 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#if defined(_MSC_VER)
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libmidi.h"
+#include "midi_fingerprint.h"
+#include "midi_thread.h"
+#include "tool_common.h"
+
+
+// find files holding the same music
+//
+// usage:
+//   midifp <file>
+//   midifp <dir> [threads]
+//
+// prints each group of files whose note content matches, files without any
+// notes are not grouped.
+
+struct entry_t {
+    struct midi_fingerprint_t fingerprint;
+    size_t index; // into the path list
+    size_t size;  // file size in bytes
+    bool ok;
+};
+
+struct batch_t {
+    struct path_list_t list;
+    struct entry_t* entry;
+};
+
+static bool fingerprint_file(const char* path, struct entry_t* entry)
+{
+    struct file_t file;
+    if (!file_load(path, &file)) {
+        return false;
+    }
+    entry->size = file.size_;
+    struct midi_t* midi = midi_load(file.file_, file.size_);
+    const bool ok = midi && midi_fingerprint(midi, &entry->fingerprint);
+    if (midi) {
+        midi_free(midi);
+    }
+    file_free(&file);
+    return ok;
+}
+
+static void batch_job(void* user, size_t index)
+{
+    struct batch_t* batch = user;
+    struct entry_t* entry = &batch->entry[index];
+    entry->index = index;
+    entry->ok = fingerprint_file(batch->list.path[index], entry);
+}
+
+static int entry_compare(const void* a, const void* b)
+{
+    const struct entry_t* x = a;
+    const struct entry_t* y = b;
+    if (x->fingerprint.hash != y->fingerprint.hash) {
+        return (x->fingerprint.hash > y->fingerprint.hash) ? 1 : -1;
+    }
+    // keep groups in path order
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+static int fingerprint_dir(const char* root, size_t threads)
+{
+    struct batch_t batch;
+    memset(&batch, 0, sizeof(batch));
+    if (!path_scan(root, ".mid", &batch.list)) {
+        fprintf(stderr, "Unable to scan '%s'\n", root);
+        return 1;
+    }
+    const size_t count = batch.list.count;
+    batch.entry = calloc(count ? count : 1, sizeof(struct entry_t));
+    if (!batch.entry) {
+        path_list_free(&batch.list);
+        return 1;
+    }
+    midi_parallel_for(count, threads, batch_job, &batch);
+
+    // drop failures and files without notes, then bring matches together
+    size_t valid = 0, failed = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const struct entry_t* e = &batch.entry[i];
+        if (!e->ok) {
+            fprintf(stderr, "failed: %s\n", batch.list.path[e->index]);
+            ++failed;
+        } else if (e->fingerprint.notes) {
+            batch.entry[valid++] = *e;
+        }
+    }
+    qsort(batch.entry, valid, sizeof(struct entry_t), entry_compare);
+
+    size_t groups = 0, duplicates = 0, redundant = 0;
+    for (size_t i = 0; i < valid;) {
+        size_t j = i + 1;
+        while (j < valid && batch.entry[j].fingerprint.hash == batch.entry[i].fingerprint.hash) {
+            ++j;
+        }
+        if (j - i > 1) {
+            const struct midi_fingerprint_t* fp = &batch.entry[i].fingerprint;
+            printf("%016llx  %llu notes, %.1fs\n", (unsigned long long)fp->hash,
+                (unsigned long long)fp->notes, (double)fp->usec / 1e6);
+            for (size_t k = i; k < j; ++k) {
+                printf("  %s\n", batch.list.path[batch.entry[k].index]);
+                if (k != i) {
+                    redundant += batch.entry[k].size;
+                }
+            }
+            ++groups;
+            duplicates += j - i - 1;
+        }
+        i = j;
+    }
+    printf("%zu files, %zu failed, %zu duplicate groups, %zu redundant files (%zu bytes)\n",
+        count, failed, groups, duplicates, redundant);
+
+    free(batch.entry);
+    path_list_free(&batch.list);
+    return failed ? 1 : 0;
+}
+
+int main(const int argc, const char* args[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <file or dir> [threads]\n", args[0]);
+        return 1;
+    }
+    if (path_is_dir(args[1])) {
+        const size_t threads = (argc > 2) ? (size_t)atoi(args[2]) : 0;
+        return fingerprint_dir(args[1], threads);
+    }
+    struct entry_t entry;
+    memset(&entry, 0, sizeof(entry));
+    if (!fingerprint_file(args[1], &entry)) {
+        fprintf(stderr, "Unable to fingerprint '%s'\n", args[1]);
+        return 1;
+    }
+    printf("%016llx  %llu notes, %.1fs\n", (unsigned long long)entry.fingerprint.hash,
+        (unsigned long long)entry.fingerprint.notes, (double)entry.fingerprint.usec / 1e6);
+    return 0;
+}
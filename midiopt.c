@@ -0,0 +1,319 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#if defined(_MSC_VER)
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libmidi.h"
+#include "midi_optimize.h"
+#include "tool_common.h"
+
+
+// remove events with no audible effect from a midi file
+//
+// usage:
+//   midiopt [-c] <in.mid> <out.mid>
+//
+// -c replays the input and the output through a player's channel state,
+// controllers, program, wheel, aftertouch and sounding notes, and checks the
+// two agree at the end of every tick. a sysex forgets all but the notes, so
+// values it may have reset have to be sent again.
+
+enum {
+    NUM_CHANNELS = 16,
+
+    // per channel: controllers, program, wheel, aftertouch, then keys
+    SLOT_PROG    = 128,
+    SLOT_WHEEL   = 129,
+    SLOT_TOUCH   = 130,
+    SLOT_KEYS    = 131,
+    NUM_SLOTS    = SLOT_KEYS + 128,
+
+    UNKNOWN      = 0xffff,
+};
+
+// channel state as a player holds it, with a hash kept up to date as
+// slots change so two files compare in constant time per tick
+struct replay_t {
+    uint16_t slot[NUM_CHANNELS][NUM_SLOTS];
+    uint64_t hash;
+};
+
+// the state hash at the end of each tick with events
+struct trace_t {
+    uint64_t* tick;
+    uint64_t* hash;
+    size_t count;
+    size_t capacity;
+};
+
+static uint64_t slot_hash(uint32_t index, uint16_t value)
+{
+    // splitmix64 finaliser
+    uint64_t x = ((uint64_t)index << 16) | value;
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+static void replay_set(struct replay_t* r, uint32_t channel, uint32_t slot, uint16_t value)
+{
+    const uint16_t old = r->slot[channel][slot];
+    if (old != value) {
+        const uint32_t index = channel * NUM_SLOTS + slot;
+        r->hash ^= slot_hash(index, old) ^ slot_hash(index, value);
+        r->slot[channel][slot] = value;
+    }
+}
+
+static void replay_init(struct replay_t* r)
+{
+    r->hash = 0;
+    for (uint32_t c = 0; c < NUM_CHANNELS; ++c) {
+        for (uint32_t i = 0; i < NUM_SLOTS; ++i) {
+            r->slot[c][i] = (i < SLOT_KEYS) ? UNKNOWN : 0;
+            r->hash ^= slot_hash(c * NUM_SLOTS + i, r->slot[c][i]);
+        }
+    }
+}
+
+static void replay_event(struct replay_t* r, const struct midi_event_t* e)
+{
+    const uint32_t c = e->channel & 0x0f;
+    switch (e->type) {
+    case e_midi_event_note_on:
+        if (e->data[1] != 0) {
+            const uint32_t key = SLOT_KEYS + (e->data[0] & 0x7f);
+            replay_set(r, c, key, (uint16_t)(r->slot[c][key] + 1));
+            break;
+        }
+        // fall through
+    case e_midi_event_note_off: {
+        const uint32_t key = SLOT_KEYS + (e->data[0] & 0x7f);
+        if (r->slot[c][key]) {
+            replay_set(r, c, key, (uint16_t)(r->slot[c][key] - 1));
+        }
+        break;
+    }
+    case e_midi_event_ctrl_change:
+        replay_set(r, c, e->data[0] & 0x7f, e->data[1]);
+        break;
+    case e_midi_event_prog_change:
+        replay_set(r, c, SLOT_PROG, e->data[0]);
+        break;
+    case e_midi_event_pitch_wheel:
+        replay_set(r, c, SLOT_WHEEL, (uint16_t)(e->data[0] | (e->data[1] << 7)));
+        break;
+    case e_midi_event_chan_aftertouch:
+        replay_set(r, c, SLOT_TOUCH, e->data[0]);
+        break;
+    case e_midi_event_channel_mode:
+        if (e->data[0] == e_midi_cmode_reset_all_controllers) {
+            for (uint32_t i = 0; i < SLOT_KEYS; ++i) {
+                if (i != SLOT_PROG) {
+                    replay_set(r, c, i, UNKNOWN);
+                }
+            }
+        }
+        if (e->data[0] == e_midi_cmode_all_notes_off ||
+            e->data[0] == e_midi_cmode_all_sound_off) {
+            for (uint32_t i = SLOT_KEYS; i < NUM_SLOTS; ++i) {
+                replay_set(r, c, i, 0);
+            }
+        }
+        break;
+    case e_midi_event_sysex:
+        for (uint32_t ch = 0; ch < NUM_CHANNELS; ++ch) {
+            for (uint32_t i = 0; i < SLOT_KEYS; ++i) {
+                replay_set(r, ch, i, UNKNOWN);
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static bool trace_push(struct trace_t* t, uint64_t tick, uint64_t hash)
+{
+    if (t->count == t->capacity) {
+        const size_t capacity = t->capacity ? t->capacity * 2 : 1024;
+        uint64_t* ticks = realloc(t->tick, capacity * sizeof(uint64_t));
+        if (ticks) {
+            t->tick = ticks;
+        }
+        uint64_t* hashes = realloc(t->hash, capacity * sizeof(uint64_t));
+        if (hashes) {
+            t->hash = hashes;
+        }
+        if (!ticks || !hashes) {
+            return false;
+        }
+        t->capacity = capacity;
+    }
+    t->tick[t->count] = tick;
+    t->hash[t->count] = hash;
+    ++t->count;
+    return true;
+}
+
+static void trace_free(struct trace_t* t)
+{
+    free(t->tick);
+    free(t->hash);
+}
+
+static bool trace_build(struct midi_t* midi, struct trace_t* t, uint64_t* initial)
+{
+    struct midi_mux_t* mux = midi_mux(midi);
+    struct replay_t* r = malloc(sizeof(struct replay_t));
+    bool ok = mux && r;
+    if (ok) {
+        replay_init(r);
+        *initial = r->hash;
+    }
+    struct midi_event_t event;
+    uint64_t tick = 0, last = 0;
+    size_t track = 0;
+    bool any = false;
+    while (ok && midi_mux_next(mux, &event, &tick, &track)) {
+        if (any && tick != last) {
+            ok = trace_push(t, last, r->hash);
+        }
+        replay_event(r, &event);
+        last = tick;
+        any = true;
+    }
+    if (ok && any) {
+        ok = trace_push(t, last, r->hash);
+    }
+    if (mux) {
+        midi_mux_free(mux);
+    }
+    free(r);
+    return ok;
+}
+
+// compare the state of both files at the end of every tick either has events
+// note: returns false and the first tick that differs if they disagree
+static bool check_equivalent(struct midi_t* a, struct midi_t* b, uint64_t* tick)
+{
+    struct trace_t ta, tb;
+    memset(&ta, 0, sizeof(ta));
+    memset(&tb, 0, sizeof(tb));
+    uint64_t ha = 0, hb = 0;
+    bool same = trace_build(a, &ta, &ha) && trace_build(b, &tb, &hb);
+    *tick = 0;
+    size_t i = 0, j = 0;
+    while (same && (i < ta.count || j < tb.count)) {
+        const uint64_t ti = (i < ta.count) ? ta.tick[i] : UINT64_MAX;
+        const uint64_t tj = (j < tb.count) ? tb.tick[j] : UINT64_MAX;
+        *tick = (ti < tj) ? ti : tj;
+        if (ti == *tick) {
+            ha = ta.hash[i++];
+        }
+        if (tj == *tick) {
+            hb = tb.hash[j++];
+        }
+        same = (ha == hb);
+    }
+    trace_free(&ta);
+    trace_free(&tb);
+    return same;
+}
+
+static void print_stats(const struct midi_optimize_stats_t* s)
+{
+    printf("events: %llu -> %llu (%llu removed)\n",
+        (unsigned long long)s->events_in,
+        (unsigned long long)s->events_out,
+        (unsigned long long)(s->events_in - s->events_out));
+    printf("bytes:  %llu -> %llu (%llu saved)\n",
+        (unsigned long long)s->bytes_in,
+        (unsigned long long)s->bytes_out,
+        (unsigned long long)(s->bytes_in - s->bytes_out));
+    printf("  redundant ctrl change   %llu\n", (unsigned long long)s->redundant_ctrl);
+    printf("  redundant prog change   %llu\n", (unsigned long long)s->redundant_prog);
+    printf("  redundant wheel / touch %llu\n", (unsigned long long)s->redundant_wheel);
+    printf("  overwritten same tick   %llu\n", (unsigned long long)s->overwritten);
+    printf("  zero length notes       %llu\n", (unsigned long long)s->zero_length);
+    printf("  stray note off          %llu\n", (unsigned long long)s->stray_note_off);
+}
+
+// reload the written file and replay it against the original
+static bool check_output(struct midi_t* midi, const char* path)
+{
+    struct file_t file;
+    if (!file_load(path, &file)) {
+        fprintf(stderr, "Unable to reload '%s'\n", path);
+        return false;
+    }
+    struct midi_t* out = midi_load(file.file_, file.size_);
+    uint64_t tick = 0;
+    const bool same = out && check_equivalent(midi, out, &tick);
+    if (!out) {
+        fprintf(stderr, "Unable to parse '%s'\n", path);
+    } else if (!same) {
+        fprintf(stderr, "Output differs from the input at tick %llu\n", (unsigned long long)tick);
+    } else {
+        printf("check: channel state identical at every tick\n");
+    }
+    if (out) {
+        midi_free(out);
+    }
+    file_free(&file);
+    return same;
+}
+
+int main(const int argc, const char* args[])
+{
+    const bool check = (argc > 1 && strcmp(args[1], "-c") == 0);
+    const int arg = check ? 2 : 1;
+    if (argc - arg < 2) {
+        fprintf(stderr, "usage: %s [-c] <in.mid> <out.mid>\n", args[0]);
+        return 1;
+    }
+    struct file_t file;
+    if (!file_load(args[arg], &file)) {
+        fprintf(stderr, "Unable open file\n");
+        return 1;
+    }
+    struct midi_t* midi = midi_load(file.file_, file.size_);
+    if (!midi) {
+        fprintf(stderr, "Unable to parse midi file\n");
+        return 1;
+    }
+    FILE* fd = fopen(args[arg + 1], "wb");
+    if (!fd) {
+        fprintf(stderr, "Unable to open output file\n");
+        return 1;
+    }
+    struct midi_writer_t writer;
+    midi_writer_init(&writer, fd);
+    struct midi_optimize_stats_t stats;
+    bool ok = midi_optimize(midi, &writer, &stats);
+    midi_writer_free(&writer);
+    fclose(fd);
+    if (!ok) {
+        fprintf(stderr, "Unable to optimize '%s'\n", args[arg]);
+        remove(args[arg + 1]);
+    } else {
+        print_stats(&stats);
+        ok = !check || check_output(midi, args[arg + 1]);
+    }
+    midi_free(midi);
+    file_free(&file);
+    return ok ? 0 : 1;
+}
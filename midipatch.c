@@ -0,0 +1,221 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#if defined(_MSC_VER)
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libmidi.h"
+#include "midi_patch.h"
+#include "midi_thread.h"
+#include "midi_writer.h"
+#include "tool_common.h"
+
+
+// transpose, remap channels and scale velocities without re-encoding
+//
+// usage:
+//   midipatch [options] <in.mid> <out.mid>
+//   midipatch [options] <in dir> <out dir> [threads]
+//
+// options:
+//   -t <semitones>      transpose, leaving the drum channel alone
+//   -v <percent>        scale note on velocities
+//   -c <from>:<to>      move a channel, channels counting from 0
+//   -s <key>:<channel>  move notes at or above key to a channel
+//   -d                  transpose the drum channel as well
+//
+// files are mapped copy on write and edited where they lie, only files whose
+// running status has to be split are re-encoded.
+
+enum {
+    DRUM_CHANNEL = 9,
+};
+
+struct totals_t {
+    volatile size_t failed;
+    volatile size_t encoded;
+    volatile size_t bytes;
+    volatile size_t changed;
+};
+
+static bool patch_file(
+    const char* in_path,
+    const char* out_path,
+    const struct midi_patch_t* patch,
+    struct totals_t* totals)
+{
+    struct file_t file;
+    if (!file_map(in_path, &file)) {
+        return false;
+    }
+    FILE* fd = fopen(out_path, "wb");
+    if (!fd) {
+        file_unmap(&file);
+        return false;
+    }
+    struct midi_writer_t writer;
+    midi_writer_init(&writer, fd);
+    struct midi_patch_stats_t stats;
+    const enum midi_patch_result_t result =
+        midi_patch(file.file_, file.size_, patch, &writer, &stats);
+    bool ok = (result == e_midi_patch_encoded);
+    if (result == e_midi_patch_in_place) {
+        ok = fwrite(file.file_, 1, file.size_, fd) == file.size_;
+    }
+    midi_writer_free(&writer);
+    ok = (fclose(fd) == 0) && ok;
+    file_unmap(&file);
+    if (!ok) {
+        remove(out_path);
+        return false;
+    }
+    midi_atomic_add(&totals->encoded, (result == e_midi_patch_encoded) ? 1 : 0);
+    midi_atomic_add(&totals->bytes, (size_t)stats.bytes);
+    midi_atomic_add(&totals->changed, (size_t)stats.changed);
+    return true;
+}
+
+struct batch_t {
+    struct path_list_t list;
+    const char* in_root;
+    const char* out_root;
+    const struct midi_patch_t* patch;
+    struct totals_t totals;
+};
+
+static void batch_job(void* user, size_t index)
+{
+    struct batch_t* batch = user;
+    const char* in_path = batch->list.path[index];
+    // mirror the input directory layout under the output root
+    char out_path[1024];
+    snprintf(out_path, sizeof(out_path), "%s%s",
+        batch->out_root, in_path + strlen(batch->in_root));
+    char* slash = strrchr(out_path, '/');
+    char* bslash = strrchr(out_path, '\\');
+    slash = (bslash > slash) ? bslash : slash;
+    if (slash) {
+        *slash = '\0';
+        const bool made = path_make_dirs(out_path);
+        *slash = '/';
+        if (!made) {
+            midi_atomic_add(&batch->totals.failed, 1);
+            return;
+        }
+    }
+    if (!patch_file(in_path, out_path, batch->patch, &batch->totals)) {
+        fprintf(stderr, "failed: %s\n", in_path);
+        midi_atomic_add(&batch->totals.failed, 1);
+    }
+}
+
+static int patch_dir(
+    const char* in_root,
+    const char* out_root,
+    const struct midi_patch_t* patch,
+    size_t threads)
+{
+    struct batch_t batch;
+    memset(&batch, 0, sizeof(batch));
+    batch.in_root = in_root;
+    batch.out_root = out_root;
+    batch.patch = patch;
+    if (!path_scan(in_root, ".mid", &batch.list)) {
+        fprintf(stderr, "Unable to scan '%s'\n", in_root);
+        return 1;
+    }
+    const double start = timer_seconds();
+    midi_parallel_for(batch.list.count, threads, batch_job, &batch);
+    const double elapsed = timer_seconds() - start;
+    printf("%zu files, %zu failed, %zu re-encoded\n",
+        batch.list.count, batch.totals.failed, batch.totals.encoded);
+    printf("%zu events changed, %zu bytes in %.3fs (%.1f MB/s)\n",
+        batch.totals.changed, batch.totals.bytes, elapsed,
+        (double)batch.totals.bytes / (elapsed * 1e6));
+    const int ret_val = batch.totals.failed ? 1 : 0;
+    path_list_free(&batch.list);
+    return ret_val;
+}
+
+static bool parse_pair(const char* text, int* a, int* b)
+{
+    char* end = NULL;
+    *a = (int)strtol(text, &end, 10);
+    if (end == text || *end != ':') {
+        return false;
+    }
+    text = end + 1;
+    *b = (int)strtol(text, &end, 10);
+    return end != text && *end == '\0';
+}
+
+int main(const int argc, const char* args[])
+{
+    struct midi_patch_t patch;
+    midi_patch_init(&patch);
+    bool drums = false;
+    int arg = 1;
+    for (; arg < argc && args[arg][0] == '-'; ++arg) {
+        const char* value = (arg + 1 < argc) ? args[arg + 1] : NULL;
+        int a = 0, b = 0;
+        if (strcmp(args[arg], "-d") == 0) {
+            drums = true;
+            continue;
+        }
+        if (!value) {
+            break;
+        }
+        if (strcmp(args[arg], "-t") == 0) {
+            patch.transpose = atoi(value);
+        } else if (strcmp(args[arg], "-v") == 0) {
+            patch.velocity = (uint32_t)(atoi(value) * MIDI_PATCH_UNITY / 100);
+        } else if (strcmp(args[arg], "-c") == 0 && parse_pair(value, &a, &b) &&
+                   a >= 0 && a < 16 && b >= 0 && b < 16) {
+            patch.channel[a] = (uint8_t)b;
+        } else if (strcmp(args[arg], "-s") == 0 && parse_pair(value, &a, &b) &&
+                   a >= 0 && a < 128 && b >= 0 && b < 16) {
+            patch.split_key = (uint8_t)a;
+            memset(patch.split_channel, b, sizeof(patch.split_channel));
+        } else {
+            fprintf(stderr, "Bad option '%s %s'\n", args[arg], value);
+            return 1;
+        }
+        ++arg;
+    }
+    if (argc - arg < 2) {
+        fprintf(stderr, "usage: %s [-t semitones] [-v percent] [-c from:to] "
+                        "[-s key:channel] [-d] <in> <out> [threads]\n", args[0]);
+        return 1;
+    }
+    if (!drums) {
+        patch.keys &= ~(1u << DRUM_CHANNEL);
+    }
+    if (path_is_dir(args[arg])) {
+        const size_t threads = (argc - arg > 2) ? (size_t)atoi(args[arg + 2]) : 0;
+        return patch_dir(args[arg], args[arg + 1], &patch, threads);
+    }
+    if (strcmp(args[arg], args[arg + 1]) == 0) {
+        fprintf(stderr, "Output must not overwrite the input\n");
+        return 1;
+    }
+    struct totals_t totals;
+    memset(&totals, 0, sizeof(totals));
+    if (!patch_file(args[arg], args[arg + 1], &patch, &totals)) {
+        fprintf(stderr, "Unable to patch '%s'\n", args[arg]);
+        return 1;
+    }
+    printf("%zu events changed%s\n", totals.changed, totals.encoded ? ", re-encoded" : "");
+    return 0;
+}
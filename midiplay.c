@@ -5,11 +5,14 @@
 // |________\___||________/\ \____|____/___/_________/___||
 //  \________\___\________\/  \____\____\__\_________\____\
 
-#if defined(_MSC_VER)
+#if defined(_WIN32)
 #define WIN32_LEAN_AND_MEAN
 #define _CRT_SECURE_NO_WARNINGS
 #include <Windows.h>
 #include <stdio.h>
+#else
+#define _POSIX_C_SOURCE 200809L
+#include <time.h>
 #endif
 
 #include <assert.h>
@@ -17,23 +20,85 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "libmidi.h"
+#include "midi_tempo.h"
+#include "midi_pipeline.h"
+#include "midi_thread.h"
+#include "midi_timeline.h"
 #include "midiplay.h"
+#include "tool_common.h"
 
 
+// play midi files, several files play back to back as a gapless playlist
+//
+// usage:
+//   midiplay [-o <device>]... [-r <track>:<channels>=<devices>]...
+//            [-t <semitones>] [-v <percent>] [-x <channels>] <file> [file ...]
+//
+// each -o opens an output device, numbered from 0 in the order given:
+//   adlib, windows, or a file, a fifo or udp:[host:]port for raw midi bytes.
+//   prefixing stamp: adds send times that midirecv -s turns into latencies
+//
+// each -r routes the channel events of a track, or of every track given *, to
+// one or more devices. channels and devices are lists such as 0-8,10-15 or *,
+// channels counting from 0. without any -r every device plays everything,
+// otherwise events no route matches are not played. for example, drums to a
+// synth, melody to the adlib emulator and everything recorded:
+//   midiplay -o windows -o adlib -o take.raw -r *:9=0 -r *:0-8,10-15=1 -r *:*=2 song.mid
+//
+// -t transposes every channel but the drums, -v scales note on velocities and
+// -x mutes channels. they are applied in the order given, once per song while
+// it is prepared, so playback itself is unchanged.
+
 // ----------------------------------------------------------------------------
-// Midi device abstraction
+// Output routing
 // ----------------------------------------------------------------------------
 
-device_open_t  device_open;
-device_close_t device_close;
-device_send_t  device_send;
+enum {
+    MAX_DEVICES = 8,
+    MAX_ROUTES  = 64,
+    ALL_TRACKS  = -1,
+};
+
+struct route_t {
+    int32_t track;      // or ALL_TRACKS
+    uint16_t channels;  // bit per channel
+    uint8_t devices;    // bit per device
+};
+
+static struct route_t routes[MAX_ROUTES];
+static size_t route_count;
+
+static struct device_t devices[MAX_DEVICES];
+static size_t device_count;
+
+// transforms applied to every song
+static struct midi_pipeline_t pipeline;
+
+// the devices a track and channel play on
+static uint8_t route_lookup(uint32_t track, uint32_t channel)
+{
+    if (route_count == 0) {
+        return (uint8_t)((1u << device_count) - 1);
+    }
+    uint8_t mask = 0;
+    for (size_t i = 0; i < route_count; ++i) {
+        const struct route_t* r = &routes[i];
+        if ((r->track == ALL_TRACKS || (uint32_t)r->track == track) &&
+            (r->channels & (1u << channel))) {
+            mask |= r->devices;
+        }
+    }
+    return mask;
+}
 
 // ----------------------------------------------------------------------------
 // System timer
 // ----------------------------------------------------------------------------
 
+#if defined(_WIN32)
 // processor counter at program start
 static LARGE_INTEGER counter_start;
 
@@ -57,50 +122,52 @@ static void timer_init(void)
     QueryPerformanceCounter(&counter_start);
 }
 
-// ----------------------------------------------------------------------------
-// File loading helper
-// ----------------------------------------------------------------------------
+static void timer_yield(void)
+{
+    Sleep(1);
+}
+#else
+// monotonic clock at program start
+static struct timespec counter_start;
 
-struct file_t {
-    void* file_;
-    size_t size_;
-};
+static double timer_get_millis(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - counter_start.tv_sec) * 1000.0 +
+           (double)(now.tv_nsec - counter_start.tv_nsec) / 1000000.0;
+}
 
-static bool file_load(const char* path, struct file_t* out)
+static void timer_init(void)
 {
-#define TRY(EXPR)       \
-    {                   \
-        if (!(EXPR))    \
-            goto error; \
-    }
-    assert(path && out);
-    FILE* fd = fopen(path, "rb");
-    TRY(fd);
-    TRY(fseek(fd, 0, SEEK_END) == 0);
-    TRY((out->size_ = ftell(fd)) > 0);
-    TRY(out->file_ = malloc(out->size_));
-    rewind(fd);
-    TRY(fread(out->file_, 1, out->size_, fd) == out->size_);
-    fclose(fd);
-    return true;
-error:
-    if (fd) {
-        fclose(fd);
+    clock_gettime(CLOCK_MONOTONIC, &counter_start);
+}
+
+static void timer_yield(void)
+{
+    const struct timespec delay = { 0, 1000000 };
+    nanosleep(&delay, NULL);
+}
+#endif
+
+// wait until we reach a target time in milliseconds
+static void timer_wait(double milliseconds)
+{
+    for (;;) {
+        const double l = timer_get_millis();
+        if (l > milliseconds) {
+            break;
+        }
+
+        // yield the processor in our waiting loop
+        timer_yield();
     }
-    return false;
-#undef TRY
 }
 
 // ----------------------------------------------------------------------------
-// Midi Playing routines
+// Song preparation
 // ----------------------------------------------------------------------------
 
-// the midi file we are parsing
-static struct midi_t* midi;
-
-// accumulate midi event times in milliseconds
-static double milliseconds;
-
 // unlike music, tempo in MIDI is not given as beats per minute, but rather in
 // microseconds per beat.
 //
@@ -108,10 +175,6 @@ static double milliseconds;
 //  1,000,000 microseconds per second
 //      1,000 microseconds per millisecond
 //
-// set the tempo to 60000000 / 500000 = 120 quarter notes per minute (120 beats
-// per minute)
-static uint64_t tempo = 500000; // 120 bpm
-
 // midi file divisions:
 //
 // when the top bit of the time division bytes is 0, the time division is in
@@ -121,111 +184,423 @@ static uint64_t tempo = 500000; // 120 bpm
 // one tick is
 //
 // 1 tick = microseconds per beat / 60
+//
+// the tempo map folds every tempo change of a song into a lookup from
+// absolute ticks to microseconds, so event times never drift.
+
+// the events of a song one device plays
+struct song_output_t {
+    uint32_t* event;    // timeline indices in time order
+    size_t count;
+    uint16_t channels;  // bit per channel
+};
 
-// timing in MIDI files is centered around ticks and beats. A beat is the same
-// as a quarter note. beats are divided into ticks, the smallest unit of time
-// in MIDI.
+// a song that is ready to play
+struct song_t {
+    const char* path;
+    struct file_t file;
+    struct midi_t* midi;
+    struct midi_timeline_t timeline;
+    struct midi_tempo_map_t tempo;
+
+    // channel event data once rewritten by the pipeline, per timeline event
+    uint8_t (*bytes)[2];
+
+    // routed channel events, per device
+    struct song_output_t output[MAX_DEVICES];
+
+    // time of the final tick in milliseconds
+    double length;
+
+    // milliseconds spent loading, and when that finished
+    double prepare_time;
+    double ready_at;
+    bool ok;
+};
 
-static double ticks_to_milliseconds(uint64_t ticks)
+static bool is_channel_event(const struct midi_event_t* event)
 {
-    const double usPerTick = (double)tempo / (double)(midi->divisions);
-    const double millisPerTick = usPerTick / 1000.0;
-    const double millis = millisPerTick * ticks;
-    return millis;
+    return event->type < e_midi_event_sysex || event->type == e_midi_event_channel_mode;
 }
 
-static void handle_delta(uint64_t delta)
+// split the channel events of a song into one list per device
+// note: the routes are resolved into a flat table once per song, so playback
+//       only walks each device's list
+static bool song_route(struct song_t* song)
 {
-    // accumulate for target time in milliseconds
-    milliseconds += ticks_to_milliseconds(delta);
-
-    // wait until we reach out target time
-    for (;;) {
-        const double l = timer_get_millis();
-        if (l > milliseconds) {
-            break;
+    const uint32_t tracks = song->midi->num_tracks;
+    uint8_t* table = (uint8_t*)malloc((size_t)tracks * 16);
+    if (!table) {
+        return false;
+    }
+    for (uint32_t t = 0; t < tracks; ++t) {
+        for (uint32_t c = 0; c < 16; ++c) {
+            table[t * 16 + c] = route_lookup(t, c);
+        }
+    }
+    const struct midi_timed_event_t* timed = song->timeline.event;
+    for (int pass = 0; pass < 2; ++pass) {
+        for (size_t i = 0; i < song->timeline.count; ++i) {
+            if (!is_channel_event(&timed[i].event)) {
+                continue;
+            }
+            const uint32_t channel = timed[i].event.channel & 0xf;
+            const uint8_t mask = table[timed[i].track * 16 + channel];
+            for (size_t d = 0; d < device_count; ++d) {
+                struct song_output_t* out = &song->output[d];
+                if (mask & (1u << d)) {
+                    if (pass) {
+                        out->event[out->count] = (uint32_t)i;
+                    }
+                    out->channels |= (uint16_t)(1u << channel);
+                    ++out->count;
+                }
+            }
+        }
+        // size each list after counting, then fill them
+        for (size_t d = 0; pass == 0 && d < device_count; ++d) {
+            struct song_output_t* out = &song->output[d];
+            out->event = (uint32_t*)malloc((out->count ? out->count : 1) * sizeof(uint32_t));
+            if (!out->event) {
+                free(table);
+                return false;
+            }
+            out->count = 0;
         }
-
-        // yield the processor in our waiting loop
-        Sleep(1);
     }
+    free(table);
+    return true;
 }
 
-static uint64_t read_number(const uint8_t* ptr, uint64_t len)
+// run the pipeline over a song's timeline, one batch at a time
+// note: results are written back over the timeline, which only shrinks, and
+//       rewritten data bytes move to the song as the batch is reused
+static bool song_transform(struct song_t* song)
 {
-    uint64_t out = 0;
-    for (; len--; ++ptr) {
-        out = (out * 256) | (*ptr);
+    struct midi_timeline_t* timeline = &song->timeline;
+    if (pipeline.count == 0 || timeline->count == 0) {
+        return true;
     }
-    return out;
+    song->bytes = (uint8_t(*)[2])malloc(timeline->count * sizeof(song->bytes[0]));
+    struct midi_batch_t* batch = (struct midi_batch_t*)malloc(sizeof(struct midi_batch_t));
+    if (!song->bytes || !batch) {
+        free(batch);
+        return false;
+    }
+    size_t out = 0;
+    for (size_t first = 0; first < timeline->count; first += MIDI_BATCH_SIZE) {
+        const size_t left = timeline->count - first;
+        batch->count = (left < MIDI_BATCH_SIZE) ? left : MIDI_BATCH_SIZE;
+        for (size_t i = 0; i < batch->count; ++i) {
+            const struct midi_timed_event_t* timed = &timeline->event[first + i];
+            struct midi_event_t* event = &batch->event[i];
+            *event = timed->event;
+            batch->time[i] = timed->time;
+            batch->track[i] = (uint16_t)timed->track;
+            if (is_channel_event(event)) {
+                batch->bytes[i][0] = event->data[0];
+                batch->bytes[i][1] = (event->length > 1) ? event->data[1] : 0;
+                event->data = batch->bytes[i];
+            }
+        }
+        midi_pipeline_run(&pipeline, batch);
+        for (size_t i = 0; i < batch->count; ++i, ++out) {
+            struct midi_timed_event_t* timed = &timeline->event[out];
+            timed->event = batch->event[i];
+            timed->time = batch->time[i];
+            timed->track = batch->track[i];
+            if (timed->event.data == batch->bytes[i]) {
+                memcpy(song->bytes[out], batch->bytes[i], 2);
+                timed->event.data = song->bytes[out];
+            }
+        }
+    }
+    timeline->count = out;
+    free(batch);
+    return true;
 }
 
-static void handle_meta(const struct midi_event_t* event)
+static bool song_load(struct song_t* song)
 {
-    switch (event->meta) {
-    case e_midi_meta_tempo:
-        tempo = read_number(event->data, event->length);
-        break;
+    if (!file_load(song->path, &song->file)) {
+        fprintf(stderr, "Unable open file '%s'\n", song->path);
+        return false;
     }
+    song->midi = midi_load(song->file.file_, song->file.size_);
+    if (!song->midi) {
+        fprintf(stderr, "Unable to parse midi file '%s'\n", song->path);
+        return false;
+    }
+    if (!midi_timeline_build(song->midi, &song->timeline, 1) ||
+        !midi_tempo_map_build(song->midi, &song->tempo)) {
+        fprintf(stderr, "Unable to decode midi file '%s'\n", song->path);
+        return false;
+    }
+    if (!song_transform(song)) {
+        fprintf(stderr, "Unable to transform midi file '%s'\n", song->path);
+        return false;
+    }
+    if (!song_route(song)) {
+        fprintf(stderr, "Unable to route midi file '%s'\n", song->path);
+        return false;
+    }
+    if (song->timeline.count) {
+        const uint64_t end = song->timeline.event[song->timeline.count - 1].time;
+        song->length = (double)midi_tempo_usec(&song->tempo, end) / 1000.0;
+    }
+    return true;
 }
 
-static void handle_event(const struct midi_event_t* event, uint64_t delta)
+// load, validate and decode a song
+// note: runs on a background thread while the previous song plays
+static void song_prepare(void* user)
 {
-    // wait for a period of time
-    handle_delta(delta);
+    struct song_t* song = (struct song_t*)user;
+    const double start = timer_get_millis();
+    song->ok = song_load(song);
+    song->ready_at = timer_get_millis();
+    song->prepare_time = song->ready_at - start;
+}
+
+static void song_free(struct song_t* song)
+{
+    for (size_t d = 0; d < MAX_DEVICES; ++d) {
+        free(song->output[d].event);
+        song->output[d].event = NULL;
+    }
+    free(song->bytes);
+    song->bytes = NULL;
+    midi_tempo_map_free(&song->tempo);
+    midi_timeline_free(&song->timeline);
+    if (song->midi) {
+        midi_free(song->midi);
+        song->midi = NULL;
+    }
+    file_free(&song->file);
+}
 
-    // apply the event
+// ----------------------------------------------------------------------------
+// Channel state
+// ----------------------------------------------------------------------------
+
+// what a song leaves behind on each channel
+struct channel_state_t {
+    uint8_t held[128]; // sounding notes per key
+    uint32_t held_count;
+    bool touched;      // controllers or pitch wheel moved
+};
+
+// per device, as each device only hears the channels routed to it
+static struct channel_state_t channel_state[MAX_DEVICES][16];
+
+static void channel_track(size_t device, const struct midi_event_t* event)
+{
+    struct channel_state_t* cs = &channel_state[device][event->channel & 0xf];
+    const uint8_t key = event->data[0] & 0x7f;
     switch (event->type) {
-    case e_midi_event_note_off:
     case e_midi_event_note_on:
-    case e_midi_event_poly_aftertouch:
+        if (event->data[1] != 0) {
+            if (cs->held[key] < UINT8_MAX) {
+                ++cs->held[key];
+                ++cs->held_count;
+            }
+            break;
+        }
+        // note on with zero velocity is a note off
+        // fall through
+    case e_midi_event_note_off:
+        if (cs->held[key]) {
+            --cs->held[key];
+            --cs->held_count;
+        }
+        break;
     case e_midi_event_ctrl_change:
-    case e_midi_event_prog_change:
     case e_midi_event_chan_aftertouch:
     case e_midi_event_pitch_wheel:
     case e_midi_event_channel_mode:
-        device_send(event);
-        break;
-    case e_midi_event_meta:
-        handle_meta(event);
+        cs->touched = true;
         break;
     }
 }
 
-static int play_demux_events(struct midi_t* mid)
+static void channel_send(
+    struct device_t* device,
+    uint32_t type,
+    uint32_t channel,
+    uint8_t data0,
+    uint8_t data1)
 {
-    // create streams for each track in the midi file
-#define MAX_STREAMS 256
-    struct midi_stream_t* streams[MAX_STREAMS] = { NULL };
-    uint64_t times[MAX_STREAMS] = { 0 };
-    for (int i = 0; i < mid->num_tracks; ++i) {
-        streams[i] = midi_stream(mid, i);
-        if (streams[i] == NULL) {
-            return 1;
+    const uint8_t data[2] = { data0, data1 };
+    struct midi_event_t event = { 0 };
+    event.type = type;
+    event.channel = channel;
+    event.length = 2;
+    event.data = data;
+    device->send(device, &event);
+}
+
+// tidy up after one song before the next starts
+// note: only hanging notes are released, and controllers are only reset on
+//       channels the next song plays on, so most transitions send nothing
+// note: next is NULL after the last song
+static uint32_t channel_handoff(const struct song_t* next)
+{
+    uint32_t sent = 0;
+    for (size_t d = 0; d < device_count; ++d) {
+        struct device_t* device = &devices[d];
+        const uint16_t next_channels = next ? next->output[d].channels : 0;
+        for (uint32_t c = 0; c < 16; ++c) {
+            struct channel_state_t* cs = &channel_state[d][c];
+            for (uint32_t key = 0; cs->held_count && key < 128; ++key) {
+                for (; cs->held[key]; --cs->held[key], --cs->held_count) {
+                    channel_send(device, e_midi_event_note_off, c, (uint8_t)key, 0);
+                    ++sent;
+                }
+            }
+            if (cs->touched && (next_channels & (1u << c))) {
+                channel_send(device, e_midi_event_ctrl_change, c,
+                    e_midi_cmode_reset_all_controllers, 0);
+                cs->touched = false;
+                ++sent;
+            }
+        }
+        if (device->flush) {
+            device->flush(device);
         }
     }
-#undef MAX_STREAMS
+    return sent;
+}
+
+// ----------------------------------------------------------------------------
+// Midi Playing routines
+// ----------------------------------------------------------------------------
+
+static double event_millis(const struct song_t* song, size_t index, double start)
+{
+    const uint64_t usec = midi_tempo_usec(&song->tempo, song->timeline.event[index].time);
+    return start + (double)usec / 1000.0;
+}
+
+// play a song whose first tick sounds at start milliseconds
+// note: every event due when the player wakes forms one slot, each device
+//       is sent its share of the slot as a batch and then flushed
+static void play_song(const struct song_t* song, double start, bool report)
+{
+    const struct midi_timed_event_t* timed = song->timeline.event;
+    const size_t count = song->timeline.count;
+    size_t cursor[MAX_DEVICES] = { 0 };
+    for (size_t i = 0; i < count;) {
+        // wait for a period of time
+        const double at = event_millis(song, i, start);
+        timer_wait(at);
+        if (i == 0 && report) {
+            printf("  first event %+.3fms from the handoff\n", timer_get_millis() - at);
+        }
 
-    // play events in a loop
-    struct midi_event_t event;
-    uint64_t lastTime = 0;
-    uint64_t time     = 0;
-    size_t   index    = 0;
-    while (midi_stream_mux(streams, times, mid->num_tracks, &event, &time, &index)) {
+        // gather everything due so far
+        const double now = timer_get_millis();
+        size_t end = i + 1;
+        while (end < count && event_millis(song, end, start) <= now) {
+            ++end;
+        }
 
-        // work out delta since last event
-        const uint64_t delta = time - lastTime;
-        lastTime = time;
-        // dispatch the event
-        handle_event(&event, delta);
+        // dispatch the slot to each device
+        for (size_t d = 0; d < device_count; ++d) {
+            const struct song_output_t* out = &song->output[d];
+            struct device_t* device = &devices[d];
+            size_t c = cursor[d];
+            for (; c < out->count && out->event[c] < end; ++c) {
+                const struct midi_event_t* event = &timed[out->event[c]].event;
+                channel_track(d, event);
+                device->send(device, event);
+            }
+            cursor[d] = c;
+            if (device->flush) {
+                device->flush(device);
+            }
+        }
+        i = end;
     }
+}
 
-    // release all of the tracks
-    for (int i = 0; i < mid->num_tracks; ++i) {
-        assert(streams[i]);
-        midi_stream_free(streams[i]);
+static int play_list(const char** paths, size_t count)
+{
+    struct song_t* songs = (struct song_t*)calloc(count, sizeof(struct song_t));
+    if (!songs) {
+        return 1;
     }
+    for (size_t i = 0; i < count; ++i) {
+        songs[i].path = paths[i];
+    }
+
+    // find the first song that loads
+    size_t index = 0;
+    for (; index < count; ++index) {
+        song_prepare(&songs[index]);
+        if (songs[index].ok) {
+            break;
+        }
+        song_free(&songs[index]);
+    }
+    if (index == count) {
+        free(songs);
+        return 1;
+    }
+
+    // each song starts on the exact tick the previous one ended
+    const size_t first = index;
+    double start = timer_get_millis();
+    while (index < count) {
+        struct song_t* song = &songs[index];
+        printf("Playing: '%s'\n", song->path);
+
+        // prepare the next song while this one plays
+        size_t next = index + 1;
+        struct midi_thread_t* thread = NULL;
+        if (next < count) {
+            thread = midi_thread_start(song_prepare, &songs[next]);
+        }
 
+        play_song(song, start, index != first);
+        if (next < count && !thread) {
+            // without a thread the next song is prepared once this one has
+            // played, as preparing first would delay its already fixed start
+            song_prepare(&songs[next]);
+        }
+        start += song->length;
+        timer_wait(start);
+        song_free(song);
+
+        if (thread) {
+            midi_thread_join(thread);
+        }
+        // skip any songs that failed to load
+        while (next < count && !songs[next].ok) {
+            song_free(&songs[next]);
+            if (++next < count) {
+                song_prepare(&songs[next]);
+            }
+        }
+        if (next == count) {
+            break;
+        }
+
+        const double now = timer_get_millis();
+        const double stall = songs[next].ready_at - start;
+        const uint32_t resets = channel_handoff(&songs[next]);
+        printf("Transition: prepared in %.3fms, %.3fms %s the handoff, %u reset messages\n",
+            songs[next].prepare_time, (stall > 0.0) ? stall : -stall,
+            (stall > 0.0) ? "after" : "before", resets);
+
+        // a late song can only start once it is ready
+        if (now > start) {
+            start = now;
+        }
+        index = next;
+    }
+
+    channel_handoff(NULL);
+    free(songs);
     return 0;
 }
 
@@ -233,35 +608,193 @@ static int play_demux_events(struct midi_t* mid)
 // Program entry point
 // ----------------------------------------------------------------------------
 
-int main(const int argc, const char* args[])
+static bool parse_mask(const char* text, uint32_t limit, uint32_t* mask)
 {
-    if (argc < 2) {
-        fprintf(stderr, "Midi file argument required\n");
-        return 1;
+    if (strcmp(text, "*") == 0) {
+        *mask = (1u << limit) - 1;
+        return true;
     }
+    *mask = 0;
+    while (*text) {
+        char* end = NULL;
+        const long first = strtol(text, &end, 10);
+        long last = first;
+        if (end == text) {
+            return false;
+        }
+        if (*end == '-') {
+            text = end + 1;
+            last = strtol(text, &end, 10);
+            if (end == text) {
+                return false;
+            }
+        }
+        if (first < 0 || last < first || last >= (long)limit) {
+            return false;
+        }
+        for (long i = first; i <= last; ++i) {
+            *mask |= 1u << i;
+        }
+        if (*end == ',') {
+            ++end;
+        } else if (*end) {
+            return false;
+        }
+        text = end;
+    }
+    return *mask != 0;
+}
 
-    if (1) device_windows_select();
-    if (0) device_adlib_select();
+// parse "<track>:<channels>=<devices>"
+static bool parse_route(const char* text, struct route_t* route)
+{
+    char temp[256];
+    if (strlen(text) >= sizeof(temp)) {
+        return false;
+    }
+    strcpy(temp, text);
+    char* colon = strchr(temp, ':');
+    char* equals = colon ? strchr(colon, '=') : NULL;
+    if (!equals) {
+        return false;
+    }
+    *colon = *equals = '\0';
+    if (strcmp(temp, "*") == 0) {
+        route->track = ALL_TRACKS;
+    } else {
+        char* end = NULL;
+        route->track = (int32_t)strtol(temp, &end, 10);
+        if (end == temp || *end || route->track < 0) {
+            return false;
+        }
+    }
+    uint32_t channels = 0, outputs = 0;
+    if (!parse_mask(colon + 1, 16, &channels) ||
+        !parse_mask(equals + 1, MAX_DEVICES, &outputs)) {
+        return false;
+    }
+    route->channels = (uint16_t)channels;
+    route->devices = (uint8_t)outputs;
+    return true;
+}
 
-    // load this raw file
-    struct file_t file;
-    const char* path = args[1];
-    if (!file_load(path, &file)) {
-        fprintf(stderr, "Unable open file\n");
-        return 1;
+// parse a transform option, adding its stage to the pipeline
+static bool parse_transform(char option, const char* text)
+{
+    // every channel but the drums
+    const uint16_t melodic = (uint16_t)(MIDI_ALL_CHANNELS & ~(1u << 9));
+    char* end = NULL;
+    const long value = strtol(text, &end, 10);
+    switch (option) {
+    case 't':
+        return end != text && !*end && value >= -127 && value <= 127 &&
+               midi_pipeline_transpose(&pipeline, (int32_t)value, melodic);
+    case 'v':
+        // percent to 8.8 fixed point
+        return end != text && !*end && value > 0 && value <= 1000 &&
+               midi_pipeline_velocity(&pipeline, (uint32_t)(value * 256 / 100), MIDI_ALL_CHANNELS);
+    case 'x': {
+        uint32_t channels = 0;
+        const uint32_t types =
+            e_midi_mask_note_off | e_midi_mask_note_on | e_midi_mask_poly_aftertouch |
+            e_midi_mask_ctrl_change | e_midi_mask_prog_change | e_midi_mask_chan_aftertouch |
+            e_midi_mask_pitch_wheel | e_midi_mask_channel_mode;
+        return parse_mask(text, 16, &channels) &&
+               midi_pipeline_filter(&pipeline, types, (uint16_t)channels);
     }
-    printf("Playing: '%s'\n", path);
+    }
+    return false;
+}
 
-    // parse as midi
-    midi = midi_load(file.file_, file.size_);
-    if (!midi) {
-        fprintf(stderr, "Unable to parse midi file\n");
+static bool device_select(struct device_t* device, const char* name)
+{
+    if (strcmp(name, "adlib") == 0) {
+        device_adlib_select(device);
+        return true;
+    }
+#if defined(_WIN32)
+    if (strcmp(name, "windows") == 0) {
+        device_windows_select(device);
+        return true;
+    }
+    fprintf(stderr, "Wire output is not supported on this platform\n");
+    return false;
+#else
+    if (strcmp(name, "windows") == 0) {
+        // rather than a wire file of that name
+        fprintf(stderr, "The windows device is not supported on this platform\n");
+        return false;
+    }
+    device_wire_select(device, name);
+    return true;
+#endif
+}
+
+int main(const int argc, const char* args[])
+{
+    int first = 1;
+    for (; first + 1 < argc; first += 2) {
+        if (strcmp(args[first], "-o") == 0) {
+            if (device_count == MAX_DEVICES) {
+                fprintf(stderr, "At most %d devices can be used\n", MAX_DEVICES);
+                return 1;
+            }
+            if (!device_select(&devices[device_count], args[first + 1])) {
+                return 1;
+            }
+            ++device_count;
+        } else if (strcmp(args[first], "-r") == 0) {
+            if (route_count == MAX_ROUTES || !parse_route(args[first + 1], &routes[route_count])) {
+                fprintf(stderr, "Bad route '%s'\n", args[first + 1]);
+                return 1;
+            }
+            ++route_count;
+        } else if (strcmp(args[first], "-t") == 0 ||
+                   strcmp(args[first], "-v") == 0 ||
+                   strcmp(args[first], "-x") == 0) {
+            if (!parse_transform(args[first][1], args[first + 1])) {
+                fprintf(stderr, "Bad transform '%s %s'\n", args[first], args[first + 1]);
+                return 1;
+            }
+        } else {
+            break;
+        }
+    }
+    if (argc <= first) {
+        fprintf(stderr, "Midi file argument required\n");
         return 1;
     }
+    for (size_t i = 0; i < route_count; ++i) {
+        if (routes[i].devices >> device_count) {
+            fprintf(stderr, "Route to a device that was not given with -o\n");
+            return 1;
+        }
+    }
+
+    // default to the platform device
+    if (device_count == 0) {
+#if defined(_WIN32)
+        if (1) device_windows_select(&devices[0]);
+        if (0) device_adlib_select(&devices[0]);
+#else
+        device_adlib_select(&devices[0]);
+#endif
+        device_count = 1;
+    }
 
-    // open the output midi device
-    if (!device_open()) {
+    // open the output midi devices
+    size_t opened = 0;
+    for (; opened < device_count; ++opened) {
+        if (!devices[opened].open(&devices[opened])) {
+            break;
+        }
+    }
+    if (opened < device_count) {
         fprintf(stderr, "Unable to open midi device\n");
+        // closing also releases the state of devices that did not open
+        for (size_t d = 0; d < device_count; ++d) {
+            devices[d].close(&devices[d]);
+        }
         return 1;
     }
 
@@ -269,12 +802,12 @@ int main(const int argc, const char* args[])
     timer_init();
 
     // run the play loop
-    const int ret_val = play_demux_events(midi);
+    const int ret_val = play_list(args + first, (size_t)(argc - first));
 
-    // release midi file
-    midi_free(midi);
-    // shutdown midi device
-    device_close();
+    // shutdown midi devices
+    for (size_t d = 0; d < device_count; ++d) {
+        devices[d].close(&devices[d]);
+    }
 
     // success
     return ret_val;
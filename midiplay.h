@@ -9,13 +9,37 @@
 
 #include "libmidi.h"
 
-typedef bool (*device_open_t )(void);
-typedef void (*device_close_t)(void);
-typedef void (*device_send_t )(const struct midi_event_t* event);
+struct device_t;
 
-extern device_open_t  device_open;
-extern device_close_t device_close;
-extern device_send_t  device_send;
+typedef bool (*device_open_t )(struct device_t* device);
+typedef void (*device_close_t)(struct device_t* device);
+typedef void (*device_send_t )(struct device_t* device, const struct midi_event_t* event);
+typedef void (*device_flush_t)(struct device_t* device);
 
-void device_windows_select(void);
-void device_adlib_select  (void);
+// an output device, several of which may be open at once
+struct device_t {
+    device_open_t  open;
+    device_close_t close;
+    device_send_t  send;
+
+    // optional, called once the events of a scheduling slot have been sent
+    device_flush_t flush;
+
+    // backend state
+    void* user;
+};
+
+void device_windows_select(struct device_t* device);
+void device_adlib_select  (struct device_t* device);
+
+// raw midi bytes to a file, a fifo or "udp:[host:]port"
+// note: a "stamp:" prefix, ie. stamp:udp:9000, frames every write with a
+//       wire_stamp_t giving its send time, for measuring latency
+void device_wire_select   (struct device_t* device, const char* target);
+
+// header of a stamped write, in native byte order as both ends share a host
+struct wire_stamp_t {
+    uint64_t usec; // CLOCK_MONOTONIC send time in microseconds
+    uint32_t size; // midi bytes that follow
+    uint32_t reserved;
+};
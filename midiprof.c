@@ -0,0 +1,238 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#if defined(_MSC_VER)
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libmidi.h"
+#include "midi_profile.h"
+#include "midi_thread.h"
+#include "tool_common.h"
+
+
+// profile polyphony and event density, for sizing voice pools and queues
+//
+// usage:
+//   midiprof [options] <file>
+//   midiprof [options] <dir> [threads]
+//
+// options:
+//   -w <usec>    sliding window for event density, default 1000
+//   -l <voices>  voice limit to report note ons beyond, default 9 as for OPL2
+//   -h           in directory mode, print every file's histograms
+//
+// a directory gives one line per file in path order, then the corpus summary.
+
+enum {
+    DEFAULT_LIMIT = 9,
+    BAR_WIDTH = 40,
+};
+
+struct options_t {
+    uint32_t window_usec;
+    uint32_t limit;
+    bool histograms;
+};
+
+static bool profile_file(const char* path, uint32_t window_usec, struct midi_profile_t* profile)
+{
+    struct file_t file;
+    if (!file_load(path, &file)) {
+        return false;
+    }
+    struct midi_t* midi = midi_load(file.file_, file.size_);
+    if (!midi) {
+        file_free(&file);
+        return false;
+    }
+    const bool ok = midi_profile(midi, window_usec, profile);
+    midi_free(midi);
+    file_free(&file);
+    return ok;
+}
+
+static uint64_t over_limit(const struct midi_profile_t* p, uint32_t limit)
+{
+    uint64_t over = 0;
+    for (uint32_t i = limit + 1; i < MIDI_PROFILE_VOICES; ++i) {
+        over += p->voices[i];
+    }
+    return over;
+}
+
+static void print_bar(uint64_t count, uint64_t total)
+{
+    const uint32_t width = total ? (uint32_t)(count * BAR_WIDTH / total) : 0;
+    printf(" %10llu %6.2f%% ", (unsigned long long)count, total ? 100.0 * count / total : 0.0);
+    for (uint32_t i = 0; i < width; ++i) {
+        putchar('#');
+    }
+    putchar('\n');
+}
+
+static void print_log2(const char* title, const uint64_t* bins, uint64_t total)
+{
+    printf("%s\n", title);
+    for (uint32_t i = 0; i < MIDI_PROFILE_LOG2_BINS; ++i) {
+        if (bins[i] == 0) {
+            continue;
+        }
+        const unsigned long long lo = 1ull << i;
+        if (i + 1 < MIDI_PROFILE_LOG2_BINS) {
+            printf("  %6llu-%-6llu", lo, (lo << 1) - 1);
+        } else {
+            printf("  %6llu+      ", lo);
+        }
+        print_bar(bins[i], total);
+    }
+}
+
+static void print_profile(const struct midi_profile_t* p, const struct options_t* opt)
+{
+    printf("%llu events, %llu notes, %llu blocks, %.3fs\n",
+        (unsigned long long)p->events, (unsigned long long)p->notes,
+        (unsigned long long)p->blocks, p->usec / 1000000.0);
+    printf("max voices %u, per channel:", p->max_voices);
+    for (uint32_t i = 0; i < 16; ++i) {
+        printf(" %u", p->max_channel_voices[i]);
+    }
+    const uint64_t over = over_limit(p, opt->limit);
+    printf("\n%llu note ons beyond %u voices (%.2f%%)\n", (unsigned long long)over,
+        opt->limit, p->notes ? 100.0 * over / p->notes : 0.0);
+    printf("peak %u events in %uus, largest block %u events\n",
+        p->max_window, p->window_usec, p->max_block);
+
+    printf("note ons by voices sounding\n");
+    for (uint32_t i = 1; i < MIDI_PROFILE_VOICES; ++i) {
+        if (p->voices[i] == 0) {
+            continue;
+        }
+        printf("  %6u%s      ", i, (i + 1 == MIDI_PROFILE_VOICES) ? "+" : " ");
+        print_bar(p->voices[i], p->notes);
+    }
+    print_log2("blocks by events", p->block, p->blocks);
+    print_log2("events by events within the window", p->window, p->events);
+}
+
+static void print_line(const char* path, const struct midi_profile_t* p, uint32_t limit)
+{
+    printf("%4u voices %6llu over limit %4u per window %4u per block  %s\n", p->max_voices,
+        (unsigned long long)over_limit(p, limit), p->max_window, p->max_block, path);
+}
+
+struct batch_t {
+    struct path_list_t list;
+    struct midi_profile_t* profile;
+    bool* ok;
+    uint32_t window_usec;
+    volatile size_t failed;
+};
+
+static void batch_job(void* user, size_t index)
+{
+    struct batch_t* batch = user;
+    batch->ok[index] = profile_file(batch->list.path[index], batch->window_usec, &batch->profile[index]);
+    if (!batch->ok[index]) {
+        fprintf(stderr, "failed: %s\n", batch->list.path[index]);
+        midi_atomic_add(&batch->failed, 1);
+    }
+}
+
+static int profile_dir(const char* root, const struct options_t* opt, size_t threads)
+{
+    struct batch_t batch;
+    memset(&batch, 0, sizeof(batch));
+    if (!path_scan(root, ".mid", &batch.list)) {
+        fprintf(stderr, "Unable to scan '%s'\n", root);
+        return 1;
+    }
+    const size_t count = batch.list.count;
+    batch.profile = calloc(count ? count : 1, sizeof(struct midi_profile_t));
+    batch.ok = calloc(count ? count : 1, sizeof(bool));
+    batch.window_usec = opt->window_usec;
+    if (!batch.profile || !batch.ok) {
+        free(batch.profile);
+        free(batch.ok);
+        path_list_free(&batch.list);
+        return 1;
+    }
+    const double start = timer_seconds();
+    midi_parallel_for(count, threads, batch_job, &batch);
+    const double elapsed = timer_seconds() - start;
+
+    // files are profiled in any order but summed in path order
+    struct midi_profile_t total;
+    memset(&total, 0, sizeof(total));
+    for (size_t i = 0; i < count; ++i) {
+        if (!batch.ok[i]) {
+            continue;
+        }
+        if (opt->histograms) {
+            printf("%s\n", batch.list.path[i]);
+            print_profile(&batch.profile[i], opt);
+            printf("\n");
+        } else {
+            print_line(batch.list.path[i], &batch.profile[i], opt->limit);
+        }
+        midi_profile_merge(&total, &batch.profile[i]);
+    }
+    printf("\n%zu files, %zu failed, %.3fs\n", count, batch.failed, elapsed);
+    print_profile(&total, opt);
+    const int ret_val = batch.failed ? 1 : 0;
+    free(batch.profile);
+    free(batch.ok);
+    path_list_free(&batch.list);
+    return ret_val;
+}
+
+int main(const int argc, const char* args[])
+{
+    struct options_t opt = { MIDI_PROFILE_WINDOW_USEC, DEFAULT_LIMIT, false };
+    int arg = 1;
+    for (; arg < argc && args[arg][0] == '-'; ++arg) {
+        if (strcmp(args[arg], "-h") == 0) {
+            opt.histograms = true;
+            continue;
+        }
+        const char* value = (arg + 1 < argc) ? args[arg + 1] : NULL;
+        if (!value) {
+            break;
+        }
+        if (strcmp(args[arg], "-w") == 0 && atoi(value) > 0) {
+            opt.window_usec = (uint32_t)atoi(value);
+        } else if (strcmp(args[arg], "-l") == 0 && atoi(value) >= 0) {
+            opt.limit = (uint32_t)atoi(value);
+        } else {
+            fprintf(stderr, "Bad option '%s %s'\n", args[arg], value);
+            return 1;
+        }
+        ++arg;
+    }
+    if (arg >= argc) {
+        fprintf(stderr, "usage: %s [-w usec] [-l voices] [-h] <file or dir> [threads]\n", args[0]);
+        return 1;
+    }
+    if (path_is_dir(args[arg])) {
+        const size_t threads = (argc - arg > 1) ? (size_t)atoi(args[arg + 1]) : 0;
+        return profile_dir(args[arg], &opt, threads);
+    }
+    struct midi_profile_t profile;
+    if (!profile_file(args[arg], opt.window_usec, &profile)) {
+        fprintf(stderr, "Unable to profile '%s'\n", args[arg]);
+        return 1;
+    }
+    print_profile(&profile, &opt);
+    return 0;
+}
@@ -0,0 +1,262 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "midiplay.h"
+
+
+// record raw midi bytes written by midiplay -o
+//
+// usage:
+//   midirecv [-s] <fifo | udp:[host:]port> [idle seconds]
+//
+// prints one line per read with its arrival time relative to the first, then
+// a summary. recording stops at end of file or after the idle time.
+//
+// with -s the sender was given a stamp: target, ie. midiplay -o stamp:udp:9000,
+// and each write carries its send time. lines are then per write and add the
+// latency from send to arrival, both taken from the same monotonic clock, so
+// sender and receiver must run on the same host.
+
+enum {
+    READ_SIZE = 64 * 1024,
+};
+
+static uint64_t clock_usec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static int open_udp(const char* spec)
+{
+    char host[256] = "127.0.0.1";
+    const char* port = strrchr(spec, ':');
+    if (port) {
+        const size_t length = (size_t)(port - spec);
+        if (length >= sizeof(host)) {
+            return -1;
+        }
+        memcpy(host, spec, length);
+        host[length] = '\0';
+        ++port;
+    } else {
+        port = spec;
+    }
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_PASSIVE;
+    struct addrinfo* info = NULL;
+    if (getaddrinfo(host, port, &hints, &info) != 0) {
+        return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo* i = info; i && fd < 0; i = i->ai_next) {
+        fd = socket(i->ai_family, i->ai_socktype | SOCK_CLOEXEC, i->ai_protocol);
+        if (fd >= 0 && bind(fd, i->ai_addr, i->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(info);
+    return fd;
+}
+
+static int open_fifo(const char* path)
+{
+    struct stat info;
+    if (stat(path, &info) != 0 && mkfifo(path, 0644) != 0) {
+        return -1;
+    }
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+// count complete channel messages, tracking running status across reads
+struct decoder_t {
+    uint8_t running;
+    uint32_t pending; // data bytes still expected
+    uint64_t messages;
+};
+
+// send to arrival latency of stamped writes
+struct latency_t {
+    uint64_t count;
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+};
+
+static void latency_add(struct latency_t* l, uint64_t usec)
+{
+    l->min = (l->count == 0 || usec < l->min) ? usec : l->min;
+    l->max = (usec > l->max) ? usec : l->max;
+    l->total += usec;
+    ++l->count;
+}
+
+static void print_read(uint64_t at, const uint8_t* data, size_t size)
+{
+    printf("%12.3f %5zu ", (double)at / 1000.0, size);
+    for (size_t i = 0; i < size && i < 24; ++i) {
+        printf(" %02x", data[i]);
+    }
+    printf((size > 24) ? " ...\n" : "\n");
+}
+
+static void decode(struct decoder_t* d, const uint8_t* data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i) {
+        const uint8_t byte = data[i];
+        if (byte & 0x80) {
+            d->running = byte;
+            d->pending = 0;
+        }
+        if (!d->running) {
+            continue;
+        }
+        if (d->pending == 0) {
+            const uint8_t type = d->running & 0xf0;
+            d->pending = (type == 0xc0 || type == 0xd0) ? 1 : 2;
+            if (byte & 0x80) {
+                continue;
+            }
+        }
+        if (--d->pending == 0) {
+            ++d->messages;
+        }
+    }
+}
+
+int main(const int argc, const char* args[])
+{
+    int arg = 1;
+    const bool stamped = (argc > 1) && strcmp(args[1], "-s") == 0;
+    if (stamped) {
+        ++arg;
+    }
+    if (argc <= arg) {
+        fprintf(stderr, "usage: %s [-s] <fifo | udp:[host:]port> [idle seconds]\n", args[0]);
+        return 1;
+    }
+    const char* target = args[arg];
+    const bool datagram = strncmp(target, "udp:", 4) == 0;
+    const int idle = (argc > arg + 1) ? atoi(args[arg + 1]) * 1000 : 5000;
+    const int fd = datagram ? open_udp(target + 4) : open_fifo(target);
+    if (fd < 0) {
+        fprintf(stderr, "Unable to open '%s'\n", target);
+        return 1;
+    }
+
+    // stamped streams are reassembled here, as writes may split across reads
+    uint8_t* buffer = (uint8_t*)malloc(READ_SIZE * 2 + sizeof(struct wire_stamp_t));
+    if (!buffer) {
+        return 1;
+    }
+    struct decoder_t decoder = { 0, 0, 0 };
+    struct latency_t latency = { 0, 0, 0, 0 };
+    uint64_t first = 0, last = 0;
+    uint64_t reads = 0, bytes = 0, writes = 0;
+    size_t largest = 0, pending = 0;
+
+    for (;;) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        const int ready = poll(&pfd, 1, idle);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready <= 0) {
+            break;
+        }
+        const ssize_t got = read(fd, buffer + pending, READ_SIZE);
+        if (got <= 0) {
+            break;
+        }
+        const uint64_t now = clock_usec();
+        if (reads == 0) {
+            first = now;
+        }
+        last = now;
+        ++reads;
+        if ((size_t)got > largest) {
+            largest = (size_t)got;
+        }
+        if (!stamped) {
+            bytes += (uint64_t)got;
+            decode(&decoder, buffer, (size_t)got);
+            print_read(now - first, buffer, (size_t)got);
+            continue;
+        }
+
+        pending += (size_t)got;
+        size_t used = 0;
+        for (;;) {
+            struct wire_stamp_t stamp;
+            if (pending - used < sizeof(stamp)) {
+                break;
+            }
+            memcpy(&stamp, buffer + used, sizeof(stamp));
+            if (stamp.size > READ_SIZE) {
+                fprintf(stderr, "Bad stamp, was the sender given stamp:?\n");
+                pending = used = 0;
+                break;
+            }
+            if (pending - used < sizeof(stamp) + stamp.size) {
+                break;
+            }
+            const uint8_t* data = buffer + used + sizeof(stamp);
+            const uint64_t delay = (now > stamp.usec) ? now - stamp.usec : 0;
+            latency_add(&latency, delay);
+            ++writes;
+            bytes += stamp.size;
+            decode(&decoder, data, stamp.size);
+            printf("%8.3fms", (double)delay / 1000.0);
+            print_read(now - first, data, stamp.size);
+            used += sizeof(stamp) + stamp.size;
+        }
+        memmove(buffer, buffer + used, pending - used);
+        pending -= used;
+        if (datagram) {
+            // a datagram holds whole writes, anything left over is damaged
+            pending = 0;
+        }
+    }
+
+    const double seconds = (double)(last - first) / 1e6;
+    fprintf(stderr, "%llu reads, %llu bytes, %llu messages over %.3fs\n",
+        (unsigned long long)reads, (unsigned long long)bytes,
+        (unsigned long long)decoder.messages, seconds);
+    fprintf(stderr, "%.2f messages and %.2f bytes per read, largest read %zu bytes\n",
+        reads ? (double)decoder.messages / (double)reads : 0.0,
+        reads ? (double)bytes / (double)reads : 0.0, largest);
+    if (stamped) {
+        fprintf(stderr, "%llu writes, latency min %.3fms, mean %.3fms, max %.3fms\n",
+            (unsigned long long)writes, (double)latency.min / 1000.0,
+            latency.count ? (double)latency.total / latency.count / 1000.0 : 0.0,
+            (double)latency.max / 1000.0);
+    }
+    free(buffer);
+    close(fd);
+    return 0;
+}
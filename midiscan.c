@@ -0,0 +1,120 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#if defined(_MSC_VER)
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libmidi.h"
+#include "midi_ingest.h"
+#include "midi_thread.h"
+#include "tool_common.h"
+
+
+// load every midi file of a library, measuring ingest throughput
+//
+// usage:
+//   midiscan [-t] [-e] <dir> [threads]
+//
+// options:
+//   -t   read with blocking reader threads even where io_uring is available
+//   -e   also decode every event of every file
+//
+// threads sets the number of parse workers.
+
+struct scan_t {
+    const struct path_list_t* list;
+    bool events;
+    volatile size_t tracks;
+    volatile size_t decoded;
+};
+
+static void scan_file(void* user, size_t index, struct midi_t* midi, const void* data, size_t size)
+{
+    struct scan_t* scan = user;
+    (void)data;
+    (void)size;
+    if (!midi) {
+        fprintf(stderr, "failed: %s\n", scan->list->path[index]);
+        return;
+    }
+    midi_atomic_add(&scan->tracks, midi->num_tracks);
+    if (!scan->events) {
+        return;
+    }
+    struct midi_mux_t* mux = midi_mux(midi);
+    if (!mux) {
+        return;
+    }
+    struct midi_event_t event;
+    uint64_t time = 0;
+    size_t track = 0, events = 0;
+    while (midi_mux_next(mux, &event, &time, &track)) {
+        ++events;
+    }
+    midi_mux_free(mux);
+    midi_atomic_add(&scan->decoded, events);
+}
+
+int main(const int argc, const char* args[])
+{
+    uint32_t flags = 0;
+    struct scan_t scan;
+    memset(&scan, 0, sizeof(scan));
+    int arg = 1;
+    for (; arg < argc && args[arg][0] == '-'; ++arg) {
+        if (strcmp(args[arg], "-t") == 0) {
+            flags |= MIDI_INGEST_NO_URING;
+        } else if (strcmp(args[arg], "-e") == 0) {
+            scan.events = true;
+        } else {
+            fprintf(stderr, "Bad option '%s'\n", args[arg]);
+            return 1;
+        }
+    }
+    if (arg >= argc) {
+        fprintf(stderr, "usage: %s [-t] [-e] <dir> [threads]\n", args[0]);
+        return 1;
+    }
+    const size_t threads = (argc - arg > 1) ? (size_t)atoi(args[arg + 1]) : 0;
+
+    struct path_list_t list;
+    memset(&list, 0, sizeof(list));
+    if (!path_scan(args[arg], ".mid", &list)) {
+        fprintf(stderr, "Unable to scan '%s'\n", args[arg]);
+        return 1;
+    }
+    scan.list = &list;
+    struct midi_ingest_stats_t stats;
+    const double start = timer_seconds();
+    const bool ok = midi_ingest((const char* const*)list.path, list.count, threads, flags,
+                                scan_file, &scan, &stats);
+    const double elapsed = timer_seconds() - start;
+    if (!ok) {
+        fprintf(stderr, "Unable to ingest '%s'\n", args[arg]);
+    }
+    printf("%zu files, %zu loaded, %zu failed, %.3fs, %s\n", list.count, stats.loaded,
+        stats.failed, elapsed,
+        (stats.backend == e_midi_ingest_uring) ? "io_uring" : "reader threads");
+    printf("%zu bytes, %zu tracks, %zu submits, %.0f files/s, %.1f MB/s\n",
+        stats.bytes, scan.tracks, stats.submits,
+        elapsed > 0.0 ? list.count / elapsed : 0.0,
+        elapsed > 0.0 ? stats.bytes / elapsed / (1024.0 * 1024.0) : 0.0);
+    if (scan.events) {
+        printf("%zu events decoded\n", scan.decoded);
+    }
+    const int ret_val = (ok && stats.failed == 0) ? 0 : 1;
+    path_list_free(&list);
+    return ret_val;
+}
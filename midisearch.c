@@ -0,0 +1,249 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#if defined(_MSC_VER)
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libmidi.h"
+#include "midi_ngram.h"
+#include "midi_thread.h"
+#include "tool_common.h"
+
+
+// find songs containing a melodic phrase
+//
+// usage:
+//   midisearch index <dir> <index file> [threads]
+//   midisearch query <index file> <file.mid | key,key,...> [count]
+//
+// a query given as keys, ie. 60,62,64,65,67, only matches intervals. a query
+// given as a midi file also matches rhythm.
+
+enum {
+    MAX_QUERY_KEYS = 1024,
+};
+
+static bool grams_from_file(const char* path, struct midi_ngrams_t* grams)
+{
+    struct file_t file;
+    if (!file_load(path, &file)) {
+        return false;
+    }
+    struct midi_t* midi = midi_load(file.file_, file.size_);
+    const bool ok = midi && midi_ngrams_build(midi, grams);
+    if (midi) {
+        midi_free(midi);
+    }
+    file_free(&file);
+    return ok;
+}
+
+// ----------------------------------------------------------------------------
+// Indexing
+// ----------------------------------------------------------------------------
+
+struct batch_t {
+    struct path_list_t list;
+    struct midi_ngrams_t* grams;
+    volatile size_t failed;
+};
+
+static void batch_job(void* user, size_t index)
+{
+    struct batch_t* batch = user;
+    if (!grams_from_file(batch->list.path[index], &batch->grams[index])) {
+        fprintf(stderr, "failed: %s\n", batch->list.path[index]);
+        midi_atomic_add(&batch->failed, 1);
+    }
+}
+
+static bool write_paths(const struct path_list_t* list, FILE* fd)
+{
+    const uint32_t count = (uint32_t)list->count;
+    if (fwrite(&count, sizeof(count), 1, fd) != 1) {
+        return false;
+    }
+    for (size_t i = 0; i < list->count; ++i) {
+        const uint32_t length = (uint32_t)strlen(list->path[i]);
+        if (fwrite(&length, sizeof(length), 1, fd) != 1 ||
+            fwrite(list->path[i], 1, length, fd) != length) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int index_dir(const char* root, const char* out_path, size_t threads)
+{
+    const double start = timer_seconds();
+    struct batch_t batch;
+    memset(&batch, 0, sizeof(batch));
+    if (!path_scan(root, ".mid", &batch.list)) {
+        fprintf(stderr, "Unable to scan '%s'\n", root);
+        return 1;
+    }
+    const size_t count = batch.list.count;
+    batch.grams = calloc(count ? count : 1, sizeof(struct midi_ngrams_t));
+    if (!batch.grams) {
+        path_list_free(&batch.list);
+        return 1;
+    }
+    midi_parallel_for(count, threads, batch_job, &batch);
+    const double parsed = timer_seconds();
+
+    size_t grams = 0;
+    for (size_t i = 0; i < count; ++i) {
+        grams += batch.grams[i].count;
+    }
+    struct midi_ngram_index_t index;
+    bool ok = midi_ngram_index_build(&index, batch.grams, count);
+    for (size_t i = 0; i < count; ++i) {
+        midi_ngrams_free(&batch.grams[i]);
+    }
+    free(batch.grams);
+
+    FILE* fd = ok ? fopen(out_path, "wb") : NULL;
+    ok = fd && midi_ngram_index_save(&index, fd) && write_paths(&batch.list, fd);
+    if (fd) {
+        ok = (fclose(fd) == 0) && ok;
+    }
+    if (ok) {
+        printf("%zu files, %zu failed, %zu song grams, %zu keys, %llu posting bytes\n",
+            count, batch.failed, grams, index.keys, (unsigned long long)index.size);
+        printf("grams %.3fs, index %.3fs\n", parsed - start, timer_seconds() - parsed);
+    } else {
+        fprintf(stderr, "Unable to write '%s'\n", out_path);
+    }
+    midi_ngram_index_free(&index);
+    path_list_free(&batch.list);
+    return ok ? 0 : 1;
+}
+
+// ----------------------------------------------------------------------------
+// Queries
+// ----------------------------------------------------------------------------
+
+static bool read_paths(struct path_list_t* list, FILE* fd)
+{
+    uint32_t count = 0;
+    if (fread(&count, sizeof(count), 1, fd) != 1) {
+        return false;
+    }
+    list->path = calloc(count ? count : 1, sizeof(char*));
+    if (!list->path) {
+        return false;
+    }
+    list->capacity = count;
+    for (; list->count < count; ++list->count) {
+        uint32_t length = 0;
+        if (fread(&length, sizeof(length), 1, fd) != 1) {
+            return false;
+        }
+        char* path = malloc(length + 1);
+        if (!path || fread(path, 1, length, fd) != length) {
+            free(path);
+            return false;
+        }
+        path[length] = '\0';
+        list->path[list->count] = path;
+    }
+    return true;
+}
+
+static bool parse_keys(const char* text, struct midi_ngrams_t* grams)
+{
+    uint8_t key[MAX_QUERY_KEYS];
+    size_t count = 0;
+    while (*text && count < MAX_QUERY_KEYS) {
+        char* end = NULL;
+        const long value = strtol(text, &end, 10);
+        if (end == text || value < 0 || value > 127) {
+            return false;
+        }
+        key[count++] = (uint8_t)value;
+        text = (*end == ',') ? end + 1 : end;
+    }
+    if (count < MIDI_NGRAM_NOTES) {
+        fprintf(stderr, "A query needs at least %d keys\n", MIDI_NGRAM_NOTES);
+        return false;
+    }
+    return midi_ngrams_from_keys(key, NULL, count, grams);
+}
+
+static int query(const char* index_path, const char* text, size_t k)
+{
+    const double start = timer_seconds();
+    FILE* fd = fopen(index_path, "rb");
+    if (!fd) {
+        fprintf(stderr, "Unable to open '%s'\n", index_path);
+        return 1;
+    }
+    struct midi_ngram_index_t index;
+    struct path_list_t list = { NULL, 0, 0 };
+    const bool loaded = midi_ngram_index_load(&index, fd) && read_paths(&list, fd) &&
+                        list.count == index.songs;
+    fclose(fd);
+    if (!loaded) {
+        fprintf(stderr, "Unable to read index '%s'\n", index_path);
+        midi_ngram_index_free(&index);
+        path_list_free(&list);
+        return 1;
+    }
+    const double opened = timer_seconds();
+
+    struct midi_ngrams_t grams = { NULL, 0, 0 };
+    // comma separated keys, or else a midi file
+    const bool keys = strchr(text, ',') && strspn(text, "0123456789, ") == strlen(text);
+    const bool parsed = keys ? parse_keys(text, &grams) : grams_from_file(text, &grams);
+    struct midi_ngram_hit_t* hits = calloc(k, sizeof(struct midi_ngram_hit_t));
+    if (!parsed || !hits) {
+        fprintf(stderr, "Unable to read query '%s'\n", text);
+        free(hits);
+        midi_ngrams_free(&grams);
+        midi_ngram_index_free(&index);
+        path_list_free(&list);
+        return 1;
+    }
+    const double queried = timer_seconds();
+    const size_t found = midi_ngram_query(&index, &grams, hits, k);
+    const double done = timer_seconds();
+
+    for (size_t i = 0; i < found; ++i) {
+        printf("%3zu %8.2f  %s\n", i + 1, hits[i].score, list.path[hits[i].song]);
+    }
+    printf("%zu query grams, load %.2fms, query %.3fms\n", grams.count,
+        (opened - start) * 1000.0, (done - queried) * 1000.0);
+
+    free(hits);
+    midi_ngrams_free(&grams);
+    midi_ngram_index_free(&index);
+    path_list_free(&list);
+    return 0;
+}
+
+int main(const int argc, const char* args[])
+{
+    if (argc >= 4 && strcmp(args[1], "index") == 0) {
+        const size_t threads = (argc > 4) ? (size_t)atoi(args[4]) : 0;
+        return index_dir(args[2], args[3], threads);
+    }
+    if (argc >= 4 && strcmp(args[1], "query") == 0) {
+        const int k = (argc > 4) ? atoi(args[4]) : 10;
+        return query(args[2], args[3], (k > 0) ? (size_t)k : 10);
+    }
+    fprintf(stderr, "usage: %s index <dir> <index file> [threads]\n", args[0]);
+    fprintf(stderr, "       %s query <index file> <file.mid | key,key,...> [count]\n", args[0]);
+    return 1;
+}
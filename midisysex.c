@@ -0,0 +1,291 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#if defined(_MSC_VER)
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libmidi.h"
+#include "midi_sysex.h"
+#include "midi_thread.h"
+#include "tool_common.h"
+
+
+// list the system exclusive messages of midi files
+//
+// usage:
+//   midisysex <file> [out.syx]
+//   midisysex -c <file> <expected.syx>
+//   midisysex <dir> [threads]
+//
+// a file lists each message, and with an output file also writes them out
+// one after another as a .syx dump. a directory only gives totals.
+//
+// -c checks the assembled bytes of every message and escape, in order,
+// against a dump, and fails on the first difference. data/sysex/split.mid
+// with split.syx covers a message split over an F0 start and two F7
+// continuations, followed by an escape.
+
+enum {
+    SHOW_BYTES = 12,
+};
+
+struct totals_t {
+    volatile size_t messages;
+    volatile size_t split;      // messages spread over several events
+    volatile size_t escapes;
+    volatile size_t bytes;
+    volatile size_t dropped;
+    volatile size_t failed;
+};
+
+struct known_t {
+    const char* name;
+    uint8_t size;
+    uint8_t data[11];
+};
+
+static const struct known_t known[] = {
+    { "GM system on", 6, { 0xf0, 0x7e, 0x7f, 0x09, 0x01, 0xf7 } },
+    { "GM system off", 6, { 0xf0, 0x7e, 0x7f, 0x09, 0x02, 0xf7 } },
+    { "GS reset", 11, { 0xf0, 0x41, 0x10, 0x42, 0x12, 0x40, 0x00, 0x7f, 0x00, 0x41, 0xf7 } },
+    { "XG system on", 9, { 0xf0, 0x43, 0x10, 0x4c, 0x00, 0x00, 0x7e, 0x00, 0xf7 } },
+};
+
+// a dump being compared against as messages are assembled
+struct check_t {
+    const uint8_t* data;
+    size_t size;
+    size_t offset;
+    bool differs;
+};
+
+static void check_bytes(struct check_t* check, const uint8_t* flat, size_t size)
+{
+    if (check->differs) {
+        return;
+    }
+    if (size > check->size - check->offset ||
+        memcmp(check->data + check->offset, flat, size) != 0) {
+        fprintf(stderr, "the message at byte %zu differs from expected\n", check->offset);
+        check->differs = true;
+        return;
+    }
+    check->offset += size;
+}
+
+static const char* known_name(const uint8_t* data, size_t size)
+{
+    for (size_t i = 0; i < sizeof(known) / sizeof(known[0]); ++i) {
+        if (size == known[i].size && memcmp(data, known[i].data, size) == 0) {
+            return known[i].name;
+        }
+    }
+    return "";
+}
+
+static void print_message(
+    const struct midi_sysex_t* sysex,
+    const uint8_t* flat,
+    uint32_t track,
+    uint64_t time)
+{
+    const size_t size = (size_t)sysex->size + (sysex->escape ? 0 : 1);
+    printf("%3u %8llu  %-6s %6zu bytes %3zu spans ", track, (unsigned long long)time,
+        sysex->escape ? "escape" : "sysex", size, sysex->count);
+    for (size_t i = 0; i < size && i < SHOW_BYTES; ++i) {
+        printf(" %02x", flat[i]);
+    }
+    printf("%s  %s\n", (size > SHOW_BYTES) ? " .." : "", known_name(flat, size));
+}
+
+// walk every track of a file, listing messages when 'list' is set
+static bool sysex_file(
+    const char* path,
+    bool list,
+    FILE* out,
+    struct check_t* check,
+    struct totals_t* totals)
+{
+    struct file_t file;
+    if (!file_load(path, &file)) {
+        return false;
+    }
+    struct midi_t* midi = midi_load(file.file_, file.size_);
+    if (!midi) {
+        file_free(&file);
+        return false;
+    }
+    struct midi_sysex_t sysex;
+    memset(&sysex, 0, sizeof(sysex));
+    struct midi_sysex_pool_t pool = { NULL, NULL };
+    bool ok = true;
+    size_t messages = 0, split = 0, escapes = 0, bytes = 0;
+    for (uint32_t i = 0; ok && i < midi->num_tracks; ++i) {
+        struct midi_stream_t* stream = midi_stream(midi, i);
+        if (!stream) {
+            ok = false;
+            break;
+        }
+        struct midi_event_t event;
+        uint64_t time = 0;
+        while (!midi_stream_end(stream) && midi_event_next(stream, &event)) {
+            time += event.delta;
+            const enum midi_sysex_result_t result = midi_sysex_push(&sysex, &event);
+            if (result == e_midi_sysex_none) {
+                continue;
+            }
+            const bool escape = (result == e_midi_sysex_escape);
+            messages += escape ? 0 : 1;
+            split += (!escape && sysex.count > 1) ? 1 : 0;
+            escapes += escape ? 1 : 0;
+            const size_t size = (size_t)sysex.size + (escape ? 0 : 1);
+            bytes += size;
+            if (list || out || check) {
+                // copies only live until the next message
+                midi_sysex_pool_reset(&pool);
+                const uint8_t* flat = midi_sysex_copy(&sysex, &pool);
+                if (!flat) {
+                    ok = false;
+                    break;
+                }
+                if (list) {
+                    print_message(&sysex, flat, i, time);
+                }
+                if (check) {
+                    check_bytes(check, flat, size);
+                }
+                if (out && !escape && fwrite(flat, 1, size, out) != size) {
+                    ok = false;
+                    break;
+                }
+            }
+        }
+        midi_stream_free(stream);
+        // a message can not carry on into another track
+        sysex.dropped += sysex.pending ? 1 : 0;
+        sysex.pending = false;
+    }
+    midi_atomic_add(&totals->messages, messages);
+    midi_atomic_add(&totals->split, split);
+    midi_atomic_add(&totals->escapes, escapes);
+    midi_atomic_add(&totals->bytes, bytes);
+    midi_atomic_add(&totals->dropped, (size_t)sysex.dropped);
+    midi_sysex_pool_free(&pool);
+    midi_sysex_free(&sysex);
+    midi_free(midi);
+    file_free(&file);
+    return ok;
+}
+
+static void print_totals(const struct totals_t* t)
+{
+    printf("%zu messages (%zu split), %zu escapes, %zu bytes, %zu dropped\n",
+        t->messages, t->split, t->escapes, t->bytes, t->dropped);
+}
+
+struct batch_t {
+    struct path_list_t list;
+    struct totals_t totals;
+};
+
+static void batch_job(void* user, size_t index)
+{
+    struct batch_t* batch = user;
+    if (!sysex_file(batch->list.path[index], false, NULL, NULL, &batch->totals)) {
+        fprintf(stderr, "failed: %s\n", batch->list.path[index]);
+        midi_atomic_add(&batch->totals.failed, 1);
+    }
+}
+
+static int sysex_dir(const char* root, size_t threads)
+{
+    struct batch_t batch;
+    memset(&batch, 0, sizeof(batch));
+    if (!path_scan(root, ".mid", &batch.list)) {
+        fprintf(stderr, "Unable to scan '%s'\n", root);
+        return 1;
+    }
+    const double start = timer_seconds();
+    midi_parallel_for(batch.list.count, threads, batch_job, &batch);
+    printf("%zu files, %zu failed, %.3fs\n",
+        batch.list.count, batch.totals.failed, timer_seconds() - start);
+    print_totals(&batch.totals);
+    const int ret_val = batch.totals.failed ? 1 : 0;
+    path_list_free(&batch.list);
+    return ret_val;
+}
+
+static int sysex_check(const char* path, const char* expected_path)
+{
+    struct file_t expected;
+    if (!file_load(expected_path, &expected)) {
+        fprintf(stderr, "Unable to read '%s'\n", expected_path);
+        return 1;
+    }
+    struct check_t check = { expected.file_, expected.size_, 0, false };
+    struct totals_t totals;
+    memset(&totals, 0, sizeof(totals));
+    const bool ok = sysex_file(path, true, NULL, &check, &totals);
+    file_free(&expected);
+    if (!ok) {
+        fprintf(stderr, "Unable to read '%s'\n", path);
+        return 1;
+    }
+    print_totals(&totals);
+    if (!check.differs && check.offset != check.size) {
+        fprintf(stderr, "%zu expected bytes were not assembled\n", check.size - check.offset);
+        check.differs = true;
+    }
+    printf("%s\n", check.differs ? "check failed" : "check passed");
+    return check.differs ? 1 : 0;
+}
+
+int main(const int argc, const char* args[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <file> [out.syx]\n", args[0]);
+        fprintf(stderr, "       %s -c <file> <expected.syx>\n", args[0]);
+        fprintf(stderr, "       %s <dir> [threads]\n", args[0]);
+        return 1;
+    }
+    if (strcmp(args[1], "-c") == 0) {
+        if (argc < 4) {
+            fprintf(stderr, "usage: %s -c <file> <expected.syx>\n", args[0]);
+            return 1;
+        }
+        return sysex_check(args[2], args[3]);
+    }
+    if (path_is_dir(args[1])) {
+        const size_t threads = (argc > 2) ? (size_t)atoi(args[2]) : 0;
+        return sysex_dir(args[1], threads);
+    }
+    FILE* out = NULL;
+    if (argc > 2 && !(out = fopen(args[2], "wb"))) {
+        fprintf(stderr, "Unable to open '%s'\n", args[2]);
+        return 1;
+    }
+    struct totals_t totals;
+    memset(&totals, 0, sizeof(totals));
+    bool ok = sysex_file(args[1], true, out, NULL, &totals);
+    if (out) {
+        ok = (fclose(out) == 0) && ok;
+    }
+    if (!ok) {
+        fprintf(stderr, "Unable to read '%s'\n", args[1]);
+        return 1;
+    }
+    print_totals(&totals);
+    return 0;
+}
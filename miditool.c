@@ -168,6 +168,31 @@ int dump_demux_events(struct midi_t* mid)
     return 0;
 }
 
+static void print_stats(void)
+{
+    struct midi_stats_t s;
+    if (!midi_stats_get(&s)) {
+        // libmidi was built without MIDI_STATS
+        return;
+    }
+    fprintf(stderr, "bytes %llu, vlq bytes %llu, running status %llu\n",
+        (unsigned long long)s.bytes, (unsigned long long)s.vlq_bytes,
+        (unsigned long long)s.running_status);
+    fprintf(stderr, "events");
+    for (int i = 0; i < MIDI_STATS_EVENT_TYPES; ++i) {
+        fprintf(stderr, " %llu", (unsigned long long)s.events[i]);
+    }
+    fprintf(stderr, "\npeeks %llu, mux compares %llu, allocations %llu\n",
+        (unsigned long long)s.peeks, (unsigned long long)s.mux_compares,
+        (unsigned long long)s.allocations);
+    if (s.next_calls) {
+        fprintf(stderr, "load %llu / %llu, next %llu / %llu, mux %llu / %llu\n",
+            (unsigned long long)s.load_time, (unsigned long long)s.load_calls,
+            (unsigned long long)s.next_time, (unsigned long long)s.next_calls,
+            (unsigned long long)s.mux_time, (unsigned long long)s.mux_calls);
+    }
+}
+
 const char * path = "";
 
 #if defined(_MSC_VER)
@@ -213,6 +238,7 @@ int main(const int argc, const char* args[])
         break;
     }
     midi_free(mid);
+    print_stats();
     // success
     return ret_val;
 }
@@ -0,0 +1,209 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#if defined(_MSC_VER)
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libmidi.h"
+#include "midi_thread.h"
+#include "midi_ump.h"
+#include "midi_writer.h"
+#include "tool_common.h"
+
+
+// convert midi files to universal midi packets and back
+//
+// usage:
+//   midiump <file.mid> <out.ump> [-jr]
+//   midiump -d <file.ump> <out.mid>
+//   midiump <dir> [threads]
+//
+// a .ump file is the raw array of 32 bit words in native byte order, always
+// with delta clockstamps, and with jitter reduction timestamps given -jr. a
+// directory converts every file in memory and back again, giving totals.
+
+struct totals_t {
+    volatile size_t words;
+    volatile size_t events;
+    volatile size_t skipped;
+    volatile size_t bytes;      // size of the files written back
+    volatile size_t failed;
+};
+
+// convert one file and write the words back out as midi, in memory
+static bool ump_file(const char* path, struct totals_t* totals)
+{
+    struct file_t file;
+    if (!file_load(path, &file)) {
+        return false;
+    }
+    struct midi_t* midi = midi_load(file.file_, file.size_);
+    if (!midi) {
+        file_free(&file);
+        return false;
+    }
+    struct midi_ump_t ump;
+    memset(&ump, 0, sizeof(ump));
+    struct midi_writer_t writer;
+    midi_writer_init(&writer, NULL);
+    bool ok = midi_ump_encode(midi, MIDI_UMP_CLOCKSTAMPS | MIDI_UMP_JR_TIMESTAMPS, 0, &ump) &&
+              midi_ump_save(ump.word, ump.count, &writer);
+    if (ok) {
+        midi_atomic_add(&totals->words, ump.count);
+        midi_atomic_add(&totals->skipped, (size_t)ump.skipped);
+        midi_atomic_add(&totals->bytes, writer.size);
+        struct midi_ump_reader_t reader;
+        midi_ump_reader_init(&reader, ump.word, ump.count);
+        struct midi_event_t event;
+        uint64_t time = 0;
+        size_t events = 0;
+        while (midi_ump_next(&reader, &event, &time)) {
+            ++events;
+        }
+        midi_ump_reader_free(&reader);
+        midi_atomic_add(&totals->events, events);
+    }
+    midi_writer_free(&writer);
+    midi_ump_free(&ump);
+    midi_free(midi);
+    file_free(&file);
+    return ok;
+}
+
+struct batch_t {
+    struct path_list_t list;
+    struct totals_t totals;
+};
+
+static void batch_job(void* user, size_t index)
+{
+    struct batch_t* batch = user;
+    if (!ump_file(batch->list.path[index], &batch->totals)) {
+        fprintf(stderr, "failed: %s\n", batch->list.path[index]);
+        midi_atomic_add(&batch->totals.failed, 1);
+    }
+}
+
+static int ump_dir(const char* root, size_t threads)
+{
+    struct batch_t batch;
+    memset(&batch, 0, sizeof(batch));
+    if (!path_scan(root, ".mid", &batch.list)) {
+        fprintf(stderr, "Unable to scan '%s'\n", root);
+        return 1;
+    }
+    const double start = timer_seconds();
+    midi_parallel_for(batch.list.count, threads, batch_job, &batch);
+    printf("%zu files, %zu failed, %.3fs\n",
+        batch.list.count, batch.totals.failed, timer_seconds() - start);
+    printf("%zu words, %zu events read back, %zu skipped, %zu bytes written\n",
+        batch.totals.words, batch.totals.events, batch.totals.skipped, batch.totals.bytes);
+    const int ret_val = batch.totals.failed ? 1 : 0;
+    path_list_free(&batch.list);
+    return ret_val;
+}
+
+static int encode(const char* in, const char* out, uint32_t flags)
+{
+    struct file_t file;
+    if (!file_load(in, &file)) {
+        fprintf(stderr, "Unable to load '%s'\n", in);
+        return 1;
+    }
+    struct midi_t* midi = midi_load(file.file_, file.size_);
+    if (!midi) {
+        fprintf(stderr, "Unable to parse '%s'\n", in);
+        file_free(&file);
+        return 1;
+    }
+    struct midi_ump_t ump;
+    memset(&ump, 0, sizeof(ump));
+    int ret_val = 1;
+    FILE* fd = NULL;
+    if (!midi_ump_encode(midi, flags, 0, &ump)) {
+        fprintf(stderr, "Unable to convert '%s'\n", in);
+    } else if (!(fd = fopen(out, "wb"))) {
+        fprintf(stderr, "Unable to open '%s'\n", out);
+    } else {
+        const bool ok = fwrite(ump.word, sizeof(uint32_t), ump.count, fd) == ump.count;
+        if (fclose(fd) != 0 || !ok) {
+            fprintf(stderr, "Unable to write '%s'\n", out);
+        } else {
+            printf("%zu words, %llu events skipped\n",
+                ump.count, (unsigned long long)ump.skipped);
+            ret_val = 0;
+        }
+    }
+    midi_ump_free(&ump);
+    midi_free(midi);
+    file_free(&file);
+    return ret_val;
+}
+
+static int decode(const char* in, const char* out)
+{
+    struct file_t file;
+    if (!file_load(in, &file)) {
+        fprintf(stderr, "Unable to load '%s'\n", in);
+        return 1;
+    }
+    const size_t count = file.size_ / sizeof(uint32_t);
+    uint32_t* word = malloc((count ? count : 1) * sizeof(uint32_t));
+    if (!word) {
+        file_free(&file);
+        return 1;
+    }
+    memcpy(word, file.file_, count * sizeof(uint32_t));
+    file_free(&file);
+    FILE* fd = fopen(out, "wb");
+    if (!fd) {
+        fprintf(stderr, "Unable to open '%s'\n", out);
+        free(word);
+        return 1;
+    }
+    struct midi_writer_t writer;
+    midi_writer_init(&writer, fd);
+    bool ok = midi_ump_save(word, count, &writer);
+    midi_writer_free(&writer);
+    ok = (fclose(fd) == 0) && ok;
+    free(word);
+    if (!ok) {
+        fprintf(stderr, "Unable to convert '%s'\n", in);
+        return 1;
+    }
+    return 0;
+}
+
+int main(const int argc, const char* args[])
+{
+    if (argc >= 4 && strcmp(args[1], "-d") == 0) {
+        return decode(args[2], args[3]);
+    }
+    if (argc >= 2 && path_is_dir(args[1])) {
+        const size_t threads = (argc > 2) ? (size_t)atoi(args[2]) : 0;
+        return ump_dir(args[1], threads);
+    }
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <file.mid> <out.ump> [-jr]\n", args[0]);
+        fprintf(stderr, "       %s -d <file.ump> <out.mid>\n", args[0]);
+        fprintf(stderr, "       %s <dir> [threads]\n", args[0]);
+        return 1;
+    }
+    uint32_t flags = MIDI_UMP_CLOCKSTAMPS;
+    if (argc > 3 && strcmp(args[3], "-jr") == 0) {
+        flags |= MIDI_UMP_JR_TIMESTAMPS;
+    }
+    return encode(args[1], args[2], flags);
+}
@@ -0,0 +1,289 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#if defined(_MSC_VER)
+#define WIN32_LEAN_AND_MEAN
+#define _CRT_SECURE_NO_WARNINGS
+#include <Windows.h>
+#include <direct.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tool_common.h"
+
+
+bool file_load(const char* path, struct file_t* out)
+{
+#define TRY(EXPR)       \
+    {                   \
+        if (!(EXPR))    \
+            goto error; \
+    }
+    assert(path && out);
+    out->file_ = NULL;
+    FILE* fd = fopen(path, "rb");
+    TRY(fd);
+    TRY(fseek(fd, 0, SEEK_END) == 0);
+    TRY((out->size_ = ftell(fd)) > 0);
+    TRY(out->file_ = malloc(out->size_));
+    rewind(fd);
+    TRY(fread(out->file_, 1, out->size_, fd) == out->size_);
+    fclose(fd);
+    return true;
+error:
+    if (fd) {
+        fclose(fd);
+    }
+    free(out->file_);
+    out->file_ = NULL;
+    return false;
+#undef TRY
+}
+
+void file_free(struct file_t* file)
+{
+    assert(file);
+    free(file->file_);
+    file->file_ = NULL;
+    file->size_ = 0;
+}
+
+bool file_map(const char* path, struct file_t* out)
+{
+    assert(path && out);
+    out->file_ = NULL;
+    out->size_ = 0;
+#if defined(_MSC_VER)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL) {
+        return false;
+    }
+    // the view keeps the mapping alive
+    void* base = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(mapping);
+    if (base == NULL) {
+        return false;
+    }
+    out->size_ = (size_t)size.QuadPart;
+#else
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    void* base = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+    out->size_ = (size_t)st.st_size;
+#endif
+    out->file_ = base;
+    return true;
+}
+
+void file_unmap(struct file_t* file)
+{
+    assert(file);
+    if (file->file_) {
+#if defined(_MSC_VER)
+        UnmapViewOfFile(file->file_);
+#else
+        munmap(file->file_, file->size_);
+#endif
+    }
+    file->file_ = NULL;
+    file->size_ = 0;
+}
+
+bool path_is_dir(const char* path)
+{
+#if defined(_MSC_VER)
+    const DWORD attr = GetFileAttributesA(path);
+    return attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY);
+#else
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+}
+
+static bool make_dir(const char* path)
+{
+    if (path_is_dir(path)) {
+        return true;
+    }
+    // another thread may have created it in the meantime
+#if defined(_MSC_VER)
+    return _mkdir(path) == 0 || path_is_dir(path);
+#else
+    return mkdir(path, 0777) == 0 || path_is_dir(path);
+#endif
+}
+
+bool path_make_dirs(const char* path)
+{
+    char temp[1024];
+    const size_t len = strlen(path);
+    if (len == 0 || len >= sizeof(temp)) {
+        return false;
+    }
+    memcpy(temp, path, len + 1);
+    for (size_t i = 1; i < len; ++i) {
+        if (temp[i] == '/' || temp[i] == '\\') {
+            const char c = temp[i];
+            temp[i] = '\0';
+            if (!make_dir(temp)) {
+                return false;
+            }
+            temp[i] = c;
+        }
+    }
+    return make_dir(temp);
+}
+
+static bool has_ext(const char* name, const char* ext)
+{
+    const size_t n = strlen(name), e = strlen(ext);
+    if (n < e) {
+        return false;
+    }
+    for (size_t i = 0; i < e; ++i) {
+        if (tolower((unsigned char)name[n - e + i]) != tolower((unsigned char)ext[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void list_push(struct path_list_t* list, const char* path)
+{
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 256;
+        list->path = realloc(list->path, list->capacity * sizeof(char*));
+        assert(list->path);
+    }
+    const size_t len = strlen(path);
+    char* copy = malloc(len + 1);
+    assert(copy);
+    memcpy(copy, path, len + 1);
+    list->path[list->count++] = copy;
+}
+
+static int compare_path(const void* a, const void* b)
+{
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+static bool scan(const char* root, const char* ext, struct path_list_t* out)
+{
+    char path[1024];
+#if defined(_MSC_VER)
+    snprintf(path, sizeof(path), "%s\\*", root);
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA(path, &data);
+    if (find == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    do {
+        const char* name = data.cFileName;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s\\%s", root, name);
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            scan(path, ext, out);
+        } else if (has_ext(name, ext)) {
+            list_push(out, path);
+        }
+    } while (FindNextFileA(find, &data));
+    FindClose(find);
+#else
+    DIR* dir = opendir(root);
+    if (!dir) {
+        return false;
+    }
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != NULL) {
+        const char* name = ent->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", root, name);
+        if (path_is_dir(path)) {
+            scan(path, ext, out);
+        } else if (has_ext(name, ext)) {
+            list_push(out, path);
+        }
+    }
+    closedir(dir);
+#endif
+    return true;
+}
+
+bool path_scan(const char* root, const char* ext, struct path_list_t* out)
+{
+    assert(root && ext && out);
+    if (!scan(root, ext, out)) {
+        return false;
+    }
+    // directory order is not stable across platforms
+    qsort(out->path, out->count, sizeof(char*), compare_path);
+    return true;
+}
+
+void path_list_free(struct path_list_t* list)
+{
+    assert(list);
+    for (size_t i = 0; i < list->count; ++i) {
+        free(list->path[i]);
+    }
+    free(list->path);
+    memset(list, 0, sizeof(struct path_list_t));
+}
+
+double timer_seconds(void)
+{
+#if defined(_MSC_VER)
+    LARGE_INTEGER counter, freq;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&freq);
+    return (double)counter.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
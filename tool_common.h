@@ -0,0 +1,71 @@
+//  ____     _____________      _____   ___________   ___
+// |    |\  |   \______   \    /     \ |   \______ \ |   |\
+// |    ||  |   ||    |  _/\  /  \ /  \|   ||    |  \|   ||
+// |    ||__|   ||    |   \/ /    Y    \   ||    `   \   ||
+// |________\___||________/\ \____|____/___/_________/___||
+//  \________\___\________\/  \____\____\__\_________\____\
+
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// helpers shared by the command line tools
+
+struct file_t {
+    void* file_;
+    size_t size_;
+};
+
+struct path_list_t {
+    char** path;
+    size_t count;
+    size_t capacity;
+};
+
+// load a whole file into memory
+bool file_load(
+    const char* path,
+    struct file_t* out);
+
+// release a loaded file
+void file_free(
+    struct file_t* file);
+
+// map a whole file copy on write, so it can be edited without changing it
+bool file_map(
+    const char* path,
+    struct file_t* out);
+
+// release a mapped file
+void file_unmap(
+    struct file_t* file);
+
+// return true if path names a directory
+bool path_is_dir(
+    const char* path);
+
+// create a directory and any missing parents
+bool path_make_dirs(
+    const char* path);
+
+// recursively collect all files under root with the given extension
+// note: the extension match is case insensitive, ie. ".mid"
+bool path_scan(
+    const char* root,
+    const char* ext,
+    struct path_list_t* out);
+
+// release a path list
+void path_list_free(
+    struct path_list_t* list);
+
+// wall clock time in seconds from an arbitrary origin
+double timer_seconds(void);
+
+#if defined(__cplusplus)
+} // extern "C"
+#endif